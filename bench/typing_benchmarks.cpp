@@ -0,0 +1,608 @@
+// Benchmarks for the scoring, persistence and rendering hot paths. Built by
+// CMake when Google Benchmark is installed; `cmake --build build --target
+// run_benchmarks` writes the results to build/benchmark_results.json.
+//
+// The program is compiled in directly so the benchmarks call the same code
+// the checker runs. Everything touching files works in a scratch directory
+// that is removed on exit.
+
+#define TYPING_SPEED_NO_MAIN
+#include "../typingspeedtester.cpp"
+
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <new>
+
+// Every heap allocation goes through here, so a benchmark can count the
+// ones its own thread makes while countingAllocations is set.
+static thread_local bool countingAllocations = false;
+static thread_local long allocationCount = 0;
+
+// GCC sees free() on memory from operator new once these are inlined; here
+// both sides are malloc/free, so the pairing is correct.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(size_t size) {
+    if (countingAllocations) allocationCount++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+const char* benchWords[] = {"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+                            "typing", "practice", "makes", "perfect", "speed", "accuracy"};
+
+// Accented words, smart quotes and emoji with a skin-tone modifier: two to
+// eight bytes per character.
+const char* unicodeWords[] = {"café", "naïve", "résumé", "“quoted”", "Zürich", "über", "señor", "👍🏽",
+                              "the", "quick", "brown", "fox", "jumps", "dog"};
+
+string makePassage(size_t length, mt19937& rng, const char** words = benchWords) {
+    string text;
+    text.reserve(length + 16);
+    while (text.length() < length) {
+        text += words[rng() % 14];
+        text += ' ';
+    }
+    text.resize(length);
+    // Drop a character the cut left without all of its bytes.
+    size_t start = text.length();
+    while (start > 0 && ((unsigned char)text[start - 1] & 0xC0) == 0x80) start--;
+    if (start > 0) {
+        unsigned char lead = text[start - 1];
+        size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+        if (start - 1 + need > text.length()) text.resize(start - 1);
+    }
+    return text;
+}
+
+// A skipped character near the start and ~2% random typos, as in
+// --bench-scoring.
+string makeAttempt(const string& original, mt19937& rng) {
+    string typed = original;
+    if (typed.length() > 1) {
+        size_t at = min<size_t>(5, typed.length() - 1);
+        while (at > 0 && ((unsigned char)typed[at] & 0xC0) == 0x80) at--;
+        size_t length;
+        codepointAt(typed, at, length);
+        typed.erase(at, length);
+    }
+    for (char& c : typed) {
+        if (rng() % 50 == 0 && (unsigned char)c < 0x80) c = 'a' + rng() % 26;
+    }
+    return typed;
+}
+
+struct Attempt {
+    string original;
+    string typed;
+};
+
+const Attempt& attemptOf(size_t length, bool unicode = false) {
+    static map<pair<size_t, bool>, Attempt> cache;
+    auto it = cache.find({length, unicode});
+    if (it == cache.end()) {
+        mt19937 rng(12345 + length);
+        Attempt a;
+        a.original = makePassage(length, rng, unicode ? unicodeWords : benchWords);
+        a.typed = makeAttempt(a.original, rng);
+        it = cache.emplace(make_pair(length, unicode), move(a)).first;
+    }
+    return it->second;
+}
+
+// Result i of count, from 1000 users over 2026.
+TypingStats makeResult(size_t i, size_t count, mt19937& rng) {
+    const char* levels[] = {"Easy", "Medium", "Hard", "Expert", "Timed-60s", "Custom"};
+    TypingStats stats;
+    stats.name = "user-" + to_string(rng() % 1000);
+    stats.wpm = 20 + (rng() % 12000) / 100.0;
+    stats.accuracy = 80 + (rng() % 2000) / 100.0;
+    stats.time = 10 + rng() % 50;
+    stats.correctChars = 100 + rng() % 200;
+    stats.totalChars = stats.correctChars + rng() % 10;
+    stats.errors = stats.totalChars - stats.correctChars;
+    stats.difficulty = levels[i % 6];
+    stats.date = formatDate(1767225600 + (int64_t)(i * (31536000.0 / count)));
+    return stats;
+}
+
+// History files per row count, written once and shared by the load
+// benchmarks. The log holds every row; the snapshot is the same rows folded,
+// with the summary statistics saved as a session leaves them.
+string historyDir(size_t rows) {
+    static map<size_t, string> made;
+    auto it = made.find(rows);
+    if (it != made.end()) return it->second;
+
+    string dir = "history-" + to_string(rows);
+    filesystem::create_directories(dir);
+    SessionLog log(dir + "/typing_history.log");
+    log.openLog();
+    mt19937 rng(7);
+    vector<TypingStats> batch;
+    for (size_t i = 0; i < rows; i += batch.size()) {
+        batch.clear();
+        for (size_t k = i; k < min(rows, i + 4096); k++) batch.push_back(makeResult(k, rows, rng));
+        log.append(batch.data(), batch.size());
+    }
+    log.closeLog();
+    filesystem::copy_file(dir + "/typing_history.log", dir + "/folded.log");
+    SessionLog folded(dir + "/folded.log");
+    folded.openLog();
+    compactHistory(folded, dir + "/typing_history.col");
+    HistorySnapshot snapshot;
+    snapshot.openSnapshot(dir + "/typing_history.col");
+    HistoryStats stats(dir + "/typing_history.stats");
+    catchUpStats(stats, snapshot, folded);
+    stats.save();
+    return made.emplace(rows, dir).first->second;
+}
+
+// ---- Scoring ----
+
+void BM_ScoreAlignment(benchmark::State& state) {
+    const Attempt& a = attemptOf(state.range(0));
+    AlignmentScorer scorer;
+    for (auto _ : state) {
+        AlignmentResult r = scorer.score(a.original, a.typed);
+        benchmark::DoNotOptimize(r.matches);
+    }
+    state.SetBytesProcessed(state.iterations() * a.original.size());
+}
+BENCHMARK(BM_ScoreAlignment)->RangeMultiplier(8)->Range(20, 1 << 20);
+
+// An attempt that stops halfway (range 0) or runs on for half as much again
+// (range 1), checked once against the full DP.
+void BM_ScoreAlignmentUnequal(benchmark::State& state) {
+    const Attempt& a = attemptOf(4096);
+    string typed = state.range(0) == 0 ? a.typed.substr(0, a.typed.size() / 2)
+                                       : a.typed + a.original.substr(0, a.original.size() / 2);
+    AlignmentScorer scorer;
+    if (scorer.align(a.original, typed).distance() != naiveDistance(a.original, typed, false)) {
+        state.SkipWithError("banded distance differs from the full DP");
+        return;
+    }
+    for (auto _ : state) {
+        AlignmentResult r = scorer.score(a.original, typed);
+        benchmark::DoNotOptimize(r.matches);
+    }
+    state.SetBytesProcessed(state.iterations() * a.original.size());
+}
+BENCHMARK(BM_ScoreAlignmentUnequal)->DenseRange(0, 1);
+
+// The same over text with multi-byte characters, aligned by cluster.
+void BM_ScoreAlignmentUnicode(benchmark::State& state) {
+    const Attempt& a = attemptOf(state.range(0), true);
+    AlignmentScorer scorer;
+    for (auto _ : state) {
+        AlignmentResult r = scorer.score(a.original, a.typed);
+        benchmark::DoNotOptimize(r.matches);
+    }
+    state.SetBytesProcessed(state.iterations() * a.original.size());
+}
+BENCHMARK(BM_ScoreAlignmentUnicode)->RangeMultiplier(8)->Range(20, 1 << 20);
+
+// GraphemeIndex::assign over ASCII text (the SIMD scan alone) and over
+// multi-byte text (the cluster table).
+void BM_GraphemeIndex(benchmark::State& state) {
+    const Attempt& a = attemptOf(state.range(0), state.range(1));
+    GraphemeIndex index;
+    for (auto _ : state) {
+        index.assign(a.original);
+        benchmark::DoNotOptimize(index.size());
+    }
+    state.SetBytesProcessed(state.iterations() * a.original.size());
+}
+BENCHMARK(BM_GraphemeIndex)->ArgsProduct({{20, 4096, 1 << 20}, {0, 1}});
+
+// The original calculateAccuracy/countErrors pair.
+void BM_ScorePositional(benchmark::State& state) {
+    const Attempt& a = attemptOf(state.range(0));
+    for (auto _ : state) {
+        double accuracy = positionalAccuracy(a.original, a.typed);
+        int errors = positionalErrors(a.original, a.typed);
+        benchmark::DoNotOptimize(accuracy);
+        benchmark::DoNotOptimize(errors);
+    }
+    state.SetBytesProcessed(state.iterations() * a.original.size());
+}
+BENCHMARK(BM_ScorePositional)->RangeMultiplier(8)->Range(20, 1 << 20);
+
+void BM_CompareKernel(benchmark::State& state) {
+    const Attempt& a = attemptOf(state.range(0));
+    for (auto _ : state) {
+        CompareCounts counts = compareText(a.original, a.typed);
+        benchmark::DoNotOptimize(counts);
+    }
+    state.SetBytesProcessed(state.iterations() * a.original.size());
+    state.SetLabel(compareKernel().name);
+}
+BENCHMARK(BM_CompareKernel)->RangeMultiplier(8)->Range(20, 1 << 20);
+
+// ---- Persistence ----
+
+// saveHistory: appending rows to the log in 4096-row batches.
+void BM_HistoryAppend(benchmark::State& state) {
+    size_t rows = state.range(0);
+    mt19937 rng(3);
+    vector<TypingStats> batch;
+    for (size_t i = 0; i < 4096; i++) batch.push_back(makeResult(i, 4096, rng));
+    for (auto _ : state) {
+        state.PauseTiming();
+        unlink("append.log");
+        SessionLog log("append.log");
+        log.openLog();
+        state.ResumeTiming();
+        for (size_t i = 0; i < rows; i += batch.size()) {
+            log.append(batch.data(), min(batch.size(), rows - i));
+        }
+        log.closeLog();
+    }
+    unlink("append.log");
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_HistoryAppend)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+// loadHistory before compaction: every row decoded from the log.
+void BM_HistoryLoadLog(benchmark::State& state) {
+    size_t rows = state.range(0);
+    SessionLog log(historyDir(rows) + "/typing_history.log");
+    for (auto _ : state) {
+        vector<TypingStats> history = log.readAll();
+        benchmark::DoNotOptimize(history.data());
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_HistoryLoadLog)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+// loadHistory after compaction: map the snapshot and load the saved summary
+// statistics, which already cover every row.
+void BM_HistoryLoadSnapshot(benchmark::State& state) {
+    size_t rows = state.range(0);
+    string dir = historyDir(rows);
+    SessionLog log(dir + "/folded.log");
+    for (auto _ : state) {
+        HistorySnapshot snapshot;
+        snapshot.openSnapshot(dir + "/typing_history.col");
+        HistoryStats stats(dir + "/typing_history.stats");
+        catchUpStats(stats, snapshot, log);
+        benchmark::DoNotOptimize(stats);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_HistoryLoadSnapshot)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+// The same with no saved statistics: every snapshot row is folded into them,
+// as on the first start after an upgrade.
+void BM_HistoryStatsRebuild(benchmark::State& state) {
+    size_t rows = state.range(0);
+    string dir = historyDir(rows);
+    SessionLog log(dir + "/folded.log");
+    for (auto _ : state) {
+        HistorySnapshot snapshot;
+        snapshot.openSnapshot(dir + "/typing_history.col");
+        HistoryStats stats("missing.stats");
+        catchUpStats(stats, snapshot, log);
+        benchmark::DoNotOptimize(stats);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_HistoryStatsRebuild)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+// Everything that runs before the name prompt: constructing the checker (and
+// destroying it unused) in a directory holding the history fixtures.
+void BM_CheckerStartup(benchmark::State& state) {
+    size_t rows = state.range(0);
+    string dir = historyDir(rows);
+    string home = filesystem::current_path();
+    filesystem::current_path(dir);
+    for (auto _ : state) {
+        TypingSpeedChecker checker;
+        benchmark::DoNotOptimize(&checker);
+    }
+    filesystem::current_path(home);
+}
+BENCHMARK(BM_CheckerStartup)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond);
+
+// updateLeaderboard: a stream of results into top-10 boards per difficulty
+// and per user (1000 users, 6 difficulties).
+void BM_LeaderboardInsert(benchmark::State& state) {
+    size_t count = state.range(0);
+    mt19937 rng(5);
+    vector<TypingStats> stream;
+    for (size_t i = 0; i < count; i++) stream.push_back(makeResult(i, count, rng));
+    for (auto _ : state) {
+        Leaderboard board(10);
+        for (const TypingStats& stats : stream) {
+            board.add(stats.name, stats.difficulty, stats.wpm, stats.accuracy, parseDate(stats.date));
+        }
+        benchmark::DoNotOptimize(board);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_LeaderboardInsert)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+// ---- History scans ----
+
+// Rows of 1000 users, once as TypingStats (the record the history used to be
+// kept as) and once as a HistoryStore, shared by the scan benchmarks.
+const vector<TypingStats>& statsRows(size_t rows) {
+    static map<size_t, vector<TypingStats>> cache;
+    auto it = cache.find(rows);
+    if (it == cache.end()) {
+        mt19937 rng(11);
+        vector<TypingStats> stats;
+        stats.reserve(rows);
+        for (size_t i = 0; i < rows; i++) stats.push_back(makeResult(i, rows, rng));
+        it = cache.emplace(rows, move(stats)).first;
+    }
+    return it->second;
+}
+
+const HistoryStore& storeRows(size_t rows) {
+    static map<size_t, HistoryStore> cache;
+    auto it = cache.find(rows);
+    if (it == cache.end()) {
+        HistoryStore store;
+        store.reserve(rows);
+        for (const auto& stats : statsRows(rows)) store.append(stats);
+        it = cache.emplace(rows, move(store)).first;
+    }
+    return it->second;
+}
+
+// History totals (valid tests, WPM, accuracy and time sums, best WPM) over a
+// vector of TypingStats, one record at a time.
+void BM_HistoryScanRecords(benchmark::State& state) {
+    const vector<TypingStats>& rows = statsRows(state.range(0));
+    for (auto _ : state) {
+        HistoryTotals totals;
+        for (const TypingStats& stats : rows) {
+            totals.tests++;
+            if (stats.wpm <= 0) continue;
+            totals.valid++;
+            totals.sumWpm += stats.wpm;
+            totals.sumAccuracy += stats.accuracy;
+            totals.sumTime += stats.time;
+            totals.bestWpm = max(totals.bestWpm, stats.wpm);
+        }
+        benchmark::DoNotOptimize(totals);
+    }
+    state.SetItemsProcessed(state.iterations() * rows.size());
+    state.SetBytesProcessed(state.iterations() * rows.size() * sizeof(TypingStats));
+}
+BENCHMARK(BM_HistoryScanRecords)->RangeMultiplier(10)->Range(1000000, 10000000)->Unit(benchmark::kMillisecond);
+
+// The same totals from the store's wpm, accuracy and time columns. The second
+// argument is the number of scan threads.
+void BM_HistoryScanColumns(benchmark::State& state) {
+    const HistoryStore& store = storeRows(state.range(0));
+    size_t threads = state.range(1);
+    for (auto _ : state) {
+        HistoryTotals totals = scanHistoryTotals(store.wpm(), store.accuracy(), store.time(), store.size(), threads);
+        benchmark::DoNotOptimize(totals);
+    }
+    state.SetItemsProcessed(state.iterations() * store.size());
+    state.SetBytesProcessed(state.iterations() * store.size() * 3 * sizeof(float));
+}
+BENCHMARK(BM_HistoryScanColumns)->ArgsProduct({{1000000, 10000000}, {1, 4}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// HistoryIndex::build over the compacted fixtures, as --query does per run.
+void BM_HistoryIndexBuild(benchmark::State& state) {
+    size_t rows = state.range(0);
+    string dir = historyDir(rows);
+    HistorySnapshot snapshot;
+    snapshot.openSnapshot(dir + "/typing_history.col");
+    HistoryStore store;
+    for (auto _ : state) {
+        HistoryIndex index;
+        index.build(snapshot, store);
+        benchmark::DoNotOptimize(&index);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_HistoryIndexBuild)->RangeMultiplier(10)->Range(1000000, 10000000)->Unit(benchmark::kMillisecond);
+
+// HistoryIndex::query on a built index. The second argument picks the query:
+// 0 = one user over a month, 1 = one difficulty over the year by week,
+// 2 = every row by day.
+void BM_HistoryQuery(benchmark::State& state) {
+    size_t rows = state.range(0);
+    string dir = historyDir(rows);
+    HistorySnapshot snapshot;
+    snapshot.openSnapshot(dir + "/typing_history.col");
+    HistoryStore store;
+    HistoryIndex index;
+    index.build(snapshot, store);
+
+    HistoryQuery query;
+    if (state.range(1) == 0) {
+        query.user = "user-42";
+        query.from = parseDate("2026-06-01 00:00:00");
+        query.to = parseDate("2026-07-01 00:00:00");
+    } else if (state.range(1) == 1) {
+        query.difficulty = "Hard";
+        query.grouping = QueryGrouping::Week;
+    } else {
+        query.grouping = QueryGrouping::Day;
+    }
+    size_t matched = 0;
+    for (auto _ : state) {
+        HistoryQueryResult result = index.query(query);
+        matched = result.totals.tests;
+        benchmark::DoNotOptimize(result);
+    }
+    state.counters["matched"] = matched;
+}
+BENCHMARK(BM_HistoryQuery)->ArgsProduct({{1000000, 10000000}, {0, 1, 2}})->Unit(benchmark::kMicrosecond);
+
+// ---- Rendering ----
+
+// displayRealTimeHighlight with cout going to /dev/null.
+void BM_HighlightToDevNull(benchmark::State& state) {
+    const Attempt& a = attemptOf(state.range(0));
+    static TypingSpeedChecker checker;
+    ofstream devNull("/dev/null");
+    streambuf* saved = cout.rdbuf(devNull.rdbuf());
+    for (auto _ : state) {
+        checker.displayRealTimeHighlight(a.original, a.typed);
+    }
+    cout.rdbuf(saved);
+    state.SetBytesProcessed(state.iterations() * a.original.size());
+}
+BENCHMARK(BM_HighlightToDevNull)->RangeMultiplier(8)->Range(20, 1 << 20);
+
+// One live-view frame per keystroke, written to /dev/null. The second
+// argument turns the hot-path probes on, as --stats does.
+void BM_LiveRendererKeystroke(benchmark::State& state) {
+    const Attempt& a = attemptOf(state.range(0));
+    probesEnabled.store(state.range(1) != 0);
+    int devNull = open("/dev/null", O_WRONLY);
+    int saved = dup(STDOUT_FILENO);
+    dup2(devNull, STDOUT_FILENO);
+    LiveRenderer renderer;
+    string typed;
+    typed.reserve(a.typed.size());
+    size_t i = 0;
+    int64_t nanos = 0;
+    renderer.begin(a.original);
+    for (auto _ : state) {
+        if (i == a.typed.size()) {
+            state.PauseTiming();
+            renderer.begin(a.original);
+            typed.clear();
+            i = 0;
+            state.ResumeTiming();
+        }
+        typed += a.typed[i++];
+        nanos += 100000000;
+        renderer.update(typed, nanos);
+        renderer.renderFrame(nanos);
+    }
+    probesEnabled.store(false);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devNull);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LiveRendererKeystroke)->ArgsProduct({{64, 4096}, {0, 1}});
+
+// ---- Probes ----
+
+// The cost of one probe around an empty block, off and on.
+void BM_ProbeScope(benchmark::State& state) {
+    probesEnabled.store(state.range(0) != 0);
+    for (auto _ : state) {
+        PROBE_SCOPE(Probe::Frame);
+        benchmark::ClobberMemory();
+    }
+    probesEnabled.store(false);
+}
+BENCHMARK(BM_ProbeScope)->Arg(0)->Arg(1);
+
+// ---- Allocations ----
+
+// Types text into a pseudo-terminal at 50-80 ms a key, after the lines the
+// test reads before it starts capturing.
+void typeInto(int terminal, const string& lines, const string& keys) {
+    mt19937 rng(11);
+    ssize_t ignored = write(terminal, lines.data(), lines.size());
+    this_thread::sleep_for(chrono::milliseconds(200)); // until raw mode is on
+    for (char c : keys) {
+        ignored = write(terminal, &c, 1);
+        this_thread::sleep_for(chrono::milliseconds(50 + rng() % 30));
+    }
+    ignored = write(terminal, "\r", 1);
+    (void)ignored;
+}
+
+// Complete tests typed through a pseudo-terminal: a corpus passage, a timed
+// test and custom text, each run once first to warm up. Counts the heap
+// allocations made from the start of a test to its last line of output,
+// which should be none.
+void BM_TestAllocations(benchmark::State& state) {
+    int terminal = posix_openpt(O_RDWR | O_NOCTTY);
+    if (terminal < 0 || grantpt(terminal) != 0 || unlockpt(terminal) != 0) {
+        state.SkipWithError("no pseudo-terminal");
+        return;
+    }
+    int typist = open(ptsname(terminal), O_RDWR | O_NOCTTY);
+    int devNull = open("/dev/null", O_WRONLY);
+    int savedIn = dup(STDIN_FILENO), savedOut = dup(STDOUT_FILENO);
+    cout.flush();
+    dup2(typist, STDIN_FILENO);
+    dup2(devNull, STDOUT_FILENO);
+
+    long total = 0, tests = 0;
+    {
+        TypingSpeedChecker checker;
+        checker.setUser("bench");
+        string level;
+        auto runTest = [&](int kind) {
+            string lines = kind == 2 ? "\nthe lazy dog naps\n\n\n" : "\n";
+            thread keys(typeInto, terminal, lines, string("the quick brown fox"));
+            allocationCount = 0;
+            countingAllocations = true;
+            if (kind == 0) checker.startTest(1, level);
+            else if (kind == 1) checker.timedMode(15);
+            else checker.customTextMode();
+            cout.flush();
+            countingAllocations = false;
+            keys.join();
+            return allocationCount;
+        };
+        for (int kind = 0; kind < 3; kind++) runTest(kind);
+
+        for (auto _ : state) {
+            for (int kind = 0; kind < 3; kind++) {
+                total += runTest(kind);
+                tests++;
+            }
+        }
+    }
+
+    dup2(savedIn, STDIN_FILENO);
+    dup2(savedOut, STDOUT_FILENO);
+    close(savedIn);
+    close(savedOut);
+    close(devNull);
+    close(typist);
+    close(terminal);
+    state.counters["allocs_per_test"] = tests > 0 ? (double)total / tests : 0;
+    if (total > 0) state.SkipWithError("a warmed-up test allocated");
+}
+BENCHMARK(BM_TestAllocations)->Iterations(2)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // Sessions and fixtures write files relative to the working directory.
+    filesystem::path scratch = filesystem::temp_directory_path() / ("typing-bench-" + to_string(getpid()));
+    filesystem::create_directories(scratch);
+    filesystem::path previous = filesystem::current_path();
+    filesystem::current_path(scratch);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    filesystem::current_path(previous);
+    filesystem::remove_all(scratch);
+    return 0;
+}
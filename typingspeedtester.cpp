@@ -8,6 +8,47 @@
 #include <fstream>
 #include <chrono>
 #include <thread>
+#include <unordered_map>
+#include <string_view>
+#include <limits>
+#include <climits>
+#include <random>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <iterator>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 using namespace std;
 
 struct TypingStats {
@@ -20,594 +61,8741 @@ struct TypingStats {
     int errors;
     string difficulty;
     string date;
+    bool flagged = false; // failed keystroke timing validation, so never ranked
 };
 
-class TypingSpeedChecker {
-private:
-    vector<TypingStats> history;
-    vector<TypingStats> leaderboard;
-    string currentUser;
-    
-    vector<string> easyTexts = {
-        "The cat sat on the mat.",
-        "I love to code every day.",
-        "Practice makes perfect."
-    };
-    
-    vector<string> mediumTexts = {
-        "The quick brown fox jumps over the lazy dog near the riverbank.",
-        "Programming is both an art and a science that requires practice.",
-        "Efficient typing skills improve productivity and save valuable time."
-    };
-    
-    vector<string> hardTexts = {
-        "In computer science, algorithms and data structures form the foundation of efficient problem-solving techniques.",
-        "The implementation of object-oriented programming principles enhances code reusability and maintainability.",
-        "Cybersecurity professionals must stay vigilant against evolving threats in our interconnected digital landscape."
+// Parses one line of the legacy pipe-delimited typing_history.txt format.
+bool parseHistoryLine(const string& line, TypingStats& stat) {
+    stringstream ss(line);
+    string token;
+
+    try {
+        getline(ss, stat.name, '|');
+        getline(ss, token, '|'); stat.wpm = stod(token);
+        getline(ss, token, '|'); stat.accuracy = stod(token);
+        getline(ss, token, '|'); stat.time = stod(token);
+        getline(ss, token, '|'); stat.correctChars = stoi(token);
+        getline(ss, token, '|'); stat.totalChars = stoi(token);
+        getline(ss, token, '|'); stat.errors = stoi(token);
+        getline(ss, stat.difficulty, '|');
+        getline(ss, stat.date);
+    } catch (const exception&) {
+        return false;
+    }
+
+    return true;
+}
+
+// CRC-32 (IEEE 802.3), used to detect torn or corrupted log records.
+// Slicing-by-8: eight bytes per step through eight derived tables.
+uint32_t computeChecksum(const void* data, size_t length) {
+    struct Tables {
+        uint32_t t[8][256];
+        Tables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; i++) {
+                for (int k = 1; k < 8; k++) {
+                    t[k][i] = t[0][t[k - 1][i] & 0xFF] ^ (t[k - 1][i] >> 8);
+                }
+            }
+        }
     };
-    
-    vector<string> expertTexts = {
-        "The polymorphic nature of C++ enables developers to write flexible, extensible code through inheritance and virtual functions.",
-        "Asynchronous programming paradigms facilitate non-blocking I/O operations, significantly improving application responsiveness.",
-        "Quantum computing's superposition principle allows qubits to exist in multiple states simultaneously, exponentially increasing computational power."
+    static const Tables tables;
+    const auto& t = tables.t;
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint32_t crc = 0xFFFFFFFFu;
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, bytes, 4);
+        memcpy(&high, bytes + 4, 4);
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+              t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        bytes += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = t[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Hot-path probes. PROBE_SCOPE times the enclosing block into the calling
+// thread's histogram for that probe and PROBE_COUNT adds to a counter. Each
+// thread owns its slots and is their only writer, so recording takes a few
+// relaxed stores and no locks, and a report can read every thread at any
+// time. Until --stats or --trace turns them on, a probe costs one branch.
+// Building with TYPING_SPEED_NO_PROBES removes them entirely.
+enum class Probe : uint8_t {
+    Input,           // one read of keystrokes, with the live view redrawn
+    Frame,           // one live view frame
+    Highlight,
+    Align,
+    Validate,
+    HistoryLoad,
+    HistoryAppend,
+    StatsSave,
+    LeaderboardLoad,
+    LeaderboardSave,
+    RecordingAppend,
+    KeyStatsLoad,
+    KeyStatsSave,
+    Count
+};
+
+static const char* const probeNames[] = {
+    "input", "frame", "highlight", "align", "validate", "history load", "history append",
+    "stats save", "leaderboard load", "leaderboard save", "recording append",
+    "key stats load", "key stats save"
+};
+
+static const char* const probeCategories[] = {
+    "input", "render", "render", "score", "score", "io", "io", "io", "io", "io", "io", "io", "io"
+};
+
+enum class Counter : uint8_t {
+    Keystrokes,
+    HistoryBytes,    // appended to the history log
+    RecordingBytes,  // appended to the recordings file
+    Count
+};
+
+static const char* const counterNames[] = {"keystrokes", "history bytes written", "recording bytes written"};
+
+// The TSC on x86, a few times cheaper than steady_clock; reports convert
+// ticks to time with the rate measured over the whole run.
+static inline uint64_t probeTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Single-writer increment: other threads only ever read the value.
+static inline void bumpProbe(atomic<uint64_t>& slot, uint64_t n) {
+    slot.store(slot.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Log-linear histogram of durations in ticks: 8 linear buckets per power of
+// two, so a percentile read from it is within 12.5%.
+struct ProbeHistogram {
+    static constexpr int subBits = 3;
+    static constexpr int bucketCount = (64 - subBits + 1) << subBits;
+
+    atomic<uint64_t> buckets[bucketCount] = {};
+    atomic<uint64_t> samples{0};
+    atomic<uint64_t> totalTicks{0};
+    atomic<uint64_t> maxTicks{0};
+
+    static int bucketOf(uint64_t ticks) {
+        if (ticks < (1u << subBits)) return (int)ticks;
+        int msb = 63 - __builtin_clzll(ticks);
+        return ((msb - subBits + 1) << subBits) + (int)((ticks >> (msb - subBits)) & ((1u << subBits) - 1));
+    }
+
+    static uint64_t lowerBound(int bucket) {
+        if (bucket < (1 << subBits)) return bucket;
+        int msb = (bucket >> subBits) + subBits - 1;
+        return (uint64_t)((1 << subBits) + (bucket & ((1 << subBits) - 1))) << (msb - subBits);
+    }
+
+    void add(uint64_t ticks) {
+        bumpProbe(buckets[bucketOf(ticks)], 1);
+        bumpProbe(samples, 1);
+        bumpProbe(totalTicks, ticks);
+        if (ticks > maxTicks.load(memory_order_relaxed)) maxTicks.store(ticks, memory_order_relaxed);
+    }
+};
+
+struct TraceEvent {
+    uint64_t start;
+    uint64_t ticks;
+    Probe probe;
+};
+
+// One thread's probes. Threads register on their first probe and their
+// slots are never freed, so a report still sees threads that have exited.
+struct ThreadProbes {
+    static constexpr size_t traceCapacity = 1 << 17;
+
+    ProbeHistogram histograms[(size_t)Probe::Count];
+    atomic<uint64_t> counters[(size_t)Counter::Count] = {};
+    unique_ptr<TraceEvent[]> trace;   // only while tracing
+    atomic<size_t> traceLength{0};    // published after each event is written
+    atomic<uint64_t> traceDropped{0};
+    uint32_t threadId = 0;
+    ThreadProbes* next = nullptr;
+};
+
+static atomic<bool> probesEnabled{false};
+static atomic<bool> probesTracing{false};
+static atomic<ThreadProbes*> probeThreads{nullptr};
+static atomic<uint32_t> probeThreadCount{0};
+
+static ThreadProbes& threadProbes() {
+    static thread_local ThreadProbes* mine = nullptr;
+    if (!mine) {
+        mine = new ThreadProbes();
+        mine->threadId = ++probeThreadCount;
+        if (probesTracing.load(memory_order_relaxed)) {
+            mine->trace.reset(new TraceEvent[ThreadProbes::traceCapacity]);
+        }
+        mine->next = probeThreads.load(memory_order_relaxed);
+        while (!probeThreads.compare_exchange_weak(mine->next, mine, memory_order_release, memory_order_relaxed)) {
+        }
+    }
+    return *mine;
+}
+
+static void recordProbe(Probe probe, uint64_t start, uint64_t end) {
+    ThreadProbes& slots = threadProbes();
+    slots.histograms[(size_t)probe].add(end - start);
+    if (!slots.trace) return;
+
+    size_t length = slots.traceLength.load(memory_order_relaxed);
+    if (length == ThreadProbes::traceCapacity) {
+        bumpProbe(slots.traceDropped, 1);
+        return;
+    }
+    slots.trace[length] = {start, end - start, probe};
+    slots.traceLength.store(length + 1, memory_order_release);
+}
+
+static inline void countProbe(Counter counter, uint64_t n) {
+    if (probesEnabled.load(memory_order_relaxed)) {
+        bumpProbe(threadProbes().counters[(size_t)counter], n);
+    }
+}
+
+class ScopedProbe {
+private:
+    Probe probe;
+    uint64_t start;
+
+public:
+    explicit ScopedProbe(Probe p) : probe(p), start(probesEnabled.load(memory_order_relaxed) ? probeTicks() : 0) {}
+
+    ~ScopedProbe() {
+        if (start != 0) recordProbe(probe, start, probeTicks());
+    }
+
+    ScopedProbe(const ScopedProbe&) = delete;
+    ScopedProbe& operator=(const ScopedProbe&) = delete;
+};
+
+#ifndef TYPING_SPEED_NO_PROBES
+#define PROBE_JOIN2(a, b) a##b
+#define PROBE_JOIN(a, b) PROBE_JOIN2(a, b)
+#define PROBE_SCOPE(probe) ScopedProbe PROBE_JOIN(probeScope, __LINE__)(probe)
+#define PROBE_COUNT(counter, n) countProbe(counter, n)
+#else
+#define PROBE_SCOPE(probe) ((void)0)
+#define PROBE_COUNT(counter, n) ((void)0)
+#endif
+
+// Exclusive flock() on a lock file for the lifetime of the object. Files that
+// are replaced by rename are guarded through a separate <file>.lock, because a
+// lock taken on the old inode would not exclude the next writer.
+class FileLock {
+private:
+    int fd;
+
+public:
+    explicit FileLock(const string& path) : fd(open(path.c_str(), O_RDWR | O_CREAT, 0644)) {
+        while (fd >= 0 && flock(fd, LOCK_EX) != 0 && errno == EINTR) {}
+    }
+
+    ~FileLock() {
+        if (fd >= 0) close(fd);
+    }
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+};
+
+// Fixed-size record stored in typing_history.log. The layout is native-endian;
+// every platform we build for (x86_64, arm64) is little-endian.
+struct HistoryRecord {
+    double wpm;
+    double accuracy;
+    double time;
+    int32_t correctChars;
+    int32_t totalChars;
+    int32_t errors;
+    uint32_t magic; // "TSSR", or "TSSF" for a result that failed timing validation
+    char name[32];
+    char difficulty[16];
+    char date[20];
+    uint32_t checksum;
+};
+static_assert(sizeof(HistoryRecord) == 112, "HistoryRecord layout must stay fixed");
+
+// A NUL-padded record field as text.
+template <size_t N>
+string_view fieldOf(const char (&field)[N]) {
+    return string_view(field, strnlen(field, N));
+}
+
+// Append-only history log: one checksummed record is written per finished test,
+// so a killed process loses at most the test in flight and exit costs no I/O.
+class SessionLog {
+private:
+    static constexpr char fileMagic[8] = {'T', 'S', 'C', 'L', 'O', 'G', '0', '1'};
+    static constexpr uint32_t recordMagic = 0x52535354;  // "TSSR"
+    static constexpr uint32_t flaggedMagic = 0x46535354; // "TSSF": failed timing validation
+    static constexpr off_t headerSize = 16;
+
+    string path;
+    int fd = -1;
+    int fsyncEvery = 0;
+    int pendingSync = 0;
+    int lockDepth = 0;
+    bool created = false;
+
+    static void copyField(char* dest, size_t size, const string& src) {
+        memset(dest, 0, size);
+        memcpy(dest, src.data(), min(src.length(), size - 1));
+    }
+
+    static string readField(const char* src, size_t size) {
+        return string(src, strnlen(src, size));
+    }
+
+    static void writeHeader(int out, uint32_t generation) {
+        char header[headerSize] = {};
+        memcpy(header, fileMagic, sizeof(fileMagic));
+        uint32_t recordSize = sizeof(HistoryRecord);
+        memcpy(header + 8, &recordSize, sizeof(recordSize));
+        memcpy(header + 12, &generation, sizeof(generation));
+        ssize_t ignored = write(out, header, sizeof(header));
+        (void)ignored;
+    }
+
+    bool lockFile(int operation) {
+        while (flock(fd, operation) != 0) {
+            if (errno != EINTR) return false;
+        }
+        return true;
+    }
+
+public:
+    explicit SessionLog(const string& logPath) : path(logPath) {}
+
+    ~SessionLog() {
+        closeLog();
+    }
+
+    const string& getPath() const {
+        return path;
+    }
+
+    bool exists() const {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0;
+    }
+
+    // True if the last openLog() found no valid header and started the file.
+    bool wasCreated() const {
+        return created;
+    }
+
+    // fsync after every n appended records; 0 leaves flushing to the OS.
+    void setFsyncEvery(int n) {
+        fsyncEvery = max(0, n);
+    }
+
+    static HistoryRecord pack(const TypingStats& stats) {
+        HistoryRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.wpm = stats.wpm;
+        rec.accuracy = stats.accuracy;
+        rec.time = stats.time;
+        rec.correctChars = stats.correctChars;
+        rec.totalChars = stats.totalChars;
+        rec.errors = stats.errors;
+        rec.magic = stats.flagged ? flaggedMagic : recordMagic;
+        copyField(rec.name, sizeof(rec.name), stats.name);
+        copyField(rec.difficulty, sizeof(rec.difficulty), stats.difficulty);
+        copyField(rec.date, sizeof(rec.date), stats.date);
+        rec.checksum = computeChecksum(&rec, offsetof(HistoryRecord, checksum));
+        return rec;
+    }
+
+    static bool isValid(const HistoryRecord& rec) {
+        return (rec.magic == recordMagic || rec.magic == flaggedMagic) &&
+               rec.checksum == computeChecksum(&rec, offsetof(HistoryRecord, checksum));
+    }
+
+    static bool isFlagged(const HistoryRecord& rec) {
+        return rec.magic == flaggedMagic;
+    }
+
+    static TypingStats unpack(const HistoryRecord& rec) {
+        TypingStats stats;
+        stats.name = readField(rec.name, sizeof(rec.name));
+        stats.wpm = rec.wpm;
+        stats.accuracy = rec.accuracy;
+        stats.time = rec.time;
+        stats.correctChars = rec.correctChars;
+        stats.totalChars = rec.totalChars;
+        stats.errors = rec.errors;
+        stats.difficulty = readField(rec.difficulty, sizeof(rec.difficulty));
+        stats.date = readField(rec.date, sizeof(rec.date));
+        stats.flagged = isFlagged(rec);
+        return stats;
+    }
+
+    // Opens the log for appending, creating it if needed. A torn record left by a
+    // killed process is trimmed so later appends stay record-aligned; the
+    // check runs under the exclusive lock so it never cuts a record another
+    // session is appending.
+    bool openLog() {
+        if (fd >= 0) return true;
+
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) return false;
+        if (!lockFile(LOCK_EX)) {
+            closeLog();
+            return false;
+        }
+
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        created = ok && st.st_size < headerSize;
+        if (created) {
+            ok = ftruncate(fd, 0) == 0;
+            if (ok) writeHeader(fd, 1);
+        } else if (ok) {
+            off_t body = st.st_size - headerSize;
+            off_t aligned = body - body % (off_t)sizeof(HistoryRecord);
+            ok = aligned == body || ftruncate(fd, headerSize + aligned) == 0;
+        }
+
+        if (lockDepth == 0) flock(fd, LOCK_UN);
+        if (!ok) closeLog();
+        return ok;
+    }
+
+    void closeLog() {
+        if (fd < 0) return;
+        sync();
+        close(fd);
+        fd = -1;
+        lockDepth = 0;
+    }
+
+    // Advisory flock() on the log itself; the file is only ever truncated in
+    // place, never replaced, so every session locks the same inode. Appends
+    // hold it shared and never wait on each other. Truncation (generation
+    // changes, compaction) holds it exclusive, so no append can land between
+    // reading the log and emptying it. Holds nest; the outermost decides the
+    // mode.
+    bool lock(bool exclusive) {
+        if (lockDepth == 0) {
+            if (fd < 0 && !openLog()) return false;
+            if (!lockFile(exclusive ? LOCK_EX : LOCK_SH)) return false;
+        }
+        lockDepth++;
+        return true;
+    }
+
+    void unlock() {
+        if (lockDepth > 0 && --lockDepth == 0 && fd >= 0) {
+            flock(fd, LOCK_UN);
+        }
+    }
+
+    bool append(const TypingStats& stats) {
+        return append(&stats, 1);
+    }
+
+    bool append(const TypingStats* stats, size_t count) {
+        if (count == 0) return true;
+        HistoryRecord one;
+        vector<HistoryRecord> many;
+        HistoryRecord* records = &one;
+        if (count > 1) {
+            many.resize(count);
+            records = many.data();
+        }
+        for (size_t i = 0; i < count; i++) records[i] = pack(stats[i]);
+        return appendRecords(records, count);
+    }
+
+    // Appends a batch with a single write, so it lands as one contiguous run
+    // however many other sessions are appending.
+    bool appendRecords(const HistoryRecord* records, size_t count) {
+        if (count == 0) return true;
+        PROBE_SCOPE(Probe::HistoryAppend);
+        size_t bytes = count * sizeof(HistoryRecord);
+        if (!lock(false)) return false;
+        bool written = write(fd, records, bytes) == (ssize_t)bytes;
+        unlock();
+        if (!written) return false;
+        PROBE_COUNT(Counter::HistoryBytes, bytes);
+
+        pendingSync += count;
+        if (fsyncEvery > 0 && pendingSync >= fsyncEvery) {
+            sync();
+        }
+        return true;
+    }
+
+    void sync() {
+        if (fd >= 0 && pendingSync > 0) {
+            fsync(fd);
+            pendingSync = 0;
+        }
+    }
+
+    // Calls fn for every valid record, reading the file in large blocks, and
+    // returns how many corrupted records were skipped.
+    template <typename Fn>
+    size_t scan(Fn fn) const {
+        int in = open(path.c_str(), O_RDONLY);
+        if (in < 0) return 0;
+
+        char header[headerSize];
+        if (pread(in, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            memcmp(header, fileMagic, sizeof(fileMagic)) != 0) {
+            close(in);
+            return 0;
+        }
+
+        vector<HistoryRecord> block(4096);
+        size_t skipped = 0;
+        off_t offset = headerSize;
+        while (true) {
+            ssize_t n = pread(in, block.data(), block.size() * sizeof(HistoryRecord), offset);
+            size_t count = n > 0 ? size_t(n) / sizeof(HistoryRecord) : 0;
+            if (count == 0) break;
+            for (size_t i = 0; i < count; i++) {
+                if (isValid(block[i])) fn(block[i]);
+                else skipped++;
+            }
+            offset += count * sizeof(HistoryRecord);
+        }
+
+        close(in);
+        return skipped;
+    }
+
+    vector<TypingStats> readAll(size_t* skipped = nullptr) const {
+        vector<TypingStats> records;
+        size_t corrupted = scan([&](const HistoryRecord& rec) {
+            records.push_back(unpack(rec));
+        });
+        if (skipped) *skipped = corrupted;
+        return records;
+    }
+
+    // Generation of the log file; bumped each time the log is folded into the
+    // columnar snapshot, so a crash mid-compaction never double-counts records.
+    uint32_t readGeneration() const {
+        ifstream file(path, ios::binary);
+        char header[headerSize];
+        if (!file.read(header, sizeof(header)) || memcmp(header, fileMagic, sizeof(fileMagic)) != 0) {
+            return 0;
+        }
+
+        uint32_t generation;
+        memcpy(&generation, header + 12, sizeof(generation));
+        return generation;
+    }
+
+    // Empties the log and starts a new generation. Truncates in place so
+    // sessions that hold the file open keep appending to the same log.
+    bool reset(uint32_t generation) {
+        if (!lock(true)) return false;
+        bool ok = ftruncate(fd, 0) == 0;
+        if (ok) {
+            writeHeader(fd, generation);
+            ok = fsync(fd) == 0;
+            pendingSync = 0;
+        }
+        unlock();
+        return ok;
+    }
+
+    // Appends every row of a legacy pipe-delimited history file.
+    // Returns the number of rows imported, or -1 if the file can't be read.
+    long importText(const string& textPath) {
+        ifstream file(textPath);
+        if (!file.is_open()) return -1;
+
+        long imported = 0;
+        string line;
+        while (getline(file, line)) {
+            TypingStats stat;
+            if (line.empty() || !parseHistoryLine(line, stat)) continue;
+            if (append(stat)) imported++;
+        }
+        sync();
+
+        return imported;
+    }
+};
+
+// Reads one unsigned field of "YYYY-MM-DD HH:MM:SS" and the separator after it.
+static bool readDateField(string_view date, size_t& position, int& value, char separator) {
+    size_t start = position;
+    value = 0;
+    while (position < date.size() && date[position] >= '0' && date[position] <= '9' && position - start < 9) {
+        value = value * 10 + (date[position++] - '0');
+    }
+    if (position == start) return false;
+    if (separator == '\0') return true;
+    if (position >= date.size() || date[position] != separator) return false;
+    position++;
+    return true;
+}
+
+// Converts a "YYYY-MM-DD HH:MM:SS" local timestamp to epoch seconds.
+// mktime dominates bulk loads, so the epoch of each local hour is cached.
+// DST changes fall on hour boundaries, so adding minutes and seconds is exact.
+int64_t parseDate(string_view date) {
+    int year, month, day, hour, minute, second;
+    size_t position = 0;
+    if (!readDateField(date, position, year, '-') || !readDateField(date, position, month, '-') ||
+        !readDateField(date, position, day, ' ') || !readDateField(date, position, hour, ':') ||
+        !readDateField(date, position, minute, ':') || !readDateField(date, position, second, '\0')) {
+        return 0;
+    }
+
+    struct HourSlot {
+        int64_t key = -1;
+        int64_t epoch = 0;
     };
+    static thread_local HourSlot cache[64];
+    int64_t key = ((int64_t(year) * 13 + month) * 32 + day) * 25 + hour;
+    HourSlot& slot = cache[key & 63];
+    if (slot.key != key) {
+        struct tm timeinfo = {};
+        timeinfo.tm_year = year - 1900;
+        timeinfo.tm_mon = month - 1;
+        timeinfo.tm_mday = day;
+        timeinfo.tm_hour = hour;
+        timeinfo.tm_isdst = -1;
+        slot.key = key;
+        slot.epoch = (int64_t)mktime(&timeinfo);
+    }
+    return slot.epoch + minute * 60 + second;
+}
 
-    string getCurrentDate() {
-        time_t now = time(0);
-        char buffer[80];
-        struct tm* timeinfo = localtime(&now);
-        strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", timeinfo);
-        return string(buffer);
+string formatDate(int64_t epochSeconds) {
+    time_t t = (time_t)epochSeconds;
+    char buffer[80];
+    struct tm* timeinfo = localtime(&t);
+    strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", timeinfo);
+    return string(buffer);
+}
+
+// Header of typing_history.col. Every column is stored contiguously at the
+// given offset (8-byte aligned) so the mapped file is scanned in place.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t logGeneration;
+    uint64_t rowCount;
+    uint64_t fileSize;
+    uint32_t nameCount;
+    uint32_t difficultyCount;
+    uint64_t wpmOffset;
+    uint64_t accuracyOffset;
+    uint64_t timeOffset;
+    uint64_t dateOffset;
+    uint64_t correctCharsOffset;
+    uint64_t totalCharsOffset;
+    uint64_t errorsOffset;
+    uint64_t nameIdOffset;
+    uint64_t difficultyIdOffset;
+    uint64_t nameDictOffset;
+    uint64_t difficultyDictOffset;
+    uint64_t flagsOffset; // version 2 on; one byte per row, 1 = flagged
+};
+
+// Read-only columnar snapshot of compacted history. Names and difficulties are
+// dictionary-encoded, dates are epoch seconds, and nothing is parsed on load.
+class HistorySnapshot {
+private:
+    static constexpr char fileMagic[8] = {'T', 'S', 'C', 'C', 'O', 'L', '0', '1'};
+    static constexpr uint32_t formatVersion = 2;
+    static constexpr size_t version1HeaderSize = offsetof(SnapshotHeader, flagsOffset);
+
+    void* base = MAP_FAILED;
+    size_t mappedSize = 0;
+    const SnapshotHeader* header = nullptr;
+
+    template <typename T>
+    const T* column(uint64_t offset) const {
+        return reinterpret_cast<const T*>(static_cast<const char*>(base) + offset);
+    }
+
+    // Dictionary layout: uint32 offsets[count + 1] followed by the string bytes.
+    string_view dictEntry(uint64_t dictOffset, uint32_t count, uint32_t id) const {
+        if (id >= count) return string_view();
+        const uint32_t* offsets = column<uint32_t>(dictOffset);
+        const char* chars = reinterpret_cast<const char*>(offsets + count + 1);
+        return string_view(chars + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    // Version 1 files have no flags column and read as nothing flagged.
+    bool validate() const {
+        const SnapshotHeader& h = *header;
+        if (memcmp(h.magic, fileMagic, sizeof(fileMagic)) != 0 || h.version < 1 || h.version > formatVersion) {
+            return false;
+        }
+        if (h.fileSize != mappedSize) return false;
+        if (h.version >= 2 && mappedSize < sizeof(SnapshotHeader)) return false;
+
+        uint64_t n = h.rowCount;
+        if (h.version >= 2 && h.flagsOffset + n > mappedSize) return false;
+        return h.wpmOffset + n * sizeof(double) <= mappedSize &&
+               h.accuracyOffset + n * sizeof(double) <= mappedSize &&
+               h.timeOffset + n * sizeof(double) <= mappedSize &&
+               h.dateOffset + n * sizeof(int64_t) <= mappedSize &&
+               h.correctCharsOffset + n * sizeof(int32_t) <= mappedSize &&
+               h.totalCharsOffset + n * sizeof(int32_t) <= mappedSize &&
+               h.errorsOffset + n * sizeof(int32_t) <= mappedSize &&
+               h.nameIdOffset + n * sizeof(uint32_t) <= mappedSize &&
+               h.difficultyIdOffset + n * sizeof(uint16_t) <= mappedSize &&
+               h.nameDictOffset + (h.nameCount + 1) * sizeof(uint32_t) <= mappedSize &&
+               h.difficultyDictOffset + (h.difficultyCount + 1) * sizeof(uint32_t) <= mappedSize;
+    }
+
+    // Appends one dictionary section to out and returns its offset.
+    static uint64_t writeDict(string& out, const vector<string>& entries) {
+        uint64_t offset = out.size();
+        uint32_t position = 0;
+        for (const auto& entry : entries) {
+            out.append(reinterpret_cast<const char*>(&position), sizeof(position));
+            position += entry.length();
+        }
+        out.append(reinterpret_cast<const char*>(&position), sizeof(position));
+        for (const auto& entry : entries) {
+            out += entry;
+        }
+        out.resize((out.size() + 7) & ~size_t(7), '\0');
+        return offset;
+    }
+
+    template <typename T>
+    static uint64_t writeColumn(string& out, const T* existing, size_t existingCount, const vector<T>& appended) {
+        uint64_t offset = out.size();
+        if (existingCount > 0) {
+            out.append(reinterpret_cast<const char*>(existing), existingCount * sizeof(T));
+        }
+        out.append(reinterpret_cast<const char*>(appended.data()), appended.size() * sizeof(T));
+        out.resize((out.size() + 7) & ~size_t(7), '\0');
+        return offset;
     }
 
 public:
-    TypingSpeedChecker() {
-        loadHistory();
-        loadLeaderboard();
+    HistorySnapshot() = default;
+    HistorySnapshot(const HistorySnapshot&) = delete;
+    HistorySnapshot& operator=(const HistorySnapshot&) = delete;
+
+    ~HistorySnapshot() {
+        closeSnapshot();
+    }
+
+    bool openSnapshot(const string& path) {
+        closeSnapshot();
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)version1HeaderSize) {
+            close(fd);
+            return false;
+        }
+
+        mappedSize = st.st_size;
+        base = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) return false;
+
+        header = static_cast<const SnapshotHeader*>(base);
+        if (!validate()) {
+            closeSnapshot();
+            return false;
+        }
+        return true;
+    }
+
+    void closeSnapshot() {
+        if (base != MAP_FAILED) {
+            munmap(base, mappedSize);
+        }
+        base = MAP_FAILED;
+        mappedSize = 0;
+        header = nullptr;
+    }
+
+    size_t size() const { return header ? header->rowCount : 0; }
+    uint32_t logGeneration() const { return header ? header->logGeneration : 0; }
+    uint32_t nameCount() const { return header ? header->nameCount : 0; }
+    uint32_t difficultyCount() const { return header ? header->difficultyCount : 0; }
+
+    const double* wpm() const { return column<double>(header->wpmOffset); }
+    const double* accuracy() const { return column<double>(header->accuracyOffset); }
+    const double* time() const { return column<double>(header->timeOffset); }
+    const int64_t* dates() const { return column<int64_t>(header->dateOffset); }
+    const int32_t* correctChars() const { return column<int32_t>(header->correctCharsOffset); }
+    const int32_t* totalChars() const { return column<int32_t>(header->totalCharsOffset); }
+    const int32_t* errors() const { return column<int32_t>(header->errorsOffset); }
+    const uint32_t* nameIds() const { return column<uint32_t>(header->nameIdOffset); }
+    const uint16_t* difficultyIds() const { return column<uint16_t>(header->difficultyIdOffset); }
+    // Null for a version 1 file, which predates flagging.
+    const uint8_t* flags() const { return header->version >= 2 ? column<uint8_t>(header->flagsOffset) : nullptr; }
+
+    string_view name(uint32_t id) const {
+        return dictEntry(header->nameDictOffset, header->nameCount, id);
+    }
+
+    string_view difficulty(uint16_t id) const {
+        return dictEntry(header->difficultyDictOffset, header->difficultyCount, id);
+    }
+
+    // Writes a new snapshot holding every row of current followed by appended.
+    // Existing columns are copied verbatim; dictionary IDs stay stable.
+    static bool writeSnapshot(const string& path, uint32_t generation, const HistorySnapshot& current,
+                      const vector<TypingStats>& appended) {
+        size_t existing = current.size();
+        vector<string> names, difficulties;
+        unordered_map<string, uint32_t> nameIndex, difficultyIndex;
+
+        for (uint32_t id = 0; id < current.nameCount(); id++) {
+            names.emplace_back(current.name(id));
+            nameIndex.emplace(names.back(), id);
+        }
+        for (uint32_t id = 0; id < current.difficultyCount(); id++) {
+            difficulties.emplace_back(current.difficulty(id));
+            difficultyIndex.emplace(difficulties.back(), id);
+        }
+
+        vector<double> wpm, accuracy, time;
+        vector<int64_t> dates;
+        vector<int32_t> correctChars, totalChars, errors;
+        vector<uint32_t> nameIds;
+        vector<uint16_t> difficultyIds;
+        vector<uint8_t> flags;
+
+        for (const auto& stat : appended) {
+            auto name = nameIndex.emplace(stat.name, (uint32_t)names.size());
+            if (name.second) names.push_back(stat.name);
+            auto difficulty = difficultyIndex.emplace(stat.difficulty, (uint32_t)difficulties.size());
+            if (difficulty.second) difficulties.push_back(stat.difficulty);
+            if (difficulties.size() > 0xFFFF) return false;
+
+            wpm.push_back(stat.wpm);
+            accuracy.push_back(stat.accuracy);
+            time.push_back(stat.time);
+            dates.push_back(parseDate(stat.date));
+            correctChars.push_back(stat.correctChars);
+            totalChars.push_back(stat.totalChars);
+            errors.push_back(stat.errors);
+            nameIds.push_back(name.first->second);
+            difficultyIds.push_back((uint16_t)difficulty.first->second);
+            flags.push_back(stat.flagged ? 1 : 0);
+        }
+
+        SnapshotHeader h = {};
+        memcpy(h.magic, fileMagic, sizeof(fileMagic));
+        h.version = formatVersion;
+        h.logGeneration = generation;
+        h.rowCount = existing + appended.size();
+        h.nameCount = names.size();
+        h.difficultyCount = difficulties.size();
+
+        string out(sizeof(SnapshotHeader), '\0');
+        h.wpmOffset = writeColumn(out, existing ? current.wpm() : nullptr, existing, wpm);
+        h.accuracyOffset = writeColumn(out, existing ? current.accuracy() : nullptr, existing, accuracy);
+        h.timeOffset = writeColumn(out, existing ? current.time() : nullptr, existing, time);
+        h.dateOffset = writeColumn(out, existing ? current.dates() : nullptr, existing, dates);
+        h.correctCharsOffset = writeColumn(out, existing ? current.correctChars() : nullptr, existing, correctChars);
+        h.totalCharsOffset = writeColumn(out, existing ? current.totalChars() : nullptr, existing, totalChars);
+        h.errorsOffset = writeColumn(out, existing ? current.errors() : nullptr, existing, errors);
+        h.nameIdOffset = writeColumn(out, existing ? current.nameIds() : nullptr, existing, nameIds);
+        h.difficultyIdOffset = writeColumn(out, existing ? current.difficultyIds() : nullptr, existing, difficultyIds);
+        h.nameDictOffset = writeDict(out, names);
+        h.difficultyDictOffset = writeDict(out, difficulties);
+        if (existing && !current.flags()) {
+            flags.insert(flags.begin(), existing, 0);
+            existing = 0;
+        }
+        h.flagsOffset = writeColumn(out, existing ? current.flags() : nullptr, existing, flags);
+        h.fileSize = out.size();
+        memcpy(&out[0], &h, sizeof(h));
+
+        string tmpPath = path + ".tmp";
+        int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+
+        bool ok = write(fd, out.data(), out.size()) == (ssize_t)out.size() && fsync(fd) == 0;
+        close(fd);
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+// Makes sure new appends land in a log generation newer than the snapshot;
+// a log whose generation was already folded is emptied. The snapshot is
+// reopened under the exclusive log lock, so a concurrent compaction can't
+// leave us appending to a generation it has just folded.
+bool startLogGeneration(SessionLog& log, const string& snapshotPath) {
+    if (!log.lock(true)) return false;
+    HistorySnapshot current;
+    current.openSnapshot(snapshotPath);
+    bool ok = log.readGeneration() > current.logGeneration() || log.reset(current.logGeneration() + 1);
+    log.unlock();
+    return ok;
+}
+
+// Folds the append-only log into the columnar snapshot and starts a fresh log
+// generation. Returns the number of records folded, or -1 on failure. Other
+// sessions' appends wait on the log lock while this runs.
+long compactHistory(SessionLog& log, const string& snapshotPath, size_t* skipped = nullptr) {
+    if (!log.lock(true)) return -1;
+
+    HistorySnapshot current;
+    current.openSnapshot(snapshotPath);
+
+    uint32_t generation = log.readGeneration();
+    vector<TypingStats> tail;
+    if (generation > current.logGeneration()) {
+        tail = log.readAll(skipped);
+    }
+
+    uint32_t folded = max(generation, current.logGeneration());
+    bool ok = HistorySnapshot::writeSnapshot(snapshotPath, folded, current, tail);
+    current.closeSnapshot();
+
+    ok = ok && log.reset(folded + 1);
+    log.unlock();
+    return ok ? (long)tail.size() : -1;
+}
+
+// Location of one sentence inside the mapped corpus plus the metrics used to
+// classify it. Sentences may span line breaks; whitespace is collapsed on use.
+struct PassageRef {
+    uint64_t offset;
+    uint32_t span;
+    uint16_t words;
+    uint16_t symbols;
+};
+
+// Header of the <corpus>.idx sidecar. Passages follow it grouped by
+// difficulty; the corpus size and mtime detect a stale index.
+struct CorpusIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t passageCount;
+    uint64_t corpusSize;
+    int64_t corpusMtime;
+    uint32_t counts[4];
+};
+
+// Built-in passages, used when no corpus file can be opened.
+static const char builtinCorpus[] =
+    "The cat sat on the mat. I love to code every day. Practice makes perfect.\n\n"
+    "The quick brown fox jumps over the lazy dog near the riverbank. "
+    "Programming is both an art and a science that requires practice. "
+    "Efficient typing skills improve productivity and save valuable time.\n\n"
+    "In computer science, algorithms and data structures form the foundation of efficient problem-solving techniques. "
+    "The implementation of object-oriented programming principles enhances code reusability and maintainability. "
+    "Cybersecurity professionals must stay vigilant against evolving threats in our interconnected digital landscape.\n\n"
+    "The polymorphic nature of C++ enables developers to write flexible, extensible code through inheritance and virtual functions. "
+    "Asynchronous programming paradigms facilitate non-blocking I/O operations, significantly improving application responsiveness. "
+    "Quantum computing's superposition principle allows qubits to exist in multiple states simultaneously, exponentially increasing computational power.\n";
+
+// Practice texts served straight from a memory-mapped file. Sentence offsets
+// are indexed once per corpus version and cached in a sidecar, so opening a
+// large corpus costs two mmaps and selecting a passage is O(1).
+class TextCorpus {
+private:
+    static constexpr char indexMagic[8] = {'T', 'S', 'C', 'I', 'D', 'X', '0', '1'};
+    static constexpr uint32_t indexVersion = 1;
+    static constexpr size_t minPassageLength = 15;
+    static constexpr size_t maxPassageLength = 300;
+
+    void* corpusMap = MAP_FAILED;
+    size_t corpusMapSize = 0;
+    void* indexMap = MAP_FAILED;
+    size_t indexMapSize = 0;
+
+    const char* data = nullptr;
+    const PassageRef* passages = nullptr;
+    uint32_t counts[4] = {0, 0, 0, 0};
+    uint32_t starts[4] = {0, 0, 0, 0};
+    vector<PassageRef> builtIndex;
+    string source;
+    mt19937_64 rng{random_device{}()};
+
+    static bool isTerminator(char c) {
+        return c == '.' || c == '!' || c == '?';
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    // 0-based difficulty from collapsed length, nudged up one level for
+    // punctuation/digit-heavy text or long average words.
+    static int classify(size_t length, const PassageRef& p) {
+        int level = length < 40 ? 0 : length < 90 ? 1 : length < 120 ? 2 : 3;
+        size_t letters = length - p.symbols - (p.words > 0 ? p.words - 1 : 0);
+        if (p.symbols * 100 > length * 6 || (p.words > 0 && letters > p.words * 9)) {
+            level++;
+        }
+        return min(level, 3);
+    }
+
+    // Splits text into sentences in one pass. A sentence ends at . ! or ?
+    // (plus closing quotes/brackets) followed by whitespace, or at a blank line.
+    static void buildIndex(const char* text, size_t size, vector<PassageRef>& out, uint32_t* groupCounts) {
+        vector<PassageRef> groups[4];
+        size_t i = 0;
+        while (i < size) {
+            while (i < size && isSpace(text[i])) i++;
+            if (i >= size) break;
+
+            size_t start = i, length = 0;
+            PassageRef p = {start, 0, 0, 0};
+            bool inWord = false, pendingSpace = false;
+            while (i < size) {
+                char c = text[i];
+                if (isSpace(c)) {
+                    if (c == '\n') {
+                        size_t j = i + 1;
+                        while (j < size && (text[j] == ' ' || text[j] == '\t' || text[j] == '\r')) j++;
+                        if (j >= size || text[j] == '\n') break;
+                    }
+                    inWord = false;
+                    pendingSpace = true;
+                    i++;
+                    continue;
+                }
+                if (pendingSpace) {
+                    length++;
+                    pendingSpace = false;
+                }
+                if (!inWord) p.words++;
+                inWord = true;
+                if (!isalnum((unsigned char)c) && !((unsigned char)c & 0x80)) p.symbols++;
+                length++;
+                i++;
+                if (isTerminator(c)) {
+                    while (i < size && (text[i] == '"' || text[i] == '\'' || text[i] == ')')) {
+                        p.symbols++;
+                        length++;
+                        i++;
+                    }
+                    if (i >= size || isSpace(text[i])) break;
+                }
+            }
+
+            size_t end = i;
+            while (end > start && isSpace(text[end - 1])) end--;
+            p.span = end - start;
+            if (length >= minPassageLength && length <= maxPassageLength) {
+                groups[classify(length, p)].push_back(p);
+            }
+        }
+
+        out.clear();
+        for (int level = 0; level < 4; level++) {
+            groupCounts[level] = groups[level].size();
+            out.insert(out.end(), groups[level].begin(), groups[level].end());
+        }
+    }
+
+    bool mapIndex(const string& indexPath, const struct stat& corpusStat) {
+        int fd = open(indexPath.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CorpusIndexHeader)) {
+            close(fd);
+            return false;
+        }
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return false;
+
+        const CorpusIndexHeader* h = static_cast<const CorpusIndexHeader*>(map);
+        uint64_t total = (uint64_t)h->counts[0] + h->counts[1] + h->counts[2] + h->counts[3];
+        bool valid = memcmp(h->magic, indexMagic, sizeof(indexMagic)) == 0 &&
+                     h->version == indexVersion &&
+                     h->corpusSize == (uint64_t)corpusStat.st_size &&
+                     h->corpusMtime == (int64_t)corpusStat.st_mtime &&
+                     total == h->passageCount &&
+                     sizeof(CorpusIndexHeader) + total * sizeof(PassageRef) == (uint64_t)st.st_size;
+        if (!valid) {
+            munmap(map, st.st_size);
+            return false;
+        }
+
+        indexMap = map;
+        indexMapSize = st.st_size;
+        passages = reinterpret_cast<const PassageRef*>(h + 1);
+        setCounts(h->counts);
+        return true;
+    }
+
+    static bool writeIndex(const string& indexPath, const struct stat& corpusStat,
+                           const vector<PassageRef>& refs, const uint32_t* groupCounts) {
+        CorpusIndexHeader h = {};
+        memcpy(h.magic, indexMagic, sizeof(indexMagic));
+        h.version = indexVersion;
+        h.passageCount = refs.size();
+        h.corpusSize = corpusStat.st_size;
+        h.corpusMtime = corpusStat.st_mtime;
+        memcpy(h.counts, groupCounts, sizeof(h.counts));
+
+        string tmpPath = indexPath + ".tmp";
+        int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+
+        size_t bytes = refs.size() * sizeof(PassageRef);
+        bool ok = write(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) &&
+                  write(fd, refs.data(), bytes) == (ssize_t)bytes;
+        close(fd);
+        if (!ok || rename(tmpPath.c_str(), indexPath.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void setCounts(const uint32_t* groupCounts) {
+        uint32_t position = 0;
+        for (int level = 0; level < 4; level++) {
+            counts[level] = groupCounts[level];
+            starts[level] = position;
+            position += groupCounts[level];
+        }
+    }
+
+public:
+    TextCorpus() = default;
+    TextCorpus(const TextCorpus&) = delete;
+    TextCorpus& operator=(const TextCorpus&) = delete;
+
+    ~TextCorpus() {
+        closeCorpus();
+    }
+
+    // Maps path and its sidecar index, rebuilding the index if it is missing
+    // or stale. Returns false if the file holds no usable passages.
+    bool openCorpus(const string& path) {
+        closeCorpus();
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        corpusMapSize = st.st_size;
+        corpusMap = mmap(nullptr, corpusMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (corpusMap == MAP_FAILED) return false;
+        data = static_cast<const char*>(corpusMap);
+
+        string indexPath = path + ".idx";
+        if (!mapIndex(indexPath, st)) {
+            uint32_t groupCounts[4];
+            buildIndex(data, corpusMapSize, builtIndex, groupCounts);
+            if (!writeIndex(indexPath, st, builtIndex, groupCounts) || !mapIndex(indexPath, st)) {
+                passages = builtIndex.data();
+                setCounts(groupCounts);
+            } else {
+                builtIndex = vector<PassageRef>();
+            }
+        }
+
+        if (size() == 0) {
+            closeCorpus();
+            return false;
+        }
+        source = path;
+        return true;
+    }
+
+    void openBuiltin() {
+        closeCorpus();
+        uint32_t groupCounts[4];
+        data = builtinCorpus;
+        buildIndex(data, sizeof(builtinCorpus) - 1, builtIndex, groupCounts);
+        passages = builtIndex.data();
+        setCounts(groupCounts);
+        source = "built-in texts";
+    }
+
+    void closeCorpus() {
+        if (corpusMap != MAP_FAILED) munmap(corpusMap, corpusMapSize);
+        if (indexMap != MAP_FAILED) munmap(indexMap, indexMapSize);
+        corpusMap = indexMap = MAP_FAILED;
+        corpusMapSize = indexMapSize = 0;
+        data = nullptr;
+        passages = nullptr;
+        builtIndex.clear();
+        for (int level = 0; level < 4; level++) counts[level] = starts[level] = 0;
+        source.clear();
+    }
+
+    bool isOpen() const { return data != nullptr; }
+    const string& getSource() const { return source; }
+    size_t size() const { return (size_t)counts[0] + counts[1] + counts[2] + counts[3]; }
+
+    // difficulty is 1 (Easy) to 4 (Expert).
+    size_t count(int difficulty) const {
+        return difficulty >= 1 && difficulty <= 4 ? counts[difficulty - 1] : 0;
+    }
+
+    // Raw bytes of a passage inside the mapping, line breaks included.
+    string_view passage(int difficulty, size_t index) const {
+        const PassageRef& p = passages[starts[difficulty - 1] + index];
+        return string_view(data + p.offset, p.span);
+    }
+
+    // Picks a passage uniformly at random, falling back to the nearest
+    // difficulty that has one. The passage is returned straight from the
+    // mapped file unless its whitespace needs collapsing, in which case it is
+    // rebuilt in buffer with runs of whitespace as single spaces.
+    string_view select(int difficulty, string& buffer) {
+        difficulty = max(1, min(4, difficulty));
+        int level = 0;
+        for (int distance = 0; level == 0 && distance < 4; distance++) {
+            if (count(difficulty - distance) > 0) level = difficulty - distance;
+            else if (count(difficulty + distance) > 0) level = difficulty + distance;
+        }
+        if (level == 0) return string_view();
+
+        string_view raw = passage(level, uniform_int_distribution<size_t>(0, count(level) - 1)(rng));
+        bool clean = true;
+        for (size_t i = 0; i < raw.size() && clean; i++) {
+            if (isSpace(raw[i])) clean = raw[i] == ' ' && i > 0 && !isSpace(raw[i - 1]);
+        }
+        if (clean) return raw;
+
+        buffer.clear();
+        bool pendingSpace = false;
+        for (char c : raw) {
+            if (isSpace(c)) {
+                pendingSpace = true;
+                continue;
+            }
+            if (pendingSpace) buffer += ' ';
+            pendingSpace = false;
+            buffer += c;
+        }
+        return buffer;
+    }
+};
+
+// Generates practice passages from a word list, biased toward features the
+// user is weak at. A feature is an in-word bigram (first * 256 + second) or a
+// single byte (65536 + byte), the same index space as KeyStatsTable. The
+// inverted index maps each feature to the words containing it, so a drill
+// costs an alias table over the weak features plus O(1) per word.
+class DrillGenerator {
+private:
+    static constexpr size_t featureCount = 65536 + 256;
+    static constexpr size_t minWordLength = 2;
+    static constexpr size_t maxWordLength = 15;
+    static constexpr double exploreRate = 0.2; // share of words drawn uniformly
+
+    void* wordMap = MAP_FAILED;
+    size_t wordMapSize = 0;
+    vector<string_view> words;
+    vector<uint32_t> postingStart;
+    vector<uint32_t> postings;
+
+    // Alias table (Vose) over the current weak features; rebuilt per drill.
+    vector<double> aliasProbability;
+    vector<uint32_t> aliasOther;
+    vector<uint32_t> aliasFeature;
+    mt19937_64 rng{random_device{}()};
+
+    static bool isWordByte(char c) {
+        return isalpha((unsigned char)c) || c == '\'';
+    }
+
+    // Distinct features of one word, written to out; returns the count.
+    static size_t wordFeatures(string_view word, uint32_t* out) {
+        size_t n = 0;
+        auto push = [&](uint32_t feature) {
+            for (size_t i = 0; i < n; i++) {
+                if (out[i] == feature) return;
+            }
+            out[n++] = feature;
+        };
+        for (size_t i = 0; i < word.size(); i++) {
+            push(65536 + (unsigned char)word[i]);
+            if (i > 0) push((unsigned char)word[i - 1] * 256 + (unsigned char)word[i]);
+        }
+        return n;
+    }
+
+    // Adds every word-like token of text, trimmed of surrounding punctuation.
+    void addWords(string_view text) {
+        size_t i = 0;
+        while (i < text.size()) {
+            while (i < text.size() && !isWordByte(text[i])) i++;
+            size_t start = i;
+            while (i < text.size() && isWordByte(text[i])) i++;
+            if (i - start >= minWordLength && i - start <= maxWordLength) {
+                words.push_back(text.substr(start, i - start));
+            }
+        }
+    }
+
+    // Two passes over the words: count postings per feature, then fill.
+    void buildIndex() {
+        postingStart.assign(featureCount + 1, 0);
+        uint32_t features[2 * maxWordLength];
+        for (auto word : words) {
+            size_t n = wordFeatures(word, features);
+            for (size_t i = 0; i < n; i++) postingStart[features[i] + 1]++;
+        }
+        for (size_t f = 0; f < featureCount; f++) postingStart[f + 1] += postingStart[f];
+
+        postings.resize(postingStart[featureCount]);
+        vector<uint32_t> cursor(postingStart.begin(), postingStart.end() - 1);
+        for (uint32_t id = 0; id < words.size(); id++) {
+            size_t n = wordFeatures(words[id], features);
+            for (size_t i = 0; i < n; i++) postings[cursor[features[i]]++] = id;
+        }
+        aliasFeature.clear();
+    }
+
+    string_view uniformWord() {
+        return words[uniform_int_distribution<size_t>(0, words.size() - 1)(rng)];
+    }
+
+public:
+    DrillGenerator() = default;
+    DrillGenerator(const DrillGenerator&) = delete;
+    DrillGenerator& operator=(const DrillGenerator&) = delete;
+
+    ~DrillGenerator() {
+        closeWords();
+    }
+
+    void closeWords() {
+        if (wordMap != MAP_FAILED) munmap(wordMap, wordMapSize);
+        wordMap = MAP_FAILED;
+        wordMapSize = 0;
+        words.clear();
+        postingStart.clear();
+        postings.clear();
+        aliasFeature.clear();
+    }
+
+    // Maps a word list (any whitespace-separated text) and indexes it.
+    bool loadWordList(const string& path) {
+        closeWords();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        wordMapSize = st.st_size;
+        wordMap = mmap(nullptr, wordMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (wordMap == MAP_FAILED) return false;
+
+        addWords(string_view(static_cast<const char*>(wordMap), wordMapSize));
+        if (words.empty()) {
+            closeWords();
+            return false;
+        }
+        buildIndex();
+        return true;
+    }
+
+    // Uses the distinct words of every corpus passage. The views point into
+    // the corpus, which must outlive the generator's use of them.
+    void loadFromCorpus(const TextCorpus& corpus) {
+        closeWords();
+        for (int difficulty = 1; difficulty <= 4; difficulty++) {
+            for (size_t i = 0; i < corpus.count(difficulty); i++) {
+                addWords(corpus.passage(difficulty, i));
+            }
+        }
+        sort(words.begin(), words.end());
+        words.erase(unique(words.begin(), words.end()), words.end());
+        buildIndex();
+    }
+
+    size_t size() const { return words.size(); }
+
+    // Installs (feature, weight) targets. Features no word contains are
+    // dropped; with no targets left, drills are uniform.
+    void setTargets(const vector<pair<uint32_t, double>>& targets) {
+        aliasFeature.clear();
+        vector<double> weights;
+        for (const auto& target : targets) {
+            uint32_t f = target.first;
+            if (f < featureCount && target.second > 0 && postingStart[f + 1] > postingStart[f]) {
+                aliasFeature.push_back(f);
+                weights.push_back(target.second);
+            }
+        }
+
+        size_t n = weights.size();
+        aliasProbability.assign(n, 0);
+        aliasOther.assign(n, 0);
+        if (n == 0) return;
+
+        double total = 0;
+        for (double w : weights) total += w;
+        vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            weights[i] = weights[i] * n / total;
+            (weights[i] < 1 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            aliasProbability[s] = weights[s];
+            aliasOther[s] = l;
+            weights[l] -= 1 - weights[s];
+            if (weights[l] < 1) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        for (uint32_t i : large) aliasProbability[i] = 1;
+        for (uint32_t i : small) aliasProbability[i] = 1;
+    }
+
+    // Fills drill, reusing its capacity; left empty if there are no words.
+    void generate(size_t wordCount, string& drill) {
+        drill.clear();
+        if (words.empty()) return;
+        drill.reserve(wordCount * 8);
+
+        uniform_real_distribution<double> unit(0, 1);
+        for (size_t i = 0; i < wordCount; i++) {
+            string_view word;
+            if (aliasFeature.empty() || unit(rng) < exploreRate) {
+                word = uniformWord();
+            } else {
+                size_t slot = uniform_int_distribution<size_t>(0, aliasFeature.size() - 1)(rng);
+                uint32_t f = aliasFeature[unit(rng) < aliasProbability[slot] ? slot : aliasOther[slot]];
+                uint32_t begin = postingStart[f], length = postingStart[f + 1] - begin;
+                word = words[postings[begin + uniform_int_distribution<uint32_t>(0, length - 1)(rng)]];
+            }
+            if (i > 0) drill += ' ';
+            drill.append(word);
+        }
+    }
+};
+
+// One leaderboard slot; also the on-disk record of leaderboard.dat. board is
+// 0 for a per-difficulty board and 1 for a per-user board.
+struct LeaderEntry {
+    double wpm;
+    double accuracy;
+    int64_t date;
+    uint32_t nameId;
+    uint16_t difficultyId;
+    uint16_t board;
+};
+
+// Fixed-capacity board kept as a min-heap whose root is the weakest entry,
+// so a result is rejected in O(1) or replaces the root in O(log K).
+class TopK {
+private:
+    vector<LeaderEntry> heap;
+    size_t capacity;
+
+public:
+    explicit TopK(size_t capacity = 10) : capacity(capacity) {}
+
+    // WPM is compared to 0.01, then accuracy, then the earlier result wins.
+    static bool ranksAbove(const LeaderEntry& a, const LeaderEntry& b) {
+        int64_t wpmA = llround(a.wpm * 100), wpmB = llround(b.wpm * 100);
+        if (wpmA != wpmB) return wpmA > wpmB;
+        if (a.accuracy != b.accuracy) return a.accuracy > b.accuracy;
+        return a.date < b.date;
+    }
+
+    bool insert(const LeaderEntry& entry) {
+        if (heap.size() < capacity) {
+            if (heap.empty()) heap.reserve(min<size_t>(capacity, 1024));
+            heap.push_back(entry);
+            push_heap(heap.begin(), heap.end(), ranksAbove);
+            return true;
+        }
+        if (capacity == 0 || !ranksAbove(entry, heap.front())) return false;
+        pop_heap(heap.begin(), heap.end(), ranksAbove);
+        heap.back() = entry;
+        push_heap(heap.begin(), heap.end(), ranksAbove);
+        return true;
+    }
+
+    void setCapacity(size_t k) {
+        capacity = k;
+        while (heap.size() > capacity) {
+            pop_heap(heap.begin(), heap.end(), ranksAbove);
+            heap.pop_back();
+        }
+    }
+
+    size_t size() const { return heap.size(); }
+    bool empty() const { return heap.empty(); }
+    const vector<LeaderEntry>& entries() const { return heap; }
+
+    // 1-based position of entry on the board, or 0 if it didn't place.
+    size_t rankOf(const LeaderEntry& entry) const {
+        size_t above = 0;
+        bool found = false;
+        for (const auto& e : heap) {
+            if (ranksAbove(e, entry)) {
+                above++;
+            } else if (e.wpm == entry.wpm && e.accuracy == entry.accuracy && e.date == entry.date &&
+                       e.nameId == entry.nameId && e.difficultyId == entry.difficultyId) {
+                found = true;
+            }
+        }
+        return found ? above + 1 : 0;
+    }
+
+    // Best first; sorts a copy, so the heap stays intact.
+    vector<LeaderEntry> ranked() const {
+        vector<LeaderEntry> sorted = heap;
+        sort(sorted.begin(), sorted.end(), ranksAbove);
+        return sorted;
+    }
+};
+
+// Header of leaderboard.dat: entries follow it, then the name and difficulty
+// dictionaries in the same layout as the history snapshot.
+struct LeaderboardHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t nameCount;
+    uint32_t difficultyCount;
+};
+
+// Top-K boards per difficulty and per user. Names and difficulties are
+// interned once, so an insert is a hash lookup plus two O(log K) heap updates.
+class Leaderboard {
+private:
+    static constexpr char fileMagic[8] = {'T', 'S', 'C', 'L', 'D', 'B', '0', '1'};
+    static constexpr uint32_t formatVersion = 1;
+
+    size_t capacity;
+    deque<string> names, difficulties;
+    unordered_map<string_view, uint32_t> nameIndex, difficultyIndex;
+    vector<TopK> byDifficulty, byUser;
+
+    static uint32_t intern(deque<string>& values, unordered_map<string_view, uint32_t>& index, string_view value) {
+        auto it = index.find(value);
+        if (it != index.end()) return it->second;
+        values.emplace_back(value);
+        uint32_t id = values.size() - 1;
+        index.emplace(values.back(), id);
+        return id;
+    }
+
+    static void writeDict(string& out, const deque<string>& entries) {
+        uint32_t position = 0;
+        for (const auto& entry : entries) {
+            out.append(reinterpret_cast<const char*>(&position), sizeof(position));
+            position += entry.length();
+        }
+        out.append(reinterpret_cast<const char*>(&position), sizeof(position));
+        for (const auto& entry : entries) {
+            out += entry;
+        }
+    }
+
+    // Reads a dictionary written by writeDict; returns false if it overruns.
+    static bool readDict(string_view in, size_t& position, uint32_t count, vector<string_view>& out) {
+        size_t offsetsSize = (size_t(count) + 1) * sizeof(uint32_t);
+        if (position + offsetsSize > in.size()) return false;
+        vector<uint32_t> offsets(count + 1);
+        memcpy(offsets.data(), in.data() + position, offsetsSize);
+        position += offsetsSize;
+
+        const char* chars = in.data() + position;
+        if (position + offsets[count] > in.size()) return false;
+        for (uint32_t i = 0; i < count; i++) {
+            if (offsets[i] > offsets[i + 1]) return false;
+            out.emplace_back(chars + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+        position += offsets[count];
+        return true;
+    }
+
+public:
+    explicit Leaderboard(size_t capacity = 10) : capacity(capacity) {}
+
+    // The indexes view strings owned by this board's deques. A move keeps
+    // the deques' storage, so it keeps them valid; a copy would not.
+    Leaderboard(const Leaderboard&) = delete;
+    Leaderboard& operator=(const Leaderboard&) = delete;
+    Leaderboard(Leaderboard&&) = default;
+    Leaderboard& operator=(Leaderboard&&) = default;
+
+    void setCapacity(size_t k) {
+        capacity = k;
+        for (auto& board : byDifficulty) board.setCapacity(k);
+        for (auto& board : byUser) board.setCapacity(k);
+    }
+
+    size_t getCapacity() const { return capacity; }
+
+    uint32_t nameId(string_view name) {
+        uint32_t id = intern(names, nameIndex, name);
+        if (id >= byUser.size()) byUser.resize(id + 1, TopK(capacity));
+        return id;
+    }
+
+    uint16_t difficultyId(string_view difficulty) {
+        uint32_t id = intern(difficulties, difficultyIndex, difficulty);
+        if (id >= byDifficulty.size()) byDifficulty.resize(id + 1, TopK(capacity));
+        return (uint16_t)id;
+    }
+
+    string_view name(uint32_t id) const { return names[id]; }
+    string_view difficulty(uint16_t id) const { return difficulties[id]; }
+    size_t difficultyCount() const { return difficulties.size(); }
+
+    // Offers one result to its difficulty board and its user's board.
+    // Returns true if it made either.
+    bool add(uint32_t name, uint16_t difficulty, double wpm, double accuracy, int64_t date) {
+        if (wpm <= 0) return false;
+        LeaderEntry entry = {wpm, accuracy, date, name, difficulty, 0};
+        bool placed = byDifficulty[difficulty].insert(entry);
+        entry.board = 1;
+        return byUser[name].insert(entry) || placed;
+    }
+
+    bool add(string_view name, string_view difficulty, double wpm, double accuracy, int64_t date) {
+        if (wpm <= 0) return false;
+        return add(nameId(name), difficultyId(difficulty), wpm, accuracy, date);
+    }
+
+    const TopK* difficultyBoard(uint16_t id) const {
+        return id < byDifficulty.size() ? &byDifficulty[id] : nullptr;
+    }
+
+    const TopK* userBoard(string_view name) const {
+        auto it = nameIndex.find(name);
+        return it != nameIndex.end() ? &byUser[it->second] : nullptr;
+    }
+
+    // Inserts an entry into the one board its board field names.
+    void addEntry(string_view name, string_view difficulty, LeaderEntry entry) {
+        entry.nameId = nameId(name);
+        entry.difficultyId = difficultyId(difficulty);
+        if (entry.board == 0) byDifficulty[entry.difficultyId].insert(entry);
+        else byUser[entry.nameId].insert(entry);
+    }
+
+    // Every difficulty board plus one user's board; what the daemon sends
+    // back for a leaderboard query.
+    Leaderboard viewFor(string_view user) const {
+        Leaderboard view(capacity);
+        for (const auto& board : byDifficulty) {
+            for (const auto& entry : board.entries()) {
+                view.addEntry(names[entry.nameId], difficulties[entry.difficultyId], entry);
+            }
+        }
+        if (const TopK* personal = userBoard(user)) {
+            for (const auto& entry : personal->entries()) {
+                view.addEntry(names[entry.nameId], difficulties[entry.difficultyId], entry);
+            }
+        }
+        return view;
+    }
+
+    // The leaderboard.dat image, also used as the daemon's query reply.
+    void serialize(string& out) const {
+        size_t start = out.size();
+        LeaderboardHeader h = {};
+        memcpy(h.magic, fileMagic, sizeof(fileMagic));
+        h.version = formatVersion;
+        h.nameCount = names.size();
+        h.difficultyCount = difficulties.size();
+
+        out.append(sizeof(LeaderboardHeader), '\0');
+        for (const auto* boards : {&byDifficulty, &byUser}) {
+            for (const auto& board : *boards) {
+                out.append(reinterpret_cast<const char*>(board.entries().data()),
+                           board.size() * sizeof(LeaderEntry));
+                h.entryCount += board.size();
+            }
+        }
+        writeDict(out, names);
+        writeDict(out, difficulties);
+        memcpy(&out[start], &h, sizeof(h));
+    }
+
+    bool save(const string& path) const {
+        string out;
+        serialize(out);
+
+        string tmpPath = path + ".tmp";
+        int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+
+        bool ok = write(fd, out.data(), out.size()) == (ssize_t)out.size();
+        close(fd);
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Loads leaderboard.dat into the boards. Entries are re-inserted, so a
+    // smaller K than the file was written with simply keeps the best.
+    bool load(const string& path) {
+        ifstream file(path, ios::binary);
+        if (!file.is_open()) return false;
+        string in((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        return deserialize(in);
+    }
+
+    bool deserialize(string_view in) {
+        LeaderboardHeader h;
+        if (in.size() < sizeof(h)) return false;
+        memcpy(&h, in.data(), sizeof(h));
+        if (memcmp(h.magic, fileMagic, sizeof(fileMagic)) != 0 || h.version != formatVersion) return false;
+
+        size_t position = sizeof(h) + size_t(h.entryCount) * sizeof(LeaderEntry);
+        vector<string_view> fileNames, fileDifficulties;
+        if (position > in.size() ||
+            !readDict(in, position, h.nameCount, fileNames) ||
+            !readDict(in, position, h.difficultyCount, fileDifficulties)) {
+            return false;
+        }
+
+        vector<uint32_t> nameMap;
+        vector<uint16_t> difficultyMap;
+        for (auto value : fileNames) nameMap.push_back(nameId(value));
+        for (auto value : fileDifficulties) difficultyMap.push_back(difficultyId(value));
+
+        const char* records = in.data() + sizeof(h);
+        for (uint32_t i = 0; i < h.entryCount; i++) {
+            LeaderEntry entry;
+            memcpy(&entry, records + size_t(i) * sizeof(entry), sizeof(entry));
+            if (entry.nameId >= nameMap.size() || entry.difficultyId >= difficultyMap.size()) continue;
+            entry.nameId = nameMap[entry.nameId];
+            entry.difficultyId = difficultyMap[entry.difficultyId];
+            if (entry.board == 0) byDifficulty[entry.difficultyId].insert(entry);
+            else byUser[entry.nameId].insert(entry);
+        }
+        return true;
+    }
+
+    // Reads the old name|wpm|accuracy|difficulty|date leaderboard.txt.
+    long loadLegacy(const string& path) {
+        ifstream file(path);
+        if (!file.is_open()) return -1;
+
+        long loaded = 0;
+        string line;
+        while (getline(file, line)) {
+            TypingStats stat;
+            stringstream ss(line);
+            string token;
+
+            try {
+                getline(ss, stat.name, '|');
+                getline(ss, token, '|'); stat.wpm = stod(token);
+                getline(ss, token, '|'); stat.accuracy = stod(token);
+                getline(ss, stat.difficulty, '|');
+                getline(ss, stat.date);
+            } catch (const exception&) {
+                continue;
+            }
+            add(stat.name, stat.difficulty, stat.wpm, stat.accuracy, parseDate(stat.date));
+            loaded++;
+        }
+        return loaded;
+    }
+};
+
+// Merge on write: the current file is reloaded under its lock and only the
+// given results are added, so concurrent writers never drop each other's
+// entries. Returns the merged boards through merged when given.
+bool mergeLeaderboard(const string& path, size_t capacity, const vector<HistoryRecord>& results,
+                      Leaderboard* merged = nullptr) {
+    FileLock lock(path + ".lock");
+    Leaderboard board(capacity);
+    board.load(path);
+    for (const auto& rec : results) {
+        board.add(fieldOf(rec.name), fieldOf(rec.difficulty), rec.wpm, rec.accuracy, parseDate(fieldOf(rec.date)));
+    }
+    if (!board.save(path)) return false;
+    if (merged) *merged = move(board);
+    return true;
+}
+
+// Merging t-digest (Dunning) with the k1 scale function. Points are buffered
+// and folded in batches, so add() is amortised O(1) and the digest stays at a
+// few hundred centroids regardless of how many tests it has seen.
+class TDigest {
+public:
+    struct Centroid {
+        double mean;
+        double weight;
+    };
+
+private:
+    static constexpr double compression = 100;
+    static constexpr size_t bufferLimit = 500;
+
+    mutable vector<Centroid> centroids;
+    mutable vector<Centroid> buffer;
+    double totalWeight = 0;
+    double minValue = numeric_limits<double>::infinity();
+    double maxValue = -numeric_limits<double>::infinity();
+
+    static double scale(double q) {
+        return compression / (2 * M_PI) * asin(2 * q - 1);
+    }
+
+    static double inverseScale(double k) {
+        return (sin(k * 2 * M_PI / compression) + 1) / 2;
+    }
+
+    void flush() const {
+        if (buffer.empty()) return;
+        buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+        sort(buffer.begin(), buffer.end(), [](const Centroid& a, const Centroid& b) {
+            return a.mean < b.mean;
+        });
+
+        centroids.clear();
+        double seen = 0;
+        double limit = inverseScale(scale(0) + 1) * totalWeight;
+        Centroid current = buffer[0];
+        for (size_t i = 1; i < buffer.size(); i++) {
+            const Centroid& next = buffer[i];
+            if (seen + current.weight + next.weight <= limit) {
+                current.mean += (next.mean - current.mean) * next.weight / (current.weight + next.weight);
+                current.weight += next.weight;
+            } else {
+                seen += current.weight;
+                centroids.push_back(current);
+                limit = inverseScale(scale(min(1.0, seen / totalWeight)) + 1) * totalWeight;
+                current = next;
+            }
+        }
+        centroids.push_back(current);
+        buffer.clear();
+    }
+
+public:
+    void add(double value, double weight = 1) {
+        buffer.push_back({value, weight});
+        totalWeight += weight;
+        minValue = min(minValue, value);
+        maxValue = max(maxValue, value);
+        if (buffer.size() >= bufferLimit) flush();
+    }
+
+    // Sizes both buffers so later adds, and the flushes they trigger, never
+    // allocate. Left to grow on demand otherwise, since most digests see a
+    // handful of values.
+    void reserve() {
+        if (buffer.capacity() >= bufferLimit) return;
+        buffer.reserve(bufferLimit + 2 * (size_t)compression);
+        centroids.reserve(2 * (size_t)compression);
+    }
+
+    void merge(const TDigest& other) {
+        other.flush();
+        for (const auto& c : other.centroids) {
+            buffer.push_back(c);
+        }
+        totalWeight += other.totalWeight;
+        minValue = min(minValue, other.minValue);
+        maxValue = max(maxValue, other.maxValue);
+        flush();
+    }
+
+    double count() const { return totalWeight; }
+
+    // Value at quantile q in [0, 1], interpolating between centroid centres.
+    double quantile(double q) const {
+        flush();
+        if (centroids.empty()) return 0;
+        if (centroids.size() == 1) return centroids[0].mean;
+
+        double target = max(0.0, min(1.0, q)) * totalWeight;
+        const Centroid& first = centroids.front();
+        if (target < first.weight / 2) {
+            return minValue + (first.mean - minValue) * target / (first.weight / 2);
+        }
+
+        double cumulative = 0;
+        for (size_t i = 0; i + 1 < centroids.size(); i++) {
+            double left = cumulative + centroids[i].weight / 2;
+            double right = cumulative + centroids[i].weight + centroids[i + 1].weight / 2;
+            if (target <= right) {
+                double t = (target - left) / (right - left);
+                return centroids[i].mean + t * (centroids[i + 1].mean - centroids[i].mean);
+            }
+            cumulative += centroids[i].weight;
+        }
+
+        const Centroid& last = centroids.back();
+        double tail = totalWeight - last.weight / 2;
+        if (target <= tail) return last.mean;
+        return last.mean + (maxValue - last.mean) * (target - tail) / (last.weight / 2);
+    }
+
+    void serialize(string& out) const {
+        flush();
+        uint32_t count = centroids.size();
+        out.append(reinterpret_cast<const char*>(&count), sizeof(count));
+        out.append(reinterpret_cast<const char*>(&minValue), sizeof(minValue));
+        out.append(reinterpret_cast<const char*>(&maxValue), sizeof(maxValue));
+        out.append(reinterpret_cast<const char*>(centroids.data()), count * sizeof(Centroid));
+    }
+
+    bool deserialize(string_view& in) {
+        uint32_t count;
+        if (in.size() < sizeof(count) + 2 * sizeof(double)) return false;
+        memcpy(&count, in.data(), sizeof(count));
+        memcpy(&minValue, in.data() + sizeof(count), sizeof(double));
+        memcpy(&maxValue, in.data() + sizeof(count) + sizeof(double), sizeof(double));
+        in.remove_prefix(sizeof(count) + 2 * sizeof(double));
+        if (in.size() < size_t(count) * sizeof(Centroid)) return false;
+
+        centroids.resize(count);
+        memcpy(centroids.data(), in.data(), count * sizeof(Centroid));
+        in.remove_prefix(count * sizeof(Centroid));
+        buffer.clear();
+        totalWeight = 0;
+        for (const auto& c : centroids) totalWeight += c.weight;
+        return true;
+    }
+};
+
+// Running sums plus Welford's mean/variance of WPM. Only tests with a valid
+// WPM contribute to the averages, as in the original history summary.
+struct RunningStats {
+    uint64_t tests = 0;
+    uint64_t valid = 0;
+    double sumWpm = 0;
+    double sumAccuracy = 0;
+    double sumTime = 0;
+    double bestWpm = 0;
+    double meanWpm = 0;
+    double m2Wpm = 0;
+
+    void add(double wpm, double accuracy, double time) {
+        tests++;
+        if (wpm <= 0) return;
+        valid++;
+        sumWpm += wpm;
+        sumAccuracy += accuracy;
+        sumTime += time;
+        bestWpm = max(bestWpm, wpm);
+        double delta = wpm - meanWpm;
+        meanWpm += delta / valid;
+        m2Wpm += delta * (wpm - meanWpm);
+    }
+
+    // Chan et al. pairwise combination of two Welford states.
+    void merge(const RunningStats& other) {
+        if (other.valid > 0) {
+            double total = double(valid + other.valid);
+            double delta = other.meanWpm - meanWpm;
+            m2Wpm += other.m2Wpm + delta * delta * valid * other.valid / total;
+            meanWpm += delta * other.valid / total;
+        }
+        tests += other.tests;
+        valid += other.valid;
+        sumWpm += other.sumWpm;
+        sumAccuracy += other.sumAccuracy;
+        sumTime += other.sumTime;
+        bestWpm = max(bestWpm, other.bestWpm);
+    }
+
+    double averageWpm() const { return valid ? sumWpm / valid : 0; }
+    double averageAccuracy() const { return valid ? sumAccuracy / valid : 0; }
+    double stddevWpm() const { return valid > 1 ? sqrt(m2Wpm / (valid - 1)) : 0; }
+};
+
+// Valid tests in one calendar day or week (key is days or Monday-based weeks
+// since 1970-01-01, local time).
+struct StatsBucket {
+    int32_t key;
+    uint32_t count;
+    double sumWpm;
+    double sumAccuracy;
+    double bestWpm;
+};
+
+// Local calendar day of an epoch time. The UTC offset is cached per hour, so
+// bulk updates avoid a localtime call per test.
+int32_t localDayIndex(int64_t epochSeconds) {
+    struct OffsetSlot {
+        int64_t hour = numeric_limits<int64_t>::min();
+        long offset = 0;
+    };
+    static thread_local OffsetSlot cache[64];
+    int64_t hour = epochSeconds >= 0 ? epochSeconds / 3600 : (epochSeconds - 3599) / 3600;
+    OffsetSlot& slot = cache[uint64_t(hour) & 63];
+    if (slot.hour != hour) {
+        time_t t = (time_t)epochSeconds;
+        struct tm local;
+        localtime_r(&t, &local);
+        slot.hour = hour;
+        slot.offset = local.tm_gmtoff;
+    }
+    int64_t seconds = epochSeconds + slot.offset;
+    return (int32_t)(seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400);
+}
+
+string formatDay(int32_t day) {
+    time_t t = (time_t)day * 86400;
+    struct tm utc;
+    gmtime_r(&t, &utc);
+    char buffer[16];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d", &utc);
+    return string(buffer);
+}
+
+// Incremental history statistics per (user, difficulty): running sums,
+// Welford variance, a WPM t-digest and per-day/week buckets. Every finished
+// test is folded in O(1); the state is saved to typing_history.stats with the
+// number of history rows it covers, so startup only replays newer rows.
+class HistoryStats {
+public:
+    struct Group {
+        string name;
+        string difficulty;
+        RunningStats running;
+        TDigest wpmDigest;
+        vector<StatsBucket> days;
+        vector<StatsBucket> weeks;
+    };
+
+private:
+    static constexpr char fileMagic[8] = {'T', 'S', 'C', 'S', 'T', 'A', '0', '1'};
+    static constexpr uint32_t formatVersion = 1;
+
+    string path;
+    vector<Group> groups;
+    unordered_map<string, uint32_t> groupIndex;
+    string key; // lookup scratch, so finding an existing group allocates nothing
+    uint64_t covered = 0;
+
+    // Buckets arrive almost always in date order, so this is an append or an
+    // update of the last bucket; older dates fall back to a sorted insert.
+    static void addToBuckets(vector<StatsBucket>& buckets, int32_t key, double wpm, double accuracy) {
+        StatsBucket* bucket;
+        if (!buckets.empty() && buckets.back().key == key) {
+            bucket = &buckets.back();
+        } else if (buckets.empty() || buckets.back().key < key) {
+            buckets.push_back({key, 0, 0, 0, 0});
+            bucket = &buckets.back();
+        } else {
+            auto it = lower_bound(buckets.begin(), buckets.end(), key, [](const StatsBucket& b, int32_t k) {
+                return b.key < k;
+            });
+            if (it == buckets.end() || it->key != key) it = buckets.insert(it, {key, 0, 0, 0, 0});
+            bucket = &*it;
+        }
+        bucket->count++;
+        bucket->sumWpm += wpm;
+        bucket->sumAccuracy += accuracy;
+        bucket->bestWpm = max(bucket->bestWpm, wpm);
+    }
+
+    static void appendString(string& out, const string& value) {
+        uint32_t length = value.size();
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out += value;
+    }
+
+    static bool readString(string_view& in, string& value) {
+        uint32_t length;
+        if (in.size() < sizeof(length)) return false;
+        memcpy(&length, in.data(), sizeof(length));
+        in.remove_prefix(sizeof(length));
+        if (in.size() < length) return false;
+        value.assign(in.data(), length);
+        in.remove_prefix(length);
+        return true;
+    }
+
+    template <typename T>
+    static void appendArray(string& out, const vector<T>& values) {
+        uint32_t count = values.size();
+        out.append(reinterpret_cast<const char*>(&count), sizeof(count));
+        out.append(reinterpret_cast<const char*>(values.data()), count * sizeof(T));
+    }
+
+    template <typename T>
+    static bool readArray(string_view& in, vector<T>& values) {
+        uint32_t count;
+        if (in.size() < sizeof(count)) return false;
+        memcpy(&count, in.data(), sizeof(count));
+        in.remove_prefix(sizeof(count));
+        if (in.size() < size_t(count) * sizeof(T)) return false;
+        values.resize(count);
+        memcpy(values.data(), in.data(), count * sizeof(T));
+        in.remove_prefix(count * sizeof(T));
+        return true;
+    }
+
+public:
+    explicit HistoryStats(const string& path) : path(path) {}
+
+    uint64_t coveredTests() const { return covered; }
+    const vector<Group>& getGroups() const { return groups; }
+
+    void clear() {
+        groups.clear();
+        groupIndex.clear();
+        covered = 0;
+    }
+
+    uint32_t groupId(string_view name, string_view difficulty) {
+        key.clear();
+        key.append(name).append(1, '\x1f').append(difficulty);
+        auto it = groupIndex.find(key);
+        if (it != groupIndex.end()) return it->second;
+
+        uint32_t id = groups.size();
+        groups.push_back(Group{string(name), string(difficulty), {}, {}, {}, {}});
+        groupIndex.emplace(move(key), id);
+        return id;
+    }
+
+    void add(uint32_t group, double wpm, double accuracy, double time, int64_t date) {
+        Group& g = groups[group];
+        g.running.add(wpm, accuracy, time);
+        covered++;
+        if (wpm <= 0) return;
+
+        g.wpmDigest.add(wpm);
+        int32_t day = localDayIndex(date);
+        addToBuckets(g.days, day, wpm, accuracy);
+        addToBuckets(g.weeks, (day + 3) / 7, wpm, accuracy);
+    }
+
+    // A result finished in this session; its group's digest is sized so the
+    // tests that follow add to it without allocating. A flagged result is
+    // added without its WPM, so it counts as a test but not towards the sums.
+    void add(const TypingStats& stats) {
+        uint32_t group = groupId(stats.name, stats.difficulty);
+        groups[group].wpmDigest.reserve();
+        add(group, stats.flagged ? 0 : stats.wpm, stats.accuracy, stats.time, parseDate(stats.date));
+    }
+
+    bool save() const {
+        string out(fileMagic, sizeof(fileMagic));
+        uint32_t header[2] = {formatVersion, (uint32_t)groups.size()};
+        out.append(reinterpret_cast<const char*>(header), sizeof(header));
+        out.append(reinterpret_cast<const char*>(&covered), sizeof(covered));
+        for (const auto& g : groups) {
+            appendString(out, g.name);
+            appendString(out, g.difficulty);
+            out.append(reinterpret_cast<const char*>(&g.running), sizeof(g.running));
+            g.wpmDigest.serialize(out);
+            appendArray(out, g.days);
+            appendArray(out, g.weeks);
+        }
+        uint32_t checksum = computeChecksum(out.data(), out.size());
+        out.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+
+        string tmpPath = path + ".tmp";
+        int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+
+        bool ok = write(fd, out.data(), out.size()) == (ssize_t)out.size();
+        close(fd);
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Returns false (leaving the stats empty) if the file is missing or damaged.
+    bool load() {
+        clear();
+        ifstream file(path, ios::binary);
+        if (!file.is_open()) return false;
+        string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+        uint32_t checksum;
+        if (data.size() < sizeof(fileMagic) + 8 + sizeof(covered) + sizeof(checksum)) return false;
+        memcpy(&checksum, data.data() + data.size() - sizeof(checksum), sizeof(checksum));
+        if (checksum != computeChecksum(data.data(), data.size() - sizeof(checksum))) return false;
+
+        string_view in(data.data(), data.size() - sizeof(checksum));
+        uint32_t header[2];
+        memcpy(header, in.data() + sizeof(fileMagic), sizeof(header));
+        if (memcmp(in.data(), fileMagic, sizeof(fileMagic)) != 0 || header[0] != formatVersion) return false;
+        in.remove_prefix(sizeof(fileMagic) + sizeof(header));
+        memcpy(&covered, in.data(), sizeof(covered));
+        in.remove_prefix(sizeof(covered));
+
+        for (uint32_t i = 0; i < header[1]; i++) {
+            Group g;
+            if (!readString(in, g.name) || !readString(in, g.difficulty) || in.size() < sizeof(g.running)) {
+                clear();
+                return false;
+            }
+            memcpy(&g.running, in.data(), sizeof(g.running));
+            in.remove_prefix(sizeof(g.running));
+            if (!g.wpmDigest.deserialize(in) || !readArray(in, g.days) || !readArray(in, g.weeks)) {
+                clear();
+                return false;
+            }
+            groupIndex.emplace(g.name + '\x1f' + g.difficulty, groups.size());
+            groups.push_back(move(g));
+        }
+        return true;
+    }
+};
+
+// Loads the saved statistics and brings them up to date with the history rows
+// (snapshot first, then the log): newer rows are replayed, and a stats file
+// that covers more rows than exist, e.g. after compaction dropped corrupted
+// records, is rebuilt from scratch. The caller holds the log lock, so no
+// compaction moves rows while they are counted.
+void catchUpStats(HistoryStats& stats, const HistorySnapshot& snapshot, const SessionLog& log) {
+    size_t archived = snapshot.size();
+    size_t logged = 0;
+    bool logActive = log.readGeneration() > snapshot.logGeneration();
+    if (logActive) {
+        log.scan([&](const HistoryRecord&) { logged++; });
+    }
+    size_t totalTests = archived + logged;
+    if (!stats.load() || stats.coveredTests() > totalTests) {
+        stats.clear();
+    }
+
+    size_t from = stats.coveredTests();
+    if (from < archived) {
+        const double* wpm = snapshot.wpm();
+        const double* accuracy = snapshot.accuracy();
+        const double* time = snapshot.time();
+        const int64_t* dates = snapshot.dates();
+        const uint32_t* nameIds = snapshot.nameIds();
+        const uint16_t* difficultyIds = snapshot.difficultyIds();
+        const uint8_t* flags = snapshot.flags();
+        unordered_map<uint64_t, uint32_t> groups;
+
+        for (size_t i = from; i < archived; i++) {
+            uint64_t key = (uint64_t(nameIds[i]) << 16) | difficultyIds[i];
+            auto group = groups.find(key);
+            if (group == groups.end()) {
+                uint32_t id = stats.groupId(snapshot.name(nameIds[i]), snapshot.difficulty(difficultyIds[i]));
+                group = groups.emplace(key, id).first;
+            }
+            stats.add(group->second, flags && flags[i] ? 0 : wpm[i], accuracy[i], time[i], dates[i]);
+        }
+    }
+
+    // Appends from other sessions may arrive during the scan; they are left
+    // for the next catch-up so the covered count stays exact.
+    if (logActive && from < totalTests) {
+        size_t row = archived;
+        log.scan([&](const HistoryRecord& rec) {
+            if (row >= from && row < totalTests) {
+                stats.add(stats.groupId(fieldOf(rec.name), fieldOf(rec.difficulty)),
+                          SessionLog::isFlagged(rec) ? 0 : rec.wpm, rec.accuracy, rec.time, parseDate(fieldOf(rec.date)));
+            }
+            row++;
+        });
+    }
+}
+
+// Dense IDs for strings that repeat across many rows (user names,
+// difficulties); each distinct value is stored once.
+class StringInterner {
+private:
+    vector<string> values;
+    unordered_map<string, uint32_t> index;
+    string key; // lookup scratch, so finding an existing value allocates nothing
+
+public:
+    uint32_t intern(string_view value) {
+        key.assign(value.data(), value.size());
+        auto it = index.find(key);
+        if (it != index.end()) return it->second;
+
+        uint32_t id = values.size();
+        values.emplace_back(value);
+        index.emplace(move(key), id);
+        return id;
+    }
+
+    bool find(string_view value, uint32_t& id) {
+        key.assign(value.data(), value.size());
+        auto it = index.find(key);
+        if (it == index.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    string_view at(uint32_t id) const {
+        return id < values.size() ? string_view(values[id]) : string_view();
+    }
+
+    size_t size() const { return values.size(); }
+
+    void clear() {
+        values.clear();
+        index.clear();
+    }
+};
+
+// One history row as held in memory: 32 bytes and no pointers, against
+// roughly 150 bytes and three heap strings for TypingStats. The name and
+// difficulty are interned IDs, the date is epoch seconds, and character
+// counts saturate at 65535.
+struct PackedStats {
+    int64_t date;
+    uint32_t nameId;
+    float wpm;
+    float accuracy;
+    float time;
+    uint16_t difficultyId;
+    uint16_t correctChars;
+    uint16_t totalChars;
+    uint16_t errors;
+};
+static_assert(sizeof(PackedStats) == 32, "PackedStats layout must stay fixed");
+
+// In-memory history stored as structure-of-arrays: one column per
+// PackedStats field, so a scan reads only the columns it needs and each of
+// them sequentially.
+class HistoryStore {
+private:
+    StringInterner names;
+    StringInterner difficulties;
+    vector<int64_t> dateValues;
+    vector<uint32_t> nameIdValues;
+    vector<uint16_t> difficultyIdValues;
+    vector<float> wpmValues;
+    vector<float> accuracyValues;
+    vector<float> timeValues;
+    vector<uint16_t> correctCounts;
+    vector<uint16_t> totalCounts;
+    vector<uint16_t> errorCounts;
+    vector<uint8_t> flagValues;
+
+    static uint16_t saturate(int32_t count) {
+        return (uint16_t)min<int32_t>(max<int32_t>(count, 0), 0xFFFF);
+    }
+
+public:
+    size_t size() const { return dateValues.size(); }
+    bool empty() const { return dateValues.empty(); }
+
+    void reserve(size_t rows) {
+        dateValues.reserve(rows);
+        nameIdValues.reserve(rows);
+        difficultyIdValues.reserve(rows);
+        wpmValues.reserve(rows);
+        accuracyValues.reserve(rows);
+        timeValues.reserve(rows);
+        correctCounts.reserve(rows);
+        totalCounts.reserve(rows);
+        errorCounts.reserve(rows);
+        flagValues.reserve(rows);
+    }
+
+    void clear() {
+        names.clear();
+        difficulties.clear();
+        dateValues.clear();
+        nameIdValues.clear();
+        difficultyIdValues.clear();
+        wpmValues.clear();
+        accuracyValues.clear();
+        timeValues.clear();
+        correctCounts.clear();
+        totalCounts.clear();
+        errorCounts.clear();
+        flagValues.clear();
+    }
+
+    uint32_t nameId(string_view name) { return names.intern(name); }
+    uint16_t difficultyId(string_view difficulty) { return (uint16_t)difficulties.intern(difficulty); }
+    bool findName(string_view name, uint32_t& id) { return names.find(name, id); }
+    string_view name(uint32_t id) const { return names.at(id); }
+    string_view difficulty(uint16_t id) const { return difficulties.at(id); }
+    uint32_t nameCount() const { return names.size(); }
+    uint32_t difficultyCount() const { return difficulties.size(); }
+
+    void append(const PackedStats& row, bool flagged = false) {
+        dateValues.push_back(row.date);
+        nameIdValues.push_back(row.nameId);
+        difficultyIdValues.push_back(row.difficultyId);
+        wpmValues.push_back(row.wpm);
+        accuracyValues.push_back(row.accuracy);
+        timeValues.push_back(row.time);
+        correctCounts.push_back(row.correctChars);
+        totalCounts.push_back(row.totalChars);
+        errorCounts.push_back(row.errors);
+        flagValues.push_back(flagged ? 1 : 0);
+    }
+
+    void append(string_view name, string_view difficulty, double wpm, double accuracy, double time,
+                int32_t correctChars, int32_t totalChars, int32_t errors, int64_t date, bool flagged = false) {
+        append(PackedStats{date, nameId(name), (float)wpm, (float)accuracy, (float)time, difficultyId(difficulty),
+                           saturate(correctChars), saturate(totalChars), saturate(errors)}, flagged);
+    }
+
+    void append(const TypingStats& stats) {
+        append(stats.name, stats.difficulty, stats.wpm, stats.accuracy, stats.time, stats.correctChars,
+               stats.totalChars, stats.errors, parseDate(stats.date), stats.flagged);
+    }
+
+    void append(const HistoryRecord& rec) {
+        append(fieldOf(rec.name), fieldOf(rec.difficulty), rec.wpm, rec.accuracy, rec.time, rec.correctChars,
+               rec.totalChars, rec.errors, parseDate(fieldOf(rec.date)), SessionLog::isFlagged(rec));
+    }
+
+    PackedStats row(size_t i) const {
+        return PackedStats{dateValues[i], nameIdValues[i], wpmValues[i], accuracyValues[i], timeValues[i],
+                           difficultyIdValues[i], correctCounts[i], totalCounts[i], errorCounts[i]};
+    }
+
+    const int64_t* dates() const { return dateValues.data(); }
+    const uint32_t* nameIds() const { return nameIdValues.data(); }
+    const uint16_t* difficultyIds() const { return difficultyIdValues.data(); }
+    const float* wpm() const { return wpmValues.data(); }
+    const float* accuracy() const { return accuracyValues.data(); }
+    const float* time() const { return timeValues.data(); }
+    const uint16_t* correctChars() const { return correctCounts.data(); }
+    const uint16_t* totalChars() const { return totalCounts.data(); }
+    const uint16_t* errors() const { return errorCounts.data(); }
+    const uint8_t* flags() const { return flagValues.data(); }
+
+    // Replaces the rows with the log's valid records and returns how many
+    // corrupted ones were skipped.
+    size_t load(const SessionLog& log) {
+        clear();
+        return log.scan([&](const HistoryRecord& rec) { append(rec); });
+    }
+};
+
+// Totals over a range of history rows. As in RunningStats, only tests with a
+// valid WPM count towards the sums, and a test that failed timing validation
+// is counted as one without.
+struct HistoryTotals {
+    uint64_t tests = 0;
+    uint64_t valid = 0;
+    double sumWpm = 0;
+    double sumAccuracy = 0;
+    double sumTime = 0;
+    double bestWpm = 0;
+
+    void merge(const HistoryTotals& other) {
+        tests += other.tests;
+        valid += other.valid;
+        sumWpm += other.sumWpm;
+        sumAccuracy += other.sumAccuracy;
+        sumTime += other.sumTime;
+        bestWpm = max(bestWpm, other.bestWpm);
+    }
+
+    double averageWpm() const { return valid ? sumWpm / valid : 0; }
+    double averageAccuracy() const { return valid ? sumAccuracy / valid : 0; }
+};
+
+enum class QueryGrouping : uint8_t { None, Day, Week };
+
+// Tests in [from, to), optionally one user's and one difficulty's. Empty
+// strings match everything.
+struct HistoryQuery {
+    string user;
+    string difficulty;
+    int64_t from = numeric_limits<int64_t>::min();
+    int64_t to = numeric_limits<int64_t>::max();
+    QueryGrouping grouping = QueryGrouping::None;
+};
+
+struct HistoryQueryResult {
+    HistoryTotals totals;
+    vector<StatsBucket> buckets; // valid tests per local day or week, oldest first
+};
+
+// Date-ordered indexes over the full history: the snapshot rows, then the
+// log rows held in a HistoryStore, numbered in that order. byDate lists every
+// row by (date, row), and each user's and difficulty's posting list is the
+// same order restricted to its rows, so a date range is two binary searches
+// on whichever list is shortest. Users and difficulties are interned across
+// both sources.
+class HistoryIndex {
+private:
+    const HistorySnapshot* snapshot = nullptr;
+    const HistoryStore* store = nullptr;
+    size_t archived = 0;
+    size_t indexed = 0;
+    StringInterner users;
+    StringInterner difficulties;
+    vector<uint32_t> snapshotUsers;          // snapshot name ID -> user
+    vector<uint16_t> snapshotDifficulties;
+    vector<uint32_t> storeUsers;             // store name ID -> user
+    vector<uint16_t> storeDifficulties;
+    vector<uint32_t> byDate;
+    vector<vector<uint32_t>> userPostings;
+    vector<vector<uint32_t>> difficultyPostings;
+
+    int64_t dateOf(uint32_t row) const {
+        return row < archived ? snapshot->dates()[row] : store->dates()[row - archived];
+    }
+
+    double wpmOf(uint32_t row) const {
+        return row < archived ? snapshot->wpm()[row] : store->wpm()[row - archived];
+    }
+
+    double accuracyOf(uint32_t row) const {
+        return row < archived ? snapshot->accuracy()[row] : store->accuracy()[row - archived];
+    }
+
+    double timeOf(uint32_t row) const {
+        return row < archived ? snapshot->time()[row] : store->time()[row - archived];
+    }
+
+    bool flaggedOf(uint32_t row) const {
+        if (row >= archived) return store->flags()[row - archived] != 0;
+        return snapshot->flags() && snapshot->flags()[row] != 0;
+    }
+
+    uint32_t userOf(uint32_t row) const {
+        return row < archived ? snapshotUsers[snapshot->nameIds()[row]] : storeUsers[store->nameIds()[row - archived]];
+    }
+
+    uint16_t difficultyOf(uint32_t row) const {
+        return row < archived ? snapshotDifficulties[snapshot->difficultyIds()[row]]
+                              : storeDifficulties[store->difficultyIds()[row - archived]];
+    }
+
+    // The rows of a date-ordered list whose date is in [from, to).
+    pair<const uint32_t*, const uint32_t*> range(const vector<uint32_t>& list, int64_t from, int64_t to) const {
+        auto before = [this](uint32_t row, int64_t date) { return dateOf(row) < date; };
+        auto first = lower_bound(list.begin(), list.end(), from, before);
+        auto last = lower_bound(first, list.end(), to, before);
+        return {list.data() + (first - list.begin()), list.data() + (last - list.begin())};
+    }
+
+public:
+    size_t size() const { return indexed; }
+
+    void build(const HistorySnapshot& archive, const HistoryStore& recent) {
+        snapshot = &archive;
+        store = &recent;
+        archived = archive.size();
+        indexed = archived + recent.size();
+        users.clear();
+        difficulties.clear();
+        snapshotUsers.clear();
+        snapshotDifficulties.clear();
+        storeUsers.clear();
+        storeDifficulties.clear();
+        userPostings.clear();
+        difficultyPostings.clear();
+
+        for (uint32_t id = 0; id < archive.nameCount(); id++) {
+            snapshotUsers.push_back(users.intern(archive.name(id)));
+        }
+        for (uint32_t id = 0; id < archive.difficultyCount(); id++) {
+            snapshotDifficulties.push_back((uint16_t)difficulties.intern(archive.difficulty((uint16_t)id)));
+        }
+        for (uint32_t id = 0; id < recent.nameCount(); id++) {
+            storeUsers.push_back(users.intern(recent.name(id)));
+        }
+        for (uint32_t id = 0; id < recent.difficultyCount(); id++) {
+            storeDifficulties.push_back((uint16_t)difficulties.intern(recent.difficulty((uint16_t)id)));
+        }
+
+        // Rows are appended as tests finish, so they come in a few ascending
+        // runs (an import or a session with a wrong clock starts a new one).
+        // Adjacent runs are merged pairwise; each pass is linear, and the
+        // merges are stable, so equal dates stay in row order.
+        byDate.resize(indexed);
+        vector<uint32_t> bounds = {0};
+        for (uint32_t row = 0; row < indexed; row++) {
+            byDate[row] = row;
+            if (row > 0 && dateOf(row) < dateOf(row - 1)) bounds.push_back(row);
+        }
+        bounds.push_back(indexed);
+        auto earlier = [this](uint32_t a, uint32_t b) { return dateOf(a) < dateOf(b); };
+        while (bounds.size() > 2) {
+            vector<uint32_t> merged;
+            size_t i = 0;
+            for (; i + 2 < bounds.size(); i += 2) {
+                inplace_merge(byDate.begin() + bounds[i], byDate.begin() + bounds[i + 1],
+                              byDate.begin() + bounds[i + 2], earlier);
+                merged.push_back(bounds[i]);
+            }
+            merged.insert(merged.end(), bounds.begin() + i, bounds.end());
+            bounds.swap(merged);
+        }
+
+        // Sized first, then filled in date order, so each list comes out sorted.
+        vector<uint32_t> userCounts(users.size()), difficultyCounts(difficulties.size());
+        for (uint32_t row = 0; row < indexed; row++) {
+            userCounts[userOf(row)]++;
+            difficultyCounts[difficultyOf(row)]++;
+        }
+        userPostings.resize(users.size());
+        difficultyPostings.resize(difficulties.size());
+        for (size_t id = 0; id < userCounts.size(); id++) userPostings[id].reserve(userCounts[id]);
+        for (size_t id = 0; id < difficultyCounts.size(); id++) difficultyPostings[id].reserve(difficultyCounts[id]);
+        for (uint32_t row : byDate) {
+            userPostings[userOf(row)].push_back(row);
+            difficultyPostings[difficultyOf(row)].push_back(row);
+        }
+    }
+
+    HistoryQueryResult query(const HistoryQuery& q) {
+        HistoryQueryResult result;
+        const vector<uint32_t>* list = &byDate;
+        uint32_t user = 0, difficulty = 0;
+        bool byUser = !q.user.empty(), byDifficulty = !q.difficulty.empty();
+        if ((byUser && !users.find(q.user, user)) || (byDifficulty && !difficulties.find(q.difficulty, difficulty))) {
+            return result;
+        }
+        if (byUser) list = &userPostings[user];
+        if (byDifficulty && difficultyPostings[difficulty].size() < list->size()) list = &difficultyPostings[difficulty];
+
+        auto rows = range(*list, q.from, q.to);
+        for (const uint32_t* it = rows.first; it != rows.second; it++) {
+            uint32_t row = *it;
+            if ((byUser && userOf(row) != user) || (byDifficulty && difficultyOf(row) != difficulty)) continue;
+            result.totals.tests++;
+            double wpm = wpmOf(row);
+            if (wpm <= 0 || flaggedOf(row)) continue;
+            double accuracy = accuracyOf(row);
+            result.totals.valid++;
+            result.totals.sumWpm += wpm;
+            result.totals.sumAccuracy += accuracy;
+            result.totals.sumTime += timeOf(row);
+            result.totals.bestWpm = max(result.totals.bestWpm, wpm);
+            if (q.grouping == QueryGrouping::None) continue;
+
+            int32_t key = localDayIndex(dateOf(row));
+            if (q.grouping == QueryGrouping::Week) key = (key + 3) / 7;
+            if (result.buckets.empty() || result.buckets.back().key != key) {
+                result.buckets.push_back({key, 0, 0, 0, 0});
+            }
+            StatsBucket& bucket = result.buckets.back();
+            bucket.count++;
+            bucket.sumWpm += wpm;
+            bucket.sumAccuracy += accuracy;
+            bucket.bestWpm = max(bucket.bestWpm, wpm);
+        }
+        return result;
+    }
+};
+
+// Code point starting at byte i, and its length; malformed bytes decode as
+// themselves, one byte long.
+static uint32_t codepointAt(string_view text, size_t i, size_t& length) {
+    unsigned char lead = text[i];
+    length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    if (length == 1 || i + length > text.size()) {
+        length = 1;
+        return lead;
+    }
+    uint32_t cp = lead & (0x7F >> length);
+    for (size_t k = 1; k < length; k++) cp = (cp << 6) | (text[i + k] & 0x3F);
+    return cp;
+}
+
+static void appendUtf8(string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+static void eraseLastCodepoint(string& text) {
+    if (text.empty()) return;
+    size_t end = text.length() - 1;
+    while (end > 0 && ((unsigned char)text[end] & 0xC0) == 0x80) end--;
+    text.erase(end);
+}
+
+// Position-by-position comparison counts for an attempt, from a single pass.
+struct CompareCounts {
+    uint32_t correct = 0;    // same byte at the same position
+    uint32_t mismatched = 0; // different byte at the same position
+    uint32_t extra = 0;      // typed bytes past the end of the original
+    uint32_t missing = 0;    // original bytes past the end of the typed text
+
+    uint32_t errors() const {
+        return mismatched + extra + missing;
+    }
+};
+
+// Byte-equality counting and ASCII scanning kernels. The widest ones the CPU
+// supports are chosen once at startup; the scalar loops handle tails and
+// unknown targets.
+typedef size_t (*CountEqualFn)(const char* a, const char* b, size_t n);
+typedef size_t (*AsciiPrefixFn)(const char* text, size_t n);
+
+size_t countEqualScalar(const char* a, const char* b, size_t n) {
+    size_t equal = 0;
+    for (size_t i = 0; i < n; i++) {
+        equal += a[i] == b[i];
+    }
+    return equal;
+}
+
+// Length of the leading run of ASCII bytes.
+size_t asciiPrefixScalar(const char* text, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if ((unsigned char)text[i] >= 0x80) return i;
+    }
+    return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+size_t countEqualSse2(const char* a, const char* b, size_t n) {
+    size_t equal = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        equal += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+    }
+    return equal + countEqualScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t countEqualAvx2(const char* a, const char* b, size_t n) {
+    size_t equal = 0, i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        equal += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+    }
+    return equal + countEqualSse2(a + i, b + i, n - i);
+}
+
+size_t asciiPrefixSse2(const char* text, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        unsigned high = (unsigned)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)));
+        if (high) return i + __builtin_ctz(high);
+    }
+    return i + asciiPrefixScalar(text + i, n - i);
+}
+
+__attribute__((target("avx2")))
+size_t asciiPrefixAvx2(const char* text, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        unsigned high = (unsigned)_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)));
+        if (high) return i + __builtin_ctz(high);
+    }
+    return i + asciiPrefixSse2(text + i, n - i);
+}
+#endif
+
+#if defined(__aarch64__)
+size_t countEqualNeon(const char* a, const char* b, size_t n) {
+    size_t equal = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(a + i)),
+                                 vld1q_u8(reinterpret_cast<const uint8_t*>(b + i)));
+        equal += vaddvq_u8(vshrq_n_u8(eq, 7));
+    }
+    return equal + countEqualScalar(a + i, b + i, n - i);
+}
+
+size_t asciiPrefixNeon(const char* text, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(text + i))) >= 0x80) break;
+    }
+    return i + asciiPrefixScalar(text + i, n - i);
+}
+#endif
+
+struct CompareKernel {
+    CountEqualFn countEqual;
+    AsciiPrefixFn asciiPrefix;
+    const char* name;
+};
+
+const CompareKernel& compareKernel() {
+    static const CompareKernel kernel = [] {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return CompareKernel{countEqualAvx2, asciiPrefixAvx2, "avx2"};
+        return CompareKernel{countEqualSse2, asciiPrefixSse2, "sse2"};
+#elif defined(__aarch64__)
+        return CompareKernel{countEqualNeon, asciiPrefixNeon, "neon"};
+#else
+        return CompareKernel{countEqualScalar, asciiPrefixScalar, "scalar"};
+#endif
+    }();
+    return kernel;
+}
+
+CompareCounts compareText(string_view original, string_view typed) {
+    size_t overlap = min(original.length(), typed.length());
+    CompareCounts counts;
+    counts.correct = compareKernel().countEqual(original.data(), typed.data(), overlap);
+    counts.mismatched = overlap - counts.correct;
+    counts.extra = typed.length() - overlap;
+    counts.missing = original.length() - overlap;
+    return counts;
+}
+
+// Grapheme cluster boundaries of a UTF-8 text: the units a reader sees as one
+// character, such as "é" written as e + U+0301, a flag, or an emoji joined
+// with ZWJ. Scoring, highlighting and WPM all count clusters. Text that is
+// all ASCII is its own index (one cluster per byte) and keeps no table.
+// Other text keeps each cluster's starting byte offset.
+//
+// Clusters follow the Unicode rules that matter for typed text: combining
+// marks, variation selectors and emoji modifiers extend the character before
+// them, ZWJ joins two pictographs, and regional indicators pair into flags.
+// Hangul jamo sequences and Indic conjuncts are not joined.
+class GraphemeIndex {
+private:
+    string_view text;
+    size_t count = 0;
+    vector<uint32_t> starts; // empty while the text is all ASCII
+
+    static bool inRanges(uint32_t cp, const uint32_t (*ranges)[2], size_t n) {
+        size_t lo = 0, hi = n;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (cp < ranges[mid][0]) hi = mid;
+            else if (cp > ranges[mid][1]) lo = mid + 1;
+            else return true;
+        }
+        return false;
+    }
+
+    static bool isExtend(uint32_t cp) {
+        static const uint32_t ranges[][2] = {
+            {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+            {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670},
+            {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x0900, 0x0903}, {0x093A, 0x094F}, {0x0951, 0x0957},
+            {0x0962, 0x0963}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1AB0, 0x1AFF},
+            {0x1DC0, 0x1DFF}, {0x200C, 0x200D}, {0x20D0, 0x20FF}, {0x302A, 0x302F}, {0x3099, 0x309A},
+            {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0x1F3FB, 0x1F3FF}, {0xE0020, 0xE007F}, {0xE0100, 0xE01EF},
+        };
+        return cp >= 0x300 && inRanges(cp, ranges, std::size(ranges));
+    }
+
+    static bool isPictographic(uint32_t cp) {
+        static const uint32_t ranges[][2] = {
+            {0x00A9, 0x00A9}, {0x00AE, 0x00AE}, {0x203C, 0x203C}, {0x2049, 0x2049}, {0x2122, 0x2122},
+            {0x2139, 0x2139}, {0x2194, 0x21AA}, {0x231A, 0x23FF}, {0x24C2, 0x24C2}, {0x25AA, 0x27BF},
+            {0x2934, 0x2935}, {0x2B05, 0x2B55}, {0x3030, 0x3030}, {0x303D, 0x303D}, {0x3297, 0x3299},
+            {0x1F000, 0x1FAFF},
+        };
+        return cp >= 0xA9 && inRanges(cp, ranges, std::size(ranges));
+    }
+
+    static bool isRegional(uint32_t cp) {
+        return cp >= 0x1F1E6 && cp <= 0x1F1FF;
+    }
+
+    void segmentFrom(size_t i) {
+        while (i < text.size()) {
+            starts.push_back((uint32_t)i);
+            i = clusterEnd(text, i);
+        }
+        count = starts.size();
+    }
+
+public:
+    // End of the cluster that starts at byte i.
+    static size_t clusterEnd(string_view text, size_t i) {
+        size_t length;
+        uint32_t cp = codepointAt(text, i, length);
+        size_t end = i + length;
+        if (end >= text.size() || (unsigned char)text[end] < 0x80 || cp < 0x20) return end;
+
+        uint32_t next = codepointAt(text, end, length);
+        if (isRegional(cp) && isRegional(next)) {
+            end += length;
+            if (end >= text.size()) return end;
+            next = codepointAt(text, end, length);
+        }
+        bool pictographic = isPictographic(cp);
+        while (isExtend(next)) {
+            end += length;
+            if (end >= text.size()) break;
+            bool joiner = next == 0x200D;
+            next = codepointAt(text, end, length);
+            if (joiner && pictographic && isPictographic(next)) {
+                end += length;
+                if (end >= text.size()) break;
+                next = codepointAt(text, end, length);
+            }
+        }
+        return end;
+    }
+
+    void assign(string_view source) {
+        text = source;
+        starts.clear();
+        size_t ascii = compareKernel().asciiPrefix(source.data(), source.size());
+        if (ascii == source.size()) {
+            count = ascii;
+            return;
+        }
+        // The last ASCII byte may take the marks that follow it.
+        size_t plain = ascii > 0 ? ascii - 1 : 0;
+        starts.resize(plain);
+        iota(starts.begin(), starts.end(), 0u);
+        segmentFrom(plain);
+    }
+
+    // Follows a text that has only been appended to or cut short since the
+    // last call, as typed text is. Only the last cluster and anything after
+    // it are segmented again, since new bytes may extend that cluster.
+    void sync(string_view source) {
+        text = source;
+        if (starts.empty()) {
+            size_t kept = min(count, source.size());
+            size_t ascii = kept + compareKernel().asciiPrefix(source.data() + kept, source.size() - kept);
+            if (ascii == source.size()) {
+                count = ascii;
+                return;
+            }
+            size_t plain = ascii > 0 ? ascii - 1 : 0;
+            starts.resize(plain);
+            iota(starts.begin(), starts.end(), 0u);
+            segmentFrom(plain);
+            return;
+        }
+        while (count > 0 && starts[count - 1] >= source.size()) count--;
+        size_t from = count > 0 ? starts[--count] : 0;
+        starts.resize(count);
+        segmentFrom(from);
+    }
+
+    bool isAscii() const { return starts.empty(); }
+    size_t size() const { return count; }
+    string_view view() const { return text; }
+
+    // Byte offset of cluster g; size() gives the end of the text.
+    size_t offset(size_t g) const {
+        if (starts.empty()) return g;
+        return g < count ? starts[g] : text.size();
+    }
+
+    string_view at(size_t g) const {
+        if (starts.empty()) return text.substr(g, 1);
+        size_t start = starts[g];
+        return text.substr(start, offset(g + 1) - start);
+    }
+};
+
+size_t graphemeCount(string_view text) {
+    size_t ascii = compareKernel().asciiPrefix(text.data(), text.size());
+    if (ascii == text.size()) return ascii;
+    size_t clusters = ascii > 0 ? ascii - 1 : 0;
+    for (size_t i = clusters; i < text.size(); clusters++) {
+        i = GraphemeIndex::clusterEnd(text, i);
+    }
+    return clusters;
+}
+
+// Clusters that are equal at the same index in both texts; bytes through the
+// SIMD kernel when both are ASCII.
+size_t countEqualClusters(const GraphemeIndex& a, const GraphemeIndex& b) {
+    size_t overlap = min(a.size(), b.size());
+    if (a.isAscii() && b.isAscii()) return compareKernel().countEqual(a.view().data(), b.view().data(), overlap);
+    size_t equal = 0;
+    for (size_t g = 0; g < overlap; g++) {
+        equal += a.at(g) == b.at(g);
+    }
+    return equal;
+}
+
+enum class KeyKind : uint8_t {
+    Character,
+    Backspace,
+    Enter
+};
+
+// One captured keystroke. Timestamps are steady_clock nanoseconds since the
+// capture started; codepoint is only meaningful for Character events.
+struct Keystroke {
+    int64_t nanos;
+    uint32_t codepoint;
+    KeyKind kind;
+};
+
+// Fixed-capacity ring of keystrokes, allocated once up front so capturing never
+// allocates. When full, the oldest keystrokes are overwritten.
+class KeystrokeRing {
+private:
+    vector<Keystroke> buffer;
+    size_t head = 0;
+    size_t count = 0;
+
+public:
+    explicit KeystrokeRing(size_t capacity) : buffer(capacity) {}
+
+    void push(const Keystroke& key) {
+        buffer[(head + count) % buffer.size()] = key;
+        if (count < buffer.size()) {
+            count++;
+        } else {
+            head = (head + 1) % buffer.size();
+        }
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return buffer.size(); }
+
+    // Oldest-first indexing.
+    const Keystroke& operator[](size_t i) const {
+        return buffer[(head + i) % buffer.size()];
+    }
+};
+
+// Inter-key latency histogram with fixed millisecond buckets.
+struct LatencyHistogram {
+    static constexpr int bucketCount = 8;
+    static constexpr int bucketLimits[bucketCount - 1] = {50, 100, 150, 200, 300, 500, 1000};
+
+    int buckets[bucketCount] = {};
+    int samples = 0;
+    double totalMs = 0;
+
+    void add(double ms) {
+        int b = 0;
+        while (b < bucketCount - 1 && ms >= bucketLimits[b]) b++;
+        buckets[b]++;
+        samples++;
+        totalMs += ms;
+    }
+
+    double mean() const {
+        return samples > 0 ? totalMs / samples : 0;
+    }
+
+    string label(int b) const {
+        if (b == 0) return "<" + to_string(bucketLimits[0]) + "ms";
+        if (b == bucketCount - 1) return to_string(bucketLimits[b - 1]) + "ms+";
+        return to_string(bucketLimits[b - 1]) + "-" + to_string(bucketLimits[b]) + "ms";
+    }
+};
+
+// Latency and error counters for one key or one byte transition (48 bytes).
+// Latencies go into a fixed log-spaced histogram, so p95 needs no samples.
+struct TransitionCell {
+    static constexpr int bucketCount = 12;
+    static constexpr uint16_t bucketLimits[bucketCount - 1] = {40, 60, 80, 100, 125, 150, 200, 250, 300, 400, 600};
+
+    uint32_t samples;  // timed transitions
+    uint32_t attempts; // times the key/bigram was expected in the original
+    uint32_t errors;   // of those, typed wrong or missed
+    uint32_t reserved;
+    double sumMillis;
+    uint16_t buckets[bucketCount];
+
+    void addLatency(double ms) {
+        int b = 0;
+        while (b < bucketCount - 1 && ms >= bucketLimits[b]) b++;
+        if (buckets[b] == UINT16_MAX) {
+            for (auto& count : buckets) count /= 2;
+        }
+        buckets[b]++;
+        samples++;
+        sumMillis += ms;
+    }
+
+    // Adds another cell's counts. If a bucket sum overflows, all buckets
+    // are halved together so the distribution keeps its shape.
+    void merge(const TransitionCell& other) {
+        uint32_t sums[bucketCount];
+        bool overflow = false;
+        for (int b = 0; b < bucketCount; b++) {
+            sums[b] = uint32_t(buckets[b]) + other.buckets[b];
+            overflow |= sums[b] > UINT16_MAX;
+        }
+        for (int b = 0; b < bucketCount; b++) {
+            buckets[b] = overflow ? sums[b] / 2 : sums[b];
+        }
+        samples += other.samples;
+        attempts += other.attempts;
+        errors += other.errors;
+        sumMillis += other.sumMillis;
+    }
+
+    bool empty() const { return samples == 0 && attempts == 0; }
+    double meanMillis() const { return samples ? sumMillis / samples : 0; }
+    double errorRate() const { return attempts ? 100.0 * errors / attempts : 0; }
+
+    // Linear interpolation inside the bucket holding quantile q.
+    double percentile(double q) const {
+        uint32_t total = 0;
+        for (auto count : buckets) total += count;
+        if (total == 0) return 0;
+
+        double target = q * total, seen = 0;
+        for (int b = 0; b < bucketCount; b++) {
+            if (buckets[b] == 0) continue;
+            if (seen + buckets[b] >= target) {
+                double low = b == 0 ? 0 : bucketLimits[b - 1];
+                double high = b == bucketCount - 1 ? 1000 : bucketLimits[b];
+                return low + (high - low) * (target - seen) / buckets[b];
+            }
+            seen += buckets[b];
+        }
+        return 1000;
+    }
+};
+static_assert(sizeof(TransitionCell) == 48, "TransitionCell layout must stay fixed");
+
+// Per-user key and bigram statistics in a dense table indexed by byte pairs
+// (previous byte, byte), followed by one row of single-key cells. The table
+// is allocated once; folding a session in touches cells in place.
+// typing_keys.dat holds one sparse section per user and is streamed, so only
+// the current user's cells are ever materialised. Sessions also collect their
+// own additions separately, so saving merges them into whatever another
+// session of the same user saved in the meantime.
+class KeyStatsTable {
+private:
+    static constexpr char fileMagic[8] = {'T', 'S', 'C', 'K', 'E', 'Y', '0', '1'};
+    static constexpr uint32_t formatVersion = 1;
+    static constexpr size_t keyBase = 256 * 256;
+    static constexpr double pauseMillis = 2000; // longer gaps are pauses, not transitions
+
+    struct CellRecord {
+        uint64_t index;
+        TransitionCell cell;
+    };
+
+    vector<TransitionCell> cells;
+    vector<TransitionCell> unsaved; // this session's additions, same layout
+    string user;
+    bool dirty = false;
+
+    static bool readExact(FILE* file, void* data, size_t size) {
+        return fread(data, 1, size, file) == size;
+    }
+
+    static bool writeExact(FILE* file, const void* data, size_t size) {
+        return fwrite(data, 1, size, file) == size;
+    }
+
+    // Latencies come from consecutive ASCII keystrokes (a backspace breaks the
+    // chain); error rates come from the alignment ops against the original.
+    static void fold(vector<TransitionCell>& table, const GraphemeIndex& original, const string& ops,
+                     const KeystrokeRing& keys) {
+        int previous = -1;
+        int64_t previousNanos = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            const Keystroke& k = keys[i];
+            if (k.kind != KeyKind::Character || k.codepoint >= 128) {
+                previous = -1;
+                continue;
+            }
+            double ms = (k.nanos - previousNanos) / 1e6;
+            if (previous >= 0 && ms <= pauseMillis) {
+                table[previous * 256 + k.codepoint].addLatency(ms);
+                table[keyBase + k.codepoint].addLatency(ms);
+            }
+            previous = k.codepoint;
+            previousNanos = k.nanos;
+        }
+
+        // Keys are tracked for ASCII characters; any other character breaks
+        // the chain of bigrams.
+        size_t i = 0;
+        int before = -1;
+        for (char op : ops) {
+            if (op == 'I') continue;
+            if (i >= original.size()) break;
+            string_view cluster = original.at(i++);
+            if (cluster.size() != 1 || (unsigned char)cluster[0] >= 128) {
+                before = -1;
+                continue;
+            }
+            bool wrong = op != '=';
+            unsigned char expected = cluster[0];
+            table[keyBase + expected].attempts++;
+            table[keyBase + expected].errors += wrong;
+            if (before >= 0) {
+                TransitionCell& cell = table[before * 256 + expected];
+                cell.attempts++;
+                cell.errors += wrong;
+            }
+            before = expected;
+        }
+    }
+
+public:
+    KeyStatsTable() : cells(keyBase + 256) {}
+
+    TransitionCell& bigram(unsigned char first, unsigned char second) { return cells[first * 256 + second]; }
+    const TransitionCell& bigram(unsigned char first, unsigned char second) const { return cells[first * 256 + second]; }
+    TransitionCell& key(unsigned char c) { return cells[keyBase + c]; }
+    const TransitionCell& key(unsigned char c) const { return cells[keyBase + c]; }
+
+    const string& getUser() const { return user; }
+
+    // Mean latency over every timed key.
+    double averageKeyMillis() const {
+        double sum = 0;
+        uint64_t samples = 0;
+        for (int c = 0; c < 256; c++) {
+            sum += key(c).sumMillis;
+            samples += key(c).samples;
+        }
+        return samples ? sum / samples : 0;
+    }
+
+    // Letter bigrams and letters ranked by weakness: how far their mean
+    // latency sits above the user's average, plus three times their error
+    // rate. Case is folded so the indices match a word list's features.
+    vector<pair<uint32_t, double>> weakestFeatures(size_t limit) const {
+        const uint32_t minSamples = 3;
+        double average = averageKeyMillis();
+        auto weakness = [&](uint32_t samples, double sumMillis, uint32_t attempts, uint32_t errors) {
+            double slow = samples >= minSamples && average > 0 ? max(0.0, sumMillis / samples / average - 1) : 0;
+            double wrong = attempts >= minSamples ? double(errors) / attempts : 0;
+            return slow + 3 * wrong;
+        };
+
+        vector<pair<uint32_t, double>> ranked;
+        for (int a = 'a'; a <= 'z'; a++) {
+            for (int b = 'a' - 1; b <= 'z'; b++) {
+                uint32_t samples = 0, attempts = 0, errors = 0;
+                double sumMillis = 0;
+                for (int first : {a, toupper(a)}) {
+                    const TransitionCell* sources[2] = {
+                        b < 'a' ? &key(first) : &bigram(first, b),
+                        b < 'a' ? nullptr : &bigram(first, toupper(b))
+                    };
+                    for (const TransitionCell* cell : sources) {
+                        if (!cell) continue;
+                        samples += cell->samples;
+                        sumMillis += cell->sumMillis;
+                        attempts += cell->attempts;
+                        errors += cell->errors;
+                    }
+                }
+                double w = weakness(samples, sumMillis, attempts, errors);
+                if (w > 0) ranked.push_back({b < 'a' ? uint32_t(keyBase + a) : uint32_t(a * 256 + b), w});
+            }
+        }
+
+        sort(ranked.begin(), ranked.end(), [](const pair<uint32_t, double>& x, const pair<uint32_t, double>& y) {
+            return x.second > y.second;
+        });
+        if (ranked.size() > limit) ranked.resize(limit);
+        return ranked;
+    }
+
+    void clear() {
+        fill(cells.begin(), cells.end(), TransitionCell{});
+        dirty = false;
+    }
+
+    void addSession(const GraphemeIndex& original, const string& ops, const KeystrokeRing& keys) {
+        if (unsaved.empty()) unsaved.resize(cells.size());
+        fold(cells, original, ops, keys);
+        fold(unsaved, original, ops, keys);
+        dirty = true;
+    }
+
+    // Loads the section for name, skipping every other user's records.
+    bool load(const string& path, const string& name) {
+        fill(unsaved.begin(), unsaved.end(), TransitionCell{});
+        return readSection(path, name);
+    }
+
+    // Rewrites path with this user's section replaced, copying the other
+    // sections through a fixed buffer. The section is first re-read under
+    // the file's lock and this session's additions are applied on top.
+    bool save(const string& path) {
+        if (!dirty || user.empty()) return true;
+
+        FileLock lock(path + ".lock");
+        readSection(path, user);
+        for (size_t index = 0; index < unsaved.size(); index++) {
+            if (!unsaved[index].empty()) cells[index].merge(unsaved[index]);
+        }
+        if (!writeFile(path)) {
+            dirty = true;
+            return false;
+        }
+
+        fill(unsaved.begin(), unsaved.end(), TransitionCell{});
+        dirty = false;
+        return true;
+    }
+
+private:
+    bool readSection(const string& path, const string& name) {
+        clear();
+        user = name;
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) return false;
+
+        char magic[8];
+        uint32_t header[2];
+        bool ok = readExact(file, magic, sizeof(magic)) && readExact(file, header, sizeof(header)) &&
+                  memcmp(magic, fileMagic, sizeof(magic)) == 0 && header[0] == formatVersion;
+        bool found = false;
+        for (uint32_t s = 0; ok && !found && s < header[1]; s++) {
+            uint32_t nameLength, cellCount;
+            string sectionName;
+            ok = readExact(file, &nameLength, sizeof(nameLength)) && nameLength < 4096;
+            if (ok) {
+                sectionName.resize(nameLength);
+                ok = readExact(file, &sectionName[0], nameLength) && readExact(file, &cellCount, sizeof(cellCount));
+            }
+            if (!ok) break;
+            if (sectionName != name) {
+                ok = fseek(file, long(cellCount) * sizeof(CellRecord), SEEK_CUR) == 0;
+                continue;
+            }
+
+            CellRecord block[256];
+            for (uint32_t done = 0; ok && done < cellCount;) {
+                uint32_t n = min<uint32_t>(256, cellCount - done);
+                ok = readExact(file, block, n * sizeof(CellRecord));
+                for (uint32_t r = 0; ok && r < n; r++) {
+                    if (block[r].index < cells.size()) cells[block[r].index] = block[r].cell;
+                }
+                done += n;
+            }
+            found = ok;
+        }
+        fclose(file);
+        if (!ok) clear();
+        return found;
+    }
+
+    bool writeFile(const string& path) const {
+        string tmpPath = path + ".tmp";
+        FILE* out = fopen(tmpPath.c_str(), "wb");
+        if (!out) return false;
+
+        uint32_t header[2] = {formatVersion, 0};
+        bool ok = writeExact(out, fileMagic, sizeof(fileMagic)) && writeExact(out, header, sizeof(header));
+
+        FILE* in = fopen(path.c_str(), "rb");
+        if (in) {
+            char magic[8];
+            uint32_t oldHeader[2];
+            bool valid = readExact(in, magic, sizeof(magic)) && readExact(in, oldHeader, sizeof(oldHeader)) &&
+                         memcmp(magic, fileMagic, sizeof(magic)) == 0 && oldHeader[0] == formatVersion;
+            vector<char> buffer(1 << 16);
+            for (uint32_t s = 0; ok && valid && s < oldHeader[1]; s++) {
+                uint32_t nameLength, cellCount;
+                string sectionName;
+                valid = readExact(in, &nameLength, sizeof(nameLength)) && nameLength < 4096;
+                if (!valid) break;
+                sectionName.resize(nameLength);
+                valid = readExact(in, &sectionName[0], nameLength) && readExact(in, &cellCount, sizeof(cellCount));
+                if (!valid) break;
+
+                bool keep = sectionName != user;
+                if (keep) {
+                    ok = writeExact(out, &nameLength, sizeof(nameLength)) &&
+                         writeExact(out, sectionName.data(), nameLength) &&
+                         writeExact(out, &cellCount, sizeof(cellCount));
+                    header[1]++;
+                }
+                size_t remaining = size_t(cellCount) * sizeof(CellRecord);
+                while (ok && valid && remaining > 0) {
+                    size_t n = min(remaining, buffer.size());
+                    valid = readExact(in, buffer.data(), n);
+                    if (valid && keep) ok = writeExact(out, buffer.data(), n);
+                    remaining -= n;
+                }
+            }
+            fclose(in);
+        }
+
+        uint32_t nameLength = user.size(), cellCount = 0;
+        for (const auto& cell : cells) cellCount += !cell.empty();
+        ok = ok && writeExact(out, &nameLength, sizeof(nameLength)) && writeExact(out, user.data(), nameLength) &&
+             writeExact(out, &cellCount, sizeof(cellCount));
+        CellRecord block[256];
+        uint32_t pending = 0;
+        for (size_t index = 0; ok && index < cells.size(); index++) {
+            if (cells[index].empty()) continue;
+            block[pending++] = {index, cells[index]};
+            if (pending == 256) {
+                ok = writeExact(out, block, sizeof(block));
+                pending = 0;
+            }
+        }
+        ok = ok && writeExact(out, block, pending * sizeof(CellRecord));
+        header[1]++;
+
+        ok = ok && fseek(out, sizeof(fileMagic), SEEK_SET) == 0 && writeExact(out, header, sizeof(header));
+        ok = (fclose(out) == 0) && ok;
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+// Puts the terminal in raw (non-canonical, no echo) mode for its lifetime.
+// Does nothing when stdin is not a terminal.
+class RawTerminal {
+private:
+    struct termios saved;
+    bool active = false;
+
+public:
+    RawTerminal() {
+        if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved) != 0) return;
+
+        struct termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+        raw.c_iflag &= ~(IXON | ICRNL);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        active = tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == 0;
+    }
+
+    ~RawTerminal() {
+        if (active) {
+            tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+        }
+    }
+
+    bool isActive() const { return active; }
+};
+
+// One racer's progress as broadcast by the race hub; also the wire record of
+// a RaceUpdate. place is 0 while racing, the finishing place once done, and
+// -1 if the racer dropped out.
+struct RaceEntry {
+    uint16_t racerId;
+    int16_t place;
+    uint32_t typedChars;
+    uint32_t correctChars;
+    float wpm;
+    float accuracy;
+    uint32_t seq; // last progress message folded in
+};
+static_assert(sizeof(RaceEntry) == 24, "RaceEntry layout must stay fixed");
+
+struct RaceLane {
+    string name;
+    RaceEntry state;
+};
+
+// Live feedback drawn while the user types. Scores are kept incrementally, in
+// O(1) per keystroke, and each frame is built in one buffer and sent with a
+// single write, at most 60 times a second. In a race, the other racers' lanes
+// are drawn below the text.
+class LiveRenderer {
+private:
+    static constexpr int64_t frameIntervalNanos = 1000000000 / 60;
+    static constexpr size_t maxLanes = 8;
+
+    GraphemeIndex original, typedText;
+    vector<uint8_t> states; // one per typed character: 1 if it matches the original
+    int correctChars = 0;
+    int64_t firstKeyNanos = -1;
+    int64_t lastFrameNanos = 0;
+    bool dirty = false;
+    int width = 80;
+    string frame;
+    const vector<RaceLane>* lanes = nullptr;
+    uint16_t selfId = 0;
+    size_t laneRows = 0;
+    bool hubLost = false;
+    vector<const RaceLane*> shown;
+
+    // The leaders among the other racers: finishers by place, then by
+    // correct characters.
+    void appendLanes() {
+        shown.clear();
+        for (const auto& lane : *lanes) {
+            if (lane.state.racerId != selfId) shown.push_back(&lane);
+        }
+        auto ahead = [](const RaceLane* a, const RaceLane* b) {
+            int placeA = a->state.place > 0 ? a->state.place : INT_MAX;
+            int placeB = b->state.place > 0 ? b->state.place : INT_MAX;
+            if (placeA != placeB) return placeA < placeB;
+            return a->state.correctChars > b->state.correctChars;
+        };
+        size_t rows = min(laneRows, shown.size());
+        partial_sort(shown.begin(), shown.begin() + rows, shown.end(), ahead);
+
+        const int barWidth = 30;
+        for (size_t r = 0; r < laneRows; r++) {
+            frame += "\r\n\033[2K";
+            if (hubLost) {
+                if (r == 0) frame += "\033[33m⚠️  Lost the race hub; the other racers are no longer shown\033[0m";
+                continue;
+            }
+            if (r >= rows) continue;
+            const RaceEntry& e = shown[r]->state;
+            double done = original.size() == 0 ? 0 : min(1.0, double(e.correctChars) / original.size());
+            int filled = int(done * barWidth);
+            char line[96];
+            snprintf(line, sizeof(line), "%-12.12s ", shown[r]->name.c_str());
+            frame += line;
+            frame += e.place < 0 ? "\033[2m" : "\033[36m";
+            for (int i = 0; i < barWidth; i++) frame += i < filled ? "█" : "░";
+            snprintf(line, sizeof(line), "\033[0m %3d%% %5.1f WPM", int(done * 100), e.wpm);
+            frame += line;
+            if (e.place > 0) frame += "  🏁 #" + to_string(e.place);
+            else if (e.place < 0) frame += "  (left)";
+        }
+    }
+
+    void appendWindow() {
+        size_t cursor = states.size();
+        size_t span = max(20, width - 1);
+        size_t start = cursor > span / 3 ? cursor - span / 3 : 0;
+        size_t end = min(original.size(), start + span);
+
+        // 0 = untyped, 1 = correct, 2 = wrong, 3 = cursor
+        int current = -1;
+        for (size_t i = start; i < end; i++) {
+            int state = i < cursor ? (states[i] ? 1 : 2) : (i == cursor ? 3 : 0);
+            if (state != current) {
+                switch (state) {
+                    case 0: frame += "\033[0;2m"; break;
+                    case 1: frame += "\033[0;32m"; break;
+                    case 2: frame += "\033[0;97;41m"; break;
+                    case 3: frame += "\033[0;4m"; break;
+                }
+                current = state;
+            }
+            frame += original.at(i);
+        }
+        frame += "\033[0m";
+    }
+
+public:
+    void begin(string_view text) {
+        original.assign(text);
+        typedText.assign(string_view());
+        states.clear();
+        states.reserve(text.length() + 256);
+        frame.reserve(4096);
+        correctChars = 0;
+        firstKeyNanos = -1;
+        lastFrameNanos = -frameIntervalNanos;
+        dirty = true;
+        lanes = nullptr;
+        laneRows = 0;
+        hubLost = false;
+    }
+
+    // Draws the other racers below the text for the rest of this capture.
+    // The table is owned by the caller and may change between frames.
+    void setLanes(const vector<RaceLane>* raceLanes, uint16_t self) {
+        lanes = raceLanes;
+        selfId = self;
+        laneRows = raceLanes ? min(maxLanes, raceLanes->size() > 0 ? raceLanes->size() - 1 : 0) : 0;
+    }
+
+    void markDirty() {
+        dirty = true;
+    }
+
+    void markHubLost() {
+        hubLost = true;
+        dirty = true;
+    }
+
+    // Takes over the terminal; called by KeystrokeCapture once raw mode is on.
+    void start() {
+        struct winsize ws;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+            width = ws.ws_col;
+        }
+
+        ssize_t ignored = write(STDOUT_FILENO, "\033[?25l", 6);
+        (void)ignored;
+    }
+
+    // Brings the scores in line with the typed text after one keystroke. Only
+    // the characters that changed are visited: the new ones, or those erased.
+    // The last one is scored again, since a combining mark may have joined it.
+    void update(const string& typed, int64_t nanos) {
+        if (firstKeyNanos < 0) firstKeyNanos = nanos;
+
+        typedText.sync(typed);
+        size_t keep = min(states.size(), typedText.size() > 0 ? typedText.size() - 1 : 0);
+        while (states.size() > keep) {
+            correctChars -= states.back();
+            states.pop_back();
+        }
+        while (states.size() < typedText.size()) {
+            size_t i = states.size();
+            uint8_t match = i < original.size() && original.at(i) == typedText.at(i);
+            correctChars += match;
+            states.push_back(match);
+        }
+        dirty = true;
+    }
+
+    bool pending() const { return dirty; }
+    int64_t nextFrameNanos() const { return lastFrameNanos + frameIntervalNanos; }
+
+    void renderFrame(int64_t nanos) {
+        PROBE_SCOPE(Probe::Frame);
+        double elapsed = firstKeyNanos >= 0 ? (nanos - firstKeyNanos) / 1e9 : 0;
+        double wpm = elapsed > 0 ? (correctChars / 5.0) / (elapsed / 60.0) : 0;
+        double accuracy = states.empty() ? 100.0 : correctChars * 100.0 / states.size();
+
+        char status[128];
+        snprintf(status, sizeof(status), "⚡ %6.1f WPM   🎯 %5.1f%%   ⏱️  %5.1fs   ✏️  %zu/%zu",
+                 wpm, accuracy, elapsed, states.size(), original.size());
+
+        frame.clear();
+        frame += "\r\033[2K";
+        frame += status;
+        frame += "\r\n\033[2K";
+        appendWindow();
+        if (laneRows > 0) appendLanes();
+        frame += "\033[" + to_string(1 + laneRows) + "A\r";
+
+        ssize_t ignored = write(STDOUT_FILENO, frame.data(), frame.size());
+        (void)ignored;
+        lastFrameNanos = nanos;
+        dirty = false;
+    }
+
+    // Draws the final state and leaves the cursor below the live area.
+    void finish(int64_t nanos) {
+        renderFrame(nanos);
+        string below;
+        for (size_t r = 0; r < 2 + laneRows; r++) below += "\r\n";
+        below += "\033[?25h";
+        ssize_t ignored = write(STDOUT_FILENO, below.data(), below.size());
+        (void)ignored;
+    }
+};
+
+// Optional participant in a capture: sees every keystroke and may add one
+// descriptor to the wait, e.g. a race hub connection whose updates are drawn
+// in the live view.
+class CaptureListener {
+public:
+    virtual ~CaptureListener() = default;
+    virtual int descriptor() const = 0;
+    virtual void onKeystroke(const string& typed, int64_t nanos) = 0;
+    virtual void onReadable(int64_t nanos) = 0;
+};
+
+// Raw-mode input engine: reads one line keystroke by keystroke, timestamping
+// every key so timing starts at the first key rather than at the prompt.
+// Backspace removes a whole UTF-8 code point; escape sequences are ignored.
+// An optional time limit ends the capture exactly that long after the first
+// key, keeping whatever was typed; the wait is a poll() so idle costs no CPU.
+// With a LiveRenderer attached, it draws the line instead of plain echo.
+class KeystrokeCapture {
+private:
+    KeystrokeRing events;
+    string typed;
+    chrono::steady_clock::time_point origin;
+    bool echo = false;
+    LiveRenderer* live = nullptr;
+    CaptureListener* listener = nullptr;
+
+    unsigned char pending[4];
+    int pendingLength = 0;
+    int pendingExpected = 0;
+    int64_t pendingNanos = 0;
+    int escapeState = 0;
+    int64_t firstKeyNanos = -1;
+    int64_t endNanos = 0;
+    bool expired = false;
+    bool cancelled = false;
+
+    static int utf8Length(unsigned char lead) {
+        if (lead >= 0xF0 && lead <= 0xF7) return 4;
+        if (lead >= 0xE0) return 3;
+        if (lead >= 0xC0) return 2;
+        return 1;
+    }
+
+    static uint32_t decodeUtf8(const unsigned char* bytes, int length) {
+        if (length == 1) return bytes[0];
+        uint32_t cp = bytes[0] & (0x7F >> length);
+        for (int i = 1; i < length; i++) {
+            cp = (cp << 6) | (bytes[i] & 0x3F);
+        }
+        return cp;
+    }
+
+    int64_t now() const {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+    }
+
+    void echoBytes(const char* bytes, size_t length) {
+        if (!echo || live) return;
+        ssize_t ignored = write(STDOUT_FILENO, bytes, length);
+        (void)ignored;
+    }
+
+    // Reads up to max bytes. Terminals are read directly; piped input goes
+    // through cin so bytes already buffered by earlier prompts aren't lost.
+    ssize_t readInput(unsigned char* buffer, size_t max) {
+        if (echo) {
+            return read(STDIN_FILENO, buffer, max);
+        }
+        int c = cin.get();
+        if (c == EOF) return 0;
+        buffer[0] = (unsigned char)c;
+        return 1;
+    }
+
+    // Waits until input is readable or the timeout passes; false on timeout
+    // or when only the listener's descriptor woke us (it is served here).
+    // Piped input can't be polled past cin's buffer, so it is never waited on.
+    bool waitForInput(int64_t timeoutNanos) {
+        if (!echo) return true;
+        
+        struct pollfd pfds[2] = {{STDIN_FILENO, POLLIN, 0}, {listener ? listener->descriptor() : -1, POLLIN, 0}};
+        int timeoutMs = timeoutNanos < 0 ? -1 : (int)((timeoutNanos + 999999) / 1000000);
+        int ready;
+        do {
+            ready = poll(pfds, listener ? 2 : 1, timeoutMs);
+        } while (ready < 0 && errno == EINTR);
+        if (ready > 0 && listener && pfds[1].revents) {
+            listener->onReadable(now());
+            return pfds[0].revents != 0;
+        }
+        return ready != 0;
+    }
+
+    void record(const Keystroke& key) {
+        PROBE_COUNT(Counter::Keystrokes, 1);
+        if (firstKeyNanos < 0) firstKeyNanos = key.nanos;
+        endNanos = key.nanos;
+        events.push(key);
+        if (live) live->update(typed, key.nanos);
+        if (listener) listener->onKeystroke(typed, key.nanos);
+    }
+
+    // Same erase as replay uses, so a replay rebuilds exactly the typed text.
+    void eraseTypedCodepoint() {
+        if (typed.empty()) return;
+        eraseLastCodepoint(typed);
+        echoBytes("\b \b", 3);
+    }
+
+    // Feeds one input byte; returns true when the line is complete.
+    bool feed(unsigned char byte, int64_t nanos) {
+        if (escapeState == 1) {
+            escapeState = (byte == '[' || byte == 'O') ? 2 : 0;
+            return false;
+        }
+        if (escapeState == 2) {
+            if (byte >= 0x40 && byte <= 0x7E) escapeState = 0;
+            return false;
+        }
+
+        if (pendingExpected > 0) {
+            if ((byte & 0xC0) == 0x80) {
+                pending[pendingLength++] = byte;
+                if (pendingLength == pendingExpected) {
+                    typed.append(reinterpret_cast<char*>(pending), pendingLength);
+                    echoBytes(reinterpret_cast<char*>(pending), pendingLength);
+                    record({pendingNanos, decodeUtf8(pending, pendingLength), KeyKind::Character});
+                    pendingExpected = 0;
+                }
+                return false;
+            }
+            pendingExpected = 0; // malformed sequence, drop it
+        }
+
+        if (byte == 0x03) {
+            cancelled = true;
+            return true;
+        }
+        if (byte == '\r' || byte == '\n' || byte == 0x04) {
+            record({nanos, 0, KeyKind::Enter});
+            return true;
+        }
+        if (byte == 0x7F || byte == 0x08) {
+            eraseTypedCodepoint();
+            record({nanos, 0, KeyKind::Backspace});
+            return false;
+        }
+        if (byte == 0x1B) {
+            escapeState = 1;
+            return false;
+        }
+        if (byte < 0x20 && byte != '\t') {
+            return false;
+        }
+
+        int length = utf8Length(byte);
+        if (length > 1) {
+            pending[0] = byte;
+            pendingLength = 1;
+            pendingExpected = length;
+            pendingNanos = nanos;
+            return false;
+        }
+
+        typed += (char)byte;
+        echoBytes(reinterpret_cast<char*>(&byte), 1);
+        record({nanos, byte, KeyKind::Character});
+        return false;
+    }
+
+public:
+    explicit KeystrokeCapture(size_t capacity = 1 << 16) : events(capacity) {
+        typed.reserve(1024);
+    }
+
+    // Captures keystrokes until Enter, end of input, or timeLimitSeconds after
+    // the first keystroke (0 = no limit), and returns the text typed so far.
+    // Ctrl-C ends the capture as cancelled; the attempt must not be scored.
+    // The renderer, if given, must already have begun on the original text.
+    const string& captureLine(double timeLimitSeconds = 0, LiveRenderer* renderer = nullptr,
+                              CaptureListener* participant = nullptr) {
+        events.clear();
+        typed.clear();
+        pendingExpected = 0;
+        escapeState = 0;
+        firstKeyNanos = -1;
+        endNanos = 0;
+        expired = false;
+        cancelled = false;
+        int64_t limitNanos = (int64_t)(timeLimitSeconds * 1e9);
+
+        cout.flush();
+        RawTerminal terminal;
+        echo = terminal.isActive();
+        live = echo ? renderer : nullptr;
+        listener = participant;
+        origin = chrono::steady_clock::now();
+        if (live) live->start();
+
+        unsigned char buffer[64];
+        bool done = false;
+        while (!done) {
+            int64_t current = now();
+            int64_t timeout = -1;
+            if (limitNanos > 0 && firstKeyNanos >= 0) {
+                timeout = max<int64_t>(0, firstKeyNanos + limitNanos - current);
+            }
+            if (live && live->pending()) {
+                int64_t frameWait = max<int64_t>(0, live->nextFrameNanos() - current);
+                timeout = timeout < 0 ? frameWait : min(timeout, frameWait);
+            }
+
+            if (!waitForInput(timeout)) {
+                current = now();
+                if (limitNanos > 0 && firstKeyNanos >= 0 && current >= firstKeyNanos + limitNanos) {
+                    record({firstKeyNanos + limitNanos, 0, KeyKind::Enter});
+                    expired = true;
+                    break;
+                }
+                if (live && live->pending() && current >= live->nextFrameNanos()) live->renderFrame(current);
+                continue;
+            }
+
+            ssize_t n = readInput(buffer, sizeof(buffer));
+            if (n <= 0) {
+                record({now(), 0, KeyKind::Enter});
+                break;
+            }
+            int64_t nanos = now();
+            PROBE_SCOPE(Probe::Input);
+            for (ssize_t i = 0; i < n && !done; i++) {
+                done = feed(buffer[i], nanos);
+            }
+
+            if (live && !done && nanos >= live->nextFrameNanos()) {
+                live->renderFrame(nanos);
+            }
+        }
+
+        listener = nullptr;
+        if (live) {
+            live->finish(endNanos);
+            live = nullptr;
+        } else {
+            echoBytes("\r\n", 2);
+        }
+        return typed;
+    }
+
+    // True if the last capture was ended by its time limit.
+    bool timedOut() const { return expired; }
+
+    // True if the last capture was abandoned with Ctrl-C.
+    bool wasCancelled() const { return cancelled; }
+
+    const string& text() const { return typed; }
+    const KeystrokeRing& keystrokes() const { return events; }
+
+    // Seconds from the first keystroke to Enter; 0 if nothing was typed.
+    double elapsedSeconds() const {
+        if (firstKeyNanos < 0) return 0;
+        return (endNanos - firstKeyNanos) / 1e9;
+    }
+
+    int backspaces() const {
+        int count = 0;
+        for (size_t i = 0; i < events.size(); i++) {
+            if (events[i].kind == KeyKind::Backspace) count++;
+        }
+        return count;
+    }
+
+    LatencyHistogram latencies() const {
+        LatencyHistogram histogram;
+        for (size_t i = 1; i < events.size(); i++) {
+            if (events[i].kind == KeyKind::Enter) continue;
+            histogram.add((events[i].nanos - events[i - 1].nanos) / 1e6);
+        }
+        return histogram;
+    }
+};
+
+// A recorded test: the passage, the result as scored when it was typed, and
+// every keystroke. Keystrokes are packed at about one byte each:
+//   0x00-0xDF  the predicted character (KeyPredictor), typed b ms after the
+//              previous key
+//   0xE0|kind  varint ms delta, then for kind 1 a varint code point;
+//              kind 0 = next character, 1 = other character, 2 = backspace,
+//              3 = enter
+// Times are rounded to whole milliseconds from the first key, so rounding
+// never accumulates.
+struct SessionRecording {
+    string name;
+    string difficulty;
+    int64_t date = 0;
+    double wpm = 0;
+    double accuracy = 0;
+    double time = 0;
+    int32_t correctChars = 0;
+    int32_t totalChars = 0;
+    int32_t errors = 0;
+    bool prefixOnly = false; // scored against a prefix of the passage (timed mode)
+    bool flagged = false;    // failed timing validation, so it was not ranked
+    uint32_t keyCount = 0;
+    string passage;
+    string events;
+};
+
+static constexpr unsigned char recordingLongForm = 0xE0;
+
+void appendVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+bool readVarint(string_view in, size_t& position, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && position < in.size(); shift += 7) {
+        unsigned char byte = in[position++];
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (byte < 0x80) return true;
+    }
+    return false;
+}
+
+// Guesses each keystroke from the passage, for the one-byte form. After a
+// miss it looks one character either side of the expected one, so a skipped
+// or doubled character costs a couple of long-form keys instead of shifting
+// the rest of the test out of step. Encoder and replay run the same guesses.
+class KeyPredictor {
+private:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    string_view passage;
+    size_t position = 0;
+    vector<size_t> undo; // position before each typed character
+
+    // Start of the code point before byte i; the passage length if none.
+    size_t previousStart(size_t i) const {
+        if (i == 0) return passage.size();
+        do i--; while (i > 0 && ((unsigned char)passage[i] & 0xC0) == 0x80);
+        return i;
+    }
+
+public:
+    KeyPredictor() = default;
+    explicit KeyPredictor(string_view text) : passage(text) {}
+
+    void reset() {
+        position = 0;
+        undo.clear();
+    }
+
+    void reset(string_view text) {
+        passage = text;
+        reset();
+    }
+
+    // The code point expected next, or none past the end of the passage.
+    uint32_t expected() const {
+        size_t length;
+        return position < passage.size() ? codepointAt(passage, position, length) : none;
+    }
+
+    void type(uint32_t codepoint) {
+        undo.push_back(position);
+        if (position >= passage.size()) return;
+        size_t length;
+        if (codepointAt(passage, position, length) == codepoint) {
+            position += length;
+            return;
+        }
+        size_t next = position + length;
+        size_t candidates[3] = {next, previousStart(position), next};
+        if (next < passage.size()) {
+            size_t skip;
+            codepointAt(passage, next, skip);
+            candidates[2] = next + skip;
+        }
+        for (size_t c : candidates) {
+            size_t candidateLength;
+            if (c < passage.size() && codepointAt(passage, c, candidateLength) == codepoint) {
+                position = c + candidateLength;
+                return;
+            }
+        }
+        position = next; // a substitution
+    }
+
+    void erase() {
+        if (undo.empty()) return;
+        position = undo.back();
+        undo.pop_back();
+    }
+};
+
+// Packs captured keystrokes against the passage they were typed from.
+void encodeKeystrokes(string_view passage, const KeystrokeRing& keys, SessionRecording& rec) {
+    rec.events.clear();
+    rec.events.reserve(keys.size() + 16);
+    rec.keyCount = keys.size();
+    static thread_local KeyPredictor predictor;
+    predictor.reset(passage);
+    int64_t previousMillis = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        const Keystroke& key = keys[i];
+        int64_t millis = (key.nanos - keys[0].nanos + 500000) / 1000000;
+        uint64_t delta = millis - previousMillis;
+        previousMillis = millis;
+
+        int kind = key.kind == KeyKind::Backspace ? 2 : key.kind == KeyKind::Enter ? 3 : 1;
+        if (kind == 1 && predictor.expected() == key.codepoint) kind = 0;
+        if (kind == 0 && delta < recordingLongForm) {
+            rec.events += (char)delta;
+        } else {
+            rec.events += (char)(recordingLongForm | kind);
+            appendVarint(rec.events, delta);
+            if (kind == 1) appendVarint(rec.events, key.codepoint);
+        }
+
+        if (kind <= 1) predictor.type(key.codepoint);
+        else if (kind == 2) predictor.erase();
+    }
+}
+
+// Steps through a recording, rebuilding the typed text one keystroke at a
+// time. Seeking backwards restarts from the first keystroke; decoding runs at
+// tens of millions of keystrokes per second, so any seek is cheap.
+class ReplayCursor {
+private:
+    const SessionRecording& rec;
+    KeyPredictor predictor;
+    size_t position = 0;
+    size_t index = 0;
+    int64_t millis = 0;
+    string typed;
+    Keystroke last = {};
+    bool corrupt = false;
+
+public:
+    explicit ReplayCursor(const SessionRecording& recording) : rec(recording), predictor(recording.passage) {
+        typed.reserve(rec.passage.size() + 64);
+    }
+
+    void rewind() {
+        position = 0;
+        index = 0;
+        millis = 0;
+        typed.clear();
+        predictor.reset();
+        last = {};
+        corrupt = false;
+    }
+
+    // Applies the next keystroke; false at the end or on a corrupt stream.
+    bool next() {
+        if (index >= rec.keyCount || position >= rec.events.size() || corrupt) return false;
+        unsigned char head = rec.events[position++];
+        uint64_t delta = head, codepoint = 0;
+        int kind = 0;
+        if (head >= recordingLongForm) {
+            kind = head & 3;
+            corrupt = !readVarint(rec.events, position, delta) ||
+                      (kind == 1 && !readVarint(rec.events, position, codepoint));
+            if (corrupt) return false;
+        }
+        if (kind == 0) {
+            codepoint = predictor.expected();
+            corrupt = codepoint == UINT32_MAX;
+            if (corrupt) return false;
+        }
+
+        millis += delta;
+        last.nanos = millis * 1000000;
+        last.codepoint = kind <= 1 ? (uint32_t)codepoint : 0;
+        last.kind = kind <= 1 ? KeyKind::Character : kind == 2 ? KeyKind::Backspace : KeyKind::Enter;
+        if (kind <= 1) {
+            appendUtf8(typed, last.codepoint);
+            predictor.type(last.codepoint);
+        } else if (kind == 2) {
+            eraseLastCodepoint(typed);
+            predictor.erase();
+        }
+        index++;
+        return true;
+    }
+
+    // Positions the cursor just after keystroke target (0 = before the first).
+    bool seek(size_t target) {
+        if (target < index) rewind();
+        while (index < target) {
+            if (!next()) return false;
+        }
+        return true;
+    }
+
+    size_t keyIndex() const { return index; }
+    int64_t nanos() const { return last.nanos; }
+    const Keystroke& keystroke() const { return last; }
+    const string& text() const { return typed; }
+    bool atEnd() const { return index >= rec.keyCount; }
+    bool isCorrupt() const { return corrupt; }
+};
+
+// Append-only file of recordings (typing_sessions.rec). Each record is one
+// write, so concurrent sessions don't interleave; the length-prefixed chain is
+// checked under the exclusive lock when opened, and a torn tail is trimmed.
+//   file:    "TSCREC01"
+//   record:  length | checksum (uint32) | RecordingHeader | name | difficulty
+//            | passage | events
+class RecordingLog {
+private:
+    static constexpr char fileMagic[8] = {'T', 'S', 'C', 'R', 'E', 'C', '0', '1'};
+
+    struct RecordingHeader {
+        double wpm;
+        double accuracy;
+        double time;
+        int64_t date;
+        int32_t correctChars;
+        int32_t totalChars;
+        int32_t errors;
+        uint32_t keyCount;
+        uint32_t passageLength;
+        uint32_t eventLength;
+        uint8_t nameLength;
+        uint8_t difficultyLength;
+        uint8_t flags; // 1 = prefixOnly, 2 = flagged
+        uint8_t reserved;
+    };
+    static_assert(sizeof(RecordingHeader) == 64, "RecordingHeader layout must stay fixed");
+
+    string path;
+    int fd = -1;
+    string record; // reused between appends
+
+    bool lockFile(int operation) {
+        while (flock(fd, operation) != 0) {
+            if (errno != EINTR) return false;
+        }
+        return true;
+    }
+
+    // Walks the length chain and cuts anything past the last whole record.
+    bool trimTornTail() {
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        if (st.st_size < (off_t)sizeof(fileMagic)) {
+            return ftruncate(fd, 0) == 0 && write(fd, fileMagic, sizeof(fileMagic)) == (ssize_t)sizeof(fileMagic);
+        }
+        off_t offset = sizeof(fileMagic);
+        uint32_t length;
+        while (offset + 8 <= st.st_size && pread(fd, &length, 4, offset) == 4 &&
+               offset + 8 + (off_t)length <= st.st_size) {
+            offset += 8 + length;
+        }
+        return offset == st.st_size || ftruncate(fd, offset) == 0;
+    }
+
+public:
+    explicit RecordingLog(const string& logPath) : path(logPath) {}
+
+    ~RecordingLog() {
+        if (fd >= 0) close(fd);
+    }
+
+    const string& getPath() const { return path; }
+
+    bool append(const SessionRecording& rec) {
+        PROBE_SCOPE(Probe::RecordingAppend);
+        if (fd < 0) {
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+            if (fd < 0) return false;
+            bool ok = lockFile(LOCK_EX) && trimTornTail();
+            flock(fd, LOCK_UN);
+            if (!ok) {
+                close(fd);
+                fd = -1;
+                return false;
+            }
+        }
+
+        RecordingHeader h = {rec.wpm, rec.accuracy, rec.time, rec.date, rec.correctChars, rec.totalChars,
+                             rec.errors, rec.keyCount, (uint32_t)rec.passage.size(), (uint32_t)rec.events.size(),
+                             (uint8_t)min<size_t>(rec.name.size(), 255),
+                             (uint8_t)min<size_t>(rec.difficulty.size(), 255),
+                             (uint8_t)(rec.prefixOnly | rec.flagged << 1), 0};
+        record.assign(8, '\0');
+        record.append(reinterpret_cast<const char*>(&h), sizeof(h));
+        record.append(rec.name, 0, h.nameLength);
+        record.append(rec.difficulty, 0, h.difficultyLength);
+        record += rec.passage;
+        record += rec.events;
+        uint32_t length = record.size() - 8;
+        uint32_t checksum = computeChecksum(record.data() + 8, length);
+        memcpy(&record[0], &length, 4);
+        memcpy(&record[4], &checksum, 4);
+
+        if (!lockFile(LOCK_SH)) return false;
+        bool written = write(fd, record.data(), record.size()) == (ssize_t)record.size();
+        flock(fd, LOCK_UN);
+        if (written) PROBE_COUNT(Counter::RecordingBytes, record.size());
+        return written;
+    }
+
+    // Calls fn for every intact recording, oldest first; corrupted records
+    // are skipped. Returns false if the file can't be read.
+    template <typename Fn>
+    bool scan(Fn fn) const {
+        ifstream in(path, ios::binary);
+        if (!in) return false;
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if (data.size() < sizeof(fileMagic) || memcmp(data.data(), fileMagic, sizeof(fileMagic)) != 0) {
+            return data.empty();
+        }
+
+        SessionRecording rec;
+        size_t offset = sizeof(fileMagic);
+        while (offset + 8 <= data.size()) {
+            uint32_t length, checksum;
+            memcpy(&length, data.data() + offset, 4);
+            memcpy(&checksum, data.data() + offset + 4, 4);
+            if (offset + 8 + length > data.size()) break;
+            const char* body = data.data() + offset + 8;
+            offset += 8 + length;
+
+            RecordingHeader h;
+            if (length < sizeof(h) || computeChecksum(body, length) != checksum) continue;
+            memcpy(&h, body, sizeof(h));
+            if (sizeof(h) + h.nameLength + h.difficultyLength + (uint64_t)h.passageLength + h.eventLength != length) {
+                continue;
+            }
+            const char* p = body + sizeof(h);
+            rec.name.assign(p, h.nameLength);
+            p += h.nameLength;
+            rec.difficulty.assign(p, h.difficultyLength);
+            p += h.difficultyLength;
+            rec.passage.assign(p, h.passageLength);
+            p += h.passageLength;
+            rec.events.assign(p, h.eventLength);
+            rec.wpm = h.wpm;
+            rec.accuracy = h.accuracy;
+            rec.time = h.time;
+            rec.date = h.date;
+            rec.correctChars = h.correctChars;
+            rec.totalChars = h.totalChars;
+            rec.errors = h.errors;
+            rec.keyCount = h.keyCount;
+            rec.prefixOnly = h.flags & 1;
+            rec.flagged = h.flags & 2;
+            fn(rec);
+        }
+        return true;
+    }
+};
+
+// Reasons a test's keystroke timing can't have come from a person typing.
+enum TimingFlag : uint8_t {
+    PasteBurst = 1,      // a run of characters arriving together
+    UniformRhythm = 2,   // intervals too regular for a hand
+    ImpossibleSpeed = 4  // key repeats or a sustained pace beyond human reach
+};
+
+struct TimingVerdict {
+    uint8_t flags = 0;
+    uint32_t longestBurst = 0;      // characters, each under burstGapMillis apart
+    double intervalCv = 0;          // stddev / mean of the typing intervals
+    uint32_t fastRepeats = 0;       // same character twice within repeatMillis
+    double fastestWindowMillis = 0; // mean interval over the fastest window
+
+    bool suspicious() const { return flags != 0; }
+
+    string describe() const {
+        char buffer[192];
+        string out;
+        if (flags & PasteBurst) {
+            snprintf(buffer, sizeof(buffer), "%u characters arrived at once; ", longestBurst);
+            out += buffer;
+        }
+        if (flags & UniformRhythm) {
+            snprintf(buffer, sizeof(buffer), "keystroke rhythm is machine-regular (CV %.3f); ", intervalCv);
+            out += buffer;
+        }
+        if (flags & ImpossibleSpeed) {
+            snprintf(buffer, sizeof(buffer), "%u repeated keys under the minimum, fastest stretch %.1f ms/key; ",
+                     fastRepeats, fastestWindowMillis);
+            out += buffer;
+        }
+        if (out.size() >= 2) out.resize(out.size() - 2);
+        return out;
+    }
+};
+
+// One pass over a test's keystrokes with O(1) state: the current burst, a
+// Welford mean/variance of the typing intervals, and a ring of the last
+// windowKeys character times. Checks a test in a few microseconds, so the
+// whole recording archive can be re-checked too. The limits leave room for
+// the fastest human bursts and key rollover; a verdict needs several
+// impossible events, not one.
+class TimingValidator {
+private:
+    static constexpr int64_t burstGapNanos = 8000000;     // 8 ms
+    static constexpr uint32_t burstLimit = 8;
+    static constexpr int64_t minIntervalNanos = 20000000; // rhythm: active typing only
+    static constexpr int64_t maxIntervalNanos = 1500000000;
+    static constexpr uint64_t rhythmMinSamples = 30;
+    static constexpr double rhythmMinCv = 0.10;
+    static constexpr int64_t repeatNanos = 25000000;      // same key needs a release and a press
+    static constexpr uint32_t repeatLimit = 3;
+    static constexpr size_t windowKeys = 16;
+    static constexpr double windowMinMillis = 30; // per key, ~400 WPM sustained
+
+    int64_t previousNanos = -1;
+    int64_t previousCharNanos = -1;
+    uint32_t previousCodepoint = 0;
+    uint32_t burst = 0;
+    uint64_t intervals = 0;
+    double mean = 0;
+    double m2 = 0;
+    int64_t window[windowKeys];
+    uint64_t characters = 0;
+    TimingVerdict verdict;
+
+public:
+    void reset() {
+        previousNanos = -1;
+        previousCharNanos = -1;
+        burst = 0;
+        intervals = 0;
+        mean = 0;
+        m2 = 0;
+        characters = 0;
+        verdict = TimingVerdict();
+    }
+
+    void add(const Keystroke& key) {
+        if (key.kind == KeyKind::Enter) return;
+        if (previousNanos >= 0) {
+            int64_t gap = key.nanos - previousNanos;
+            if (gap >= minIntervalNanos && gap <= maxIntervalNanos) {
+                intervals++;
+                double delta = gap - mean;
+                mean += delta / intervals;
+                m2 += delta * (gap - mean);
+            }
+        }
+        previousNanos = key.nanos;
+        if (key.kind != KeyKind::Character) {
+            burst = 0;
+            return;
+        }
+
+        int64_t gap = previousCharNanos >= 0 ? key.nanos - previousCharNanos : INT64_MAX;
+        burst = gap < burstGapNanos ? burst + 1 : 1;
+        verdict.longestBurst = max(verdict.longestBurst, burst);
+        if (gap < repeatNanos && key.codepoint == previousCodepoint) verdict.fastRepeats++;
+
+        // Bursts are judged above; the window only sees paced typing.
+        if (gap >= burstGapNanos) {
+            if (characters >= windowKeys) {
+                int64_t span = key.nanos - window[characters % windowKeys];
+                double perKey = span / 1e6 / windowKeys;
+                if (verdict.fastestWindowMillis == 0 || perKey < verdict.fastestWindowMillis) {
+                    verdict.fastestWindowMillis = perKey;
+                }
+            }
+            window[characters % windowKeys] = key.nanos;
+            characters++;
+        }
+        previousCharNanos = key.nanos;
+        previousCodepoint = key.codepoint;
+    }
+
+    TimingVerdict finish() {
+        verdict.intervalCv = intervals > 1 && mean > 0 ? sqrt(m2 / (intervals - 1)) / mean : 0;
+        verdict.flags = 0;
+        if (verdict.longestBurst >= burstLimit) verdict.flags |= PasteBurst;
+        if (intervals >= rhythmMinSamples && verdict.intervalCv < rhythmMinCv) verdict.flags |= UniformRhythm;
+        if (verdict.fastRepeats >= repeatLimit ||
+            (verdict.fastestWindowMillis > 0 && verdict.fastestWindowMillis < windowMinMillis)) {
+            verdict.flags |= ImpossibleSpeed;
+        }
+        return verdict;
+    }
+
+    TimingVerdict check(const KeystrokeRing& keys) {
+        PROBE_SCOPE(Probe::Validate);
+        reset();
+        for (size_t i = 0; i < keys.size(); i++) add(keys[i]);
+        return finish();
+    }
+
+    TimingVerdict check(const vector<Keystroke>& keys) {
+        reset();
+        for (const Keystroke& key : keys) add(key);
+        return finish();
+    }
+
+    TimingVerdict check(const SessionRecording& rec) {
+        reset();
+        ReplayCursor cursor(rec);
+        while (cursor.next()) add(cursor.keystroke());
+        return finish();
+    }
+};
+
+// Outcome of aligning typed text against the original, counted in grapheme
+// clusters. Insertions are extra characters typed, deletions are original
+// characters that were skipped.
+struct AlignmentResult {
+    int matches = 0;
+    int substitutions = 0;
+    int insertions = 0;
+    int deletions = 0;
+    size_t originalLength = 0; // portion of the original the typed text covers
+    string ops;                // per aligned position: '=', 'S', 'I' or 'D'
+
+    int distance() const {
+        return substitutions + insertions + deletions;
+    }
+
+    int typedLength() const {
+        return matches + substitutions + insertions;
+    }
+
+    // Matches as a percentage of the longer of the two aligned texts.
+    double accuracy() const {
+        int total = max(matches + substitutions + deletions, matches + substitutions + insertions);
+        return total > 0 ? (double)matches / total * 100.0 : 0;
+    }
+};
+
+// Scores typed text by Levenshtein alignment instead of position, so one
+// skipped character costs one error rather than everything after it.
+// Uses Myers' bit-parallel algorithm (64 rows of the DP per machine word).
+// Texts longer than fullWidthLimit are computed within bandRows of the
+// diagonals from the start and to the end, so an alignment that strays
+// further (a skipped paragraph, say) is not found. Very long inputs are
+// aligned chunk by chunk so memory stays bounded. Buffers are reused between
+// calls.
+//
+// ASCII texts are aligned byte by byte. Otherwise each distinct cluster of
+// the original is numbered, and the two texts are aligned as sequences of
+// those numbers, so a multi-byte character is one position.
+class AlignmentScorer {
+private:
+    static constexpr size_t fullWidthLimit = 512;
+    static constexpr int64_t bandRows = 192;
+    static constexpr size_t chunkColumns = 32768;
+    static constexpr int infinity = 1 << 29;
+
+    GraphemeIndex originalText, typedText;
+    u32string originalSymbols, typedSymbols;
+    vector<uint32_t> symbolSlots; // open addressing: first cluster index + 1
+    uint32_t symbolCount = 0;
+
+    size_t blocks = 0;
+    int16_t alphabet[256];
+    vector<int32_t> symbolAlphabet;
+    vector<uint64_t> peq;
+
+    // Working state for the current column, one entry per block.
+    vector<uint64_t> pv, mv;
+    vector<int> bottom;
+
+    // Stored columns for traceback: computed block range, the score of the row
+    // just above the range, and each computed block's state.
+    vector<int> firstBlock, lastBlock, topScore;
+    vector<size_t> columnOffset;
+    vector<uint64_t> pvStore, mvStore;
+    vector<int> bottomStore;
+
+    // Segments both texts and, unless both are ASCII, numbers their
+    // clusters. Typed clusters that are not in the original all get
+    // symbolCount, which matches nothing. Returns whether bytes will do.
+    bool segment(string_view original, string_view typed) {
+        originalText.assign(original);
+        typedText.assign(typed);
+        if (originalText.isAscii() && typedText.isAscii()) return true;
+
+        size_t slots = 16;
+        while (slots < originalText.size() * 2) slots <<= 1;
+        symbolSlots.assign(slots, 0);
+        symbolCount = 0;
+        auto find = [&](string_view cluster) {
+            size_t slot = hash<string_view>()(cluster) & (slots - 1);
+            while (symbolSlots[slot] && originalText.at(symbolSlots[slot] - 1) != cluster) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            return slot;
+        };
+
+        originalSymbols.resize(originalText.size());
+        for (size_t g = 0; g < originalText.size(); g++) {
+            size_t slot = find(originalText.at(g));
+            if (symbolSlots[slot] == 0) {
+                symbolSlots[slot] = (uint32_t)g + 1;
+                originalSymbols[g] = symbolCount++;
+            } else {
+                originalSymbols[g] = originalSymbols[symbolSlots[slot] - 1];
+            }
+        }
+        typedSymbols.resize(typedText.size());
+        for (size_t g = 0; g < typedText.size(); g++) {
+            size_t slot = find(typedText.at(g));
+            typedSymbols[g] = symbolSlots[slot] ? originalSymbols[symbolSlots[slot] - 1] : symbolCount;
+        }
+        symbolAlphabet.resize(symbolCount + 1);
+        return false;
+    }
+
+    void resetAlphabet(char) { memset(alphabet, -1, sizeof(alphabet)); }
+    void resetAlphabet(char32_t) { fill(symbolAlphabet.begin(), symbolAlphabet.end(), -1); }
+    int16_t& slot(char c) { return alphabet[(unsigned char)c]; }
+    int32_t& slot(char32_t symbol) { return symbolAlphabet[symbol]; }
+
+    template <typename Symbol>
+    void buildPeq(basic_string_view<Symbol> original) {
+        resetAlphabet(Symbol());
+        int symbols = 0;
+        for (Symbol c : original) {
+            auto& s = slot(c);
+            if (s < 0) s = symbols++;
+        }
+
+        blocks = (original.length() + 63) / 64;
+        peq.assign((size_t)symbols * blocks, 0);
+        for (size_t i = 0; i < original.length(); i++) {
+            peq[slot(original[i]) * blocks + i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+
+    // One 64-row block of Myers' algorithm for a single column.
+    static int advanceBlock(uint64_t& Pv, uint64_t& Mv, uint64_t Eq, int hin) {
+        uint64_t hinNeg = hin < 0 ? 1 : 0;
+        uint64_t Xv = Eq | Mv;
+        Eq |= hinNeg;
+        uint64_t Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+        uint64_t Ph = Mv | ~(Xh | Pv);
+        uint64_t Mh = Pv & Xh;
+
+        int hout = 0;
+        if (Ph >> 63) hout = 1;
+        if (Mh >> 63) hout = -1;
+
+        Ph <<= 1;
+        Mh <<= 1;
+        Mh |= hinNeg;
+        Ph |= hin > 0 ? 1 : 0;
+        Pv = Mh | ~(Xv | Ph);
+        Mv = Ph & Xv;
+        return hout;
+    }
+
+    // DP value D(i, j) reconstructed from the stored column states.
+    int cell(size_t i, size_t j) const {
+        if (j == 0) return (int)i;
+
+        int f = firstBlock[j], l = lastBlock[j];
+        size_t top = (size_t)f * 64;
+        if (i < top) return infinity;
+        if (i == top) return topScore[j];
+
+        size_t b = (i - 1) / 64;
+        const size_t base = columnOffset[j];
+        if ((int)b > l) {
+            size_t below = (size_t)(l + 1) * 64;
+            return bottomStore[base + (l - f)] + (int)(i - below);
+        }
+
+        int above = ((int)b == f) ? topScore[j] : bottomStore[base + (b - 1 - f)];
+        size_t bits = i - b * 64;
+        uint64_t mask = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+        return above + __builtin_popcountll(pvStore[base + (b - f)] & mask)
+                     - __builtin_popcountll(mvStore[base + (b - f)] & mask);
+    }
+
+    // Aligns typed against original. In prefix mode the alignment may end
+    // anywhere in the original (used when the text is longer than the attempt).
+    template <typename Symbol>
+    void alignSegment(basic_string_view<Symbol> original, basic_string_view<Symbol> typed, bool prefixOnly,
+                      bool wantOps, AlignmentResult& result) {
+        size_t n = typed.length();
+        size_t m = original.length();
+        bool banded = max(m, n) > fullWidthLimit;
+        int64_t band = banded ? bandRows : (int64_t)(m + n + 1);
+        if (prefixOnly) {
+            m = min(m, n + (size_t)(banded ? band : n + 1));
+            original = original.substr(0, m);
+        }
+
+        if (n == 0) {
+            if (!prefixOnly) {
+                result.deletions += m;
+                result.originalLength += m;
+                if (wantOps) result.ops.append(m, 'D');
+            }
+            return;
+        }
+        if (m == 0) {
+            result.insertions += n;
+            if (wantOps) result.ops.append(n, 'I');
+            return;
+        }
+
+        buildPeq(original);
+        pv.assign(blocks, ~uint64_t(0));
+        mv.assign(blocks, 0);
+        bottom.resize(blocks);
+        firstBlock.resize(n + 1);
+        lastBlock.resize(n + 1);
+        topScore.resize(n + 1);
+        columnOffset.resize(n + 1);
+        size_t stored = 0;
+
+        firstBlock[0] = 0;
+        lastBlock[0] = -1;
+        topScore[0] = 0;
+        int prevFirst = 0, prevLast = -1, prevTop = 0;
+
+        // The band covers the diagonal through (0, 0), the one ending at
+        // (m, n), everything between them and band rows either side, so an
+        // attempt much shorter or longer than the original still has its best
+        // alignment inside.
+        int64_t skew = prefixOnly ? 0 : (int64_t)m - (int64_t)n;
+        int64_t lowDiagonal = min<int64_t>(0, skew) - band;
+        int64_t highDiagonal = max<int64_t>(0, skew) + band;
+        for (size_t j = 1; j <= n; j++) {
+            int64_t lo = (int64_t)j + lowDiagonal, hi = (int64_t)j + highDiagonal;
+            int first = lo <= 1 ? 0 : (int)min<int64_t>((int64_t)blocks - 1, (lo - 1) / 64);
+            int last = (int)min<int64_t>((int64_t)blocks - 1, hi <= 1 ? 0 : (hi - 1) / 64);
+            first = max(first, prevFirst);
+            last = max(last, max(first, prevLast));
+
+            // Blocks entering the band start as a run of deletions below the
+            // last computed row: an upper bound, exact when the optimal
+            // alignment stays inside the band.
+            for (int b = max(prevLast + 1, 0); b <= last; b++) {
+                pv[b] = ~uint64_t(0);
+                mv[b] = 0;
+                bottom[b] = (b == 0 ? (int)(j - 1) : bottom[b - 1]) + 64;
+            }
+
+            int top;
+            if (first == 0) top = (int)j;
+            else if (first == prevFirst) top = prevTop + 1;
+            else top = bottom[first - 1] + 1;
+
+            int c = slot(typed[j - 1]);
+            const uint64_t* eqRow = c < 0 ? nullptr : &peq[(size_t)c * blocks];
+
+            size_t offset = stored;
+            stored += last - first + 1;
+            if (stored > pvStore.size()) {
+                pvStore.resize(stored * 2);
+                mvStore.resize(stored * 2);
+                bottomStore.resize(stored * 2);
+            }
+            columnOffset[j] = offset;
+
+            int hin = 1;
+            for (int b = first; b <= last; b++, offset++) {
+                hin = advanceBlock(pv[b], mv[b], eqRow ? eqRow[b] : 0, hin);
+                bottom[b] += hin;
+                pvStore[offset] = pv[b];
+                mvStore[offset] = mv[b];
+                bottomStore[offset] = bottom[b];
+            }
+
+            firstBlock[j] = first;
+            lastBlock[j] = last;
+            topScore[j] = top;
+            prevFirst = first;
+            prevLast = last;
+            prevTop = top;
+        }
+
+        // Pick the end row: the whole original, or the best prefix of it.
+        size_t i = m;
+        if (prefixOnly) {
+            int best = infinity;
+            size_t from = (size_t)firstBlock[n] * 64;
+            size_t to = min(m, (size_t)(lastBlock[n] + 1) * 64);
+            for (size_t row = from; row <= to; row++) {
+                int value = cell(row, n);
+                if (value < best || (value == best && row <= n)) {
+                    best = value;
+                    i = row;
+                }
+            }
+        }
+        result.originalLength += i;
+
+        size_t opsStart = result.ops.length();
+        size_t j = n;
+        while (i > 0 || j > 0) {
+            int d = cell(i, j);
+            if (i > 0 && j > 0) {
+                bool same = original[i - 1] == typed[j - 1];
+                if (cell(i - 1, j - 1) + (same ? 0 : 1) == d) {
+                    if (same) result.matches++;
+                    else result.substitutions++;
+                    if (wantOps) result.ops += same ? '=' : 'S';
+                    i--;
+                    j--;
+                    continue;
+                }
+            }
+            if (j > 0 && cell(i, j - 1) + 1 == d) {
+                result.insertions++;
+                if (wantOps) result.ops += 'I';
+                j--;
+            } else {
+                result.deletions++;
+                if (wantOps) result.ops += 'D';
+                i--;
+            }
+        }
+        if (wantOps) reverse(result.ops.begin() + opsStart, result.ops.end());
+    }
+
+    // Long attempts are aligned in chunks; each chunk ends at its best
+    // prefix of the remaining original, and the next chunk resumes there.
+    template <typename Symbol>
+    void alignChunks(AlignmentResult& result, basic_string_view<Symbol> original, basic_string_view<Symbol> typed,
+                     bool prefixOnly, bool wantOps) {
+        while (typed.length() > chunkColumns) {
+            size_t covered = result.originalLength;
+            alignSegment(original, typed.substr(0, chunkColumns), true, wantOps, result);
+            original.remove_prefix(result.originalLength - covered);
+            typed.remove_prefix(chunkColumns);
+        }
+        alignSegment(original, typed, prefixOnly, wantOps, result);
+    }
+
+    void alignSegmented(AlignmentResult& result, string_view original, string_view typed, bool prefixOnly,
+                        bool wantOps, bool bytes) {
+        PROBE_SCOPE(Probe::Align);
+        result.matches = result.substitutions = result.insertions = result.deletions = 0;
+        result.originalLength = 0;
+        result.ops.clear();
+        if (bytes) {
+            alignChunks(result, original, typed, prefixOnly, wantOps);
+        } else {
+            alignChunks(result, u32string_view(originalSymbols), u32string_view(typedSymbols), prefixOnly, wantOps);
+        }
+    }
+
+public:
+    // Scores an attempt. When the texts differ in at most one position, the
+    // positional comparison is already the optimal alignment, so the common
+    // clean ASCII attempt is settled by the SIMD kernel without running Myers.
+    AlignmentResult score(string_view original, string_view typed, bool prefixOnly = false) {
+        AlignmentResult result;
+        bool bytes = segment(original, typed);
+        string_view compared = prefixOnly ? original.substr(0, typed.length()) : original;
+        CompareCounts counts = bytes ? compareText(compared, typed) : CompareCounts{};
+        if (!bytes || counts.errors() > 1) {
+            alignSegmented(result, original, typed, prefixOnly, false, bytes);
+            return result;
+        }
+
+        result.matches = counts.correct;
+        result.substitutions = counts.mismatched;
+        result.insertions = counts.extra;
+        result.deletions = counts.missing;
+        result.originalLength = compared.length();
+        return result;
+    }
+
+    // Clusters of the texts last scored or aligned, which ops index into.
+    const GraphemeIndex& originalClusters() const { return originalText; }
+    const GraphemeIndex& typedClusters() const { return typedText; }
+
+    AlignmentResult align(string_view original, string_view typed, bool prefixOnly = false, bool wantOps = false) {
+        AlignmentResult result;
+        alignInto(result, original, typed, prefixOnly, wantOps);
+        return result;
+    }
+
+    // As align(), into a result whose ops buffer is reused.
+    void alignInto(AlignmentResult& result, string_view original, string_view typed, bool prefixOnly = false,
+                   bool wantOps = false) {
+        alignSegmented(result, original, typed, prefixOnly, wantOps, segment(original, typed));
+    }
+};
+
+enum class TimingCheck {
+    Ok,
+    TooShort,
+    Unrealistic
+};
+
+// WPM rules shared by interactive tests and headless re-scoring.
+double wpmFor(int correctChars, double timeInSeconds, TimingCheck& check) {
+    // Time is measured from the first keystroke, so a sub-0.5s test is a real
+    // anomaly (e.g. pasted input), not reaction delay or clock jitter.
+    if (timeInSeconds < 0.5) {
+        check = TimingCheck::TooShort;
+        return 0;
+    }
+    
+    double minutes = timeInSeconds / 60.0;
+    double words = correctChars / 5.0;
+    double wpm = words / minutes;
+    
+    // Cap at 300 WPM (world record territory)
+    if (wpm > 300) {
+        check = TimingCheck::Unrealistic;
+        return 0;
+    }
+    
+    check = TimingCheck::Ok;
+    return wpm;
+}
+
+// Rebuilds the typed text from a recording and scores it with the current
+// rules. The time is the one measured at the test, so only a scoring change
+// can make the result differ from the recorded one.
+bool rescoreRecording(const SessionRecording& rec, AlignmentScorer& scorer, string& typed, TypingStats& stats) {
+    ReplayCursor cursor(rec);
+    cursor.seek(rec.keyCount);
+    if (cursor.isCorrupt() || !cursor.atEnd()) return false;
+    typed = cursor.text();
+
+    AlignmentResult score = scorer.score(rec.passage, typed, rec.prefixOnly);
+    TimingCheck check;
+    stats.name = rec.name;
+    stats.difficulty = rec.difficulty;
+    stats.date = formatDate(rec.date);
+    stats.time = rec.time;
+    stats.correctChars = score.matches;
+    stats.totalChars = score.typedLength();
+    stats.errors = score.distance();
+    stats.accuracy = score.accuracy();
+    stats.wpm = wpmFor(score.matches, rec.time, check);
+    return true;
+}
+
+bool matchesRecording(const SessionRecording& rec, const TypingStats& stats) {
+    return rec.correctChars == stats.correctChars && rec.totalChars == stats.totalChars &&
+           rec.errors == stats.errors && fabs(rec.wpm - stats.wpm) < 1e-9 &&
+           fabs(rec.accuracy - stats.accuracy) < 1e-9;
+}
+
+// Readiness notification for many sockets behind one small interface: epoll
+// on Linux, where the daemon's thousands of idle clients cost nothing per
+// wakeup, and poll() elsewhere (macOS).
+class EventPoller {
+private:
+#ifdef __linux__
+    int epollFd;
+    vector<epoll_event> ready;
+#else
+    vector<pollfd> fds;
+    unordered_map<int, size_t> slots;
+#endif
+
+public:
+#ifdef __linux__
+    EventPoller() : epollFd(epoll_create1(EPOLL_CLOEXEC)), ready(256) {}
+
+    ~EventPoller() {
+        if (epollFd >= 0) close(epollFd);
+    }
+
+    bool watch(int fd, bool wantWrite, int operation = EPOLL_CTL_ADD) {
+        epoll_event event = {};
+        event.events = EPOLLIN | (wantWrite ? uint32_t(EPOLLOUT) : 0u);
+        event.data.fd = fd;
+        return epoll_ctl(epollFd, operation, fd, &event) == 0;
+    }
+
+    bool modify(int fd, bool wantWrite) {
+        return watch(fd, wantWrite, EPOLL_CTL_MOD);
+    }
+
+    void remove(int fd) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    // Waits up to timeoutMs and calls fn(fd, readable, writable) for every
+    // ready descriptor. Returns the number handled, or -1 on error.
+    template <typename Fn>
+    int wait(int timeoutMs, Fn fn) {
+        int n = epoll_wait(epollFd, ready.data(), ready.size(), timeoutMs);
+        if (n < 0) return errno == EINTR ? 0 : -1;
+        for (int i = 0; i < n; i++) {
+            uint32_t events = ready[i].events;
+            fn(ready[i].data.fd, (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0, (events & EPOLLOUT) != 0);
+        }
+        if (n == (int)ready.size()) ready.resize(ready.size() * 2);
+        return n;
+    }
+#else
+    bool watch(int fd, bool wantWrite) {
+        slots[fd] = fds.size();
+        fds.push_back({fd, short(POLLIN | (wantWrite ? POLLOUT : 0)), 0});
+        return true;
+    }
+
+    bool modify(int fd, bool wantWrite) {
+        auto it = slots.find(fd);
+        if (it == slots.end()) return false;
+        fds[it->second].events = POLLIN | (wantWrite ? POLLOUT : 0);
+        return true;
+    }
+
+    void remove(int fd) {
+        auto it = slots.find(fd);
+        if (it == slots.end()) return;
+        fds[it->second] = fds.back();
+        slots[fds[it->second].fd] = it->second;
+        fds.pop_back();
+        slots.erase(fd);
+    }
+
+    template <typename Fn>
+    int wait(int timeoutMs, Fn fn) {
+        int n = poll(fds.data(), fds.size(), timeoutMs);
+        if (n < 0) return errno == EINTR ? 0 : -1;
+        vector<pollfd> fired;
+        for (const auto& p : fds) {
+            if (p.revents) fired.push_back(p);
+        }
+        for (const auto& p : fired) {
+            fn(p.fd, (p.revents & (POLLIN | POLLHUP | POLLERR)) != 0, (p.revents & POLLOUT) != 0);
+        }
+        return (int)fired.size();
+    }
+#endif
+
+    EventPoller(const EventPoller&) = delete;
+    EventPoller& operator=(const EventPoller&) = delete;
+};
+
+// Wire protocol of the leaderboard daemon. Every message is a FrameHeader
+// followed by length payload bytes; integers and doubles are native
+// little-endian like the data files. Replies echo the request id, so a
+// client may pipeline requests on one connection.
+enum class MessageType : uint8_t {
+    Submit = 1,      // SubmitBody, the name, difficulty and date bytes, then SubmitKeys
+    SubmitReply = 2, // SubmitReplyBody
+    Query = 3,       // the user whose personal board should be included
+    QueryReply = 4,  // a leaderboard.dat image: every difficulty board plus that user's
+    Error = 5,       // empty; the request was malformed
+    Join = 6,        // race: the racer's name
+    RaceStart = 7,   // RaceStartHeader, names and passage
+    Progress = 8,    // RaceProgress
+    RaceUpdate = 9,  // the RaceEntry records that changed this tick
+    Finish = 10,     // RaceFinish
+    RaceOver = 11    // empty; the final RaceUpdate came just before
+};
+
+struct FrameHeader {
+    uint32_t length;
+    uint32_t requestId;
+    uint8_t type;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(FrameHeader) == 12, "FrameHeader layout must stay fixed");
+
+struct SubmitBody {
+    double wpm;
+    double accuracy;
+    double time;
+    int32_t correctChars;
+    int32_t totalChars;
+    int32_t errors;
+    uint8_t nameLength;
+    uint8_t difficultyLength;
+    uint8_t dateLength;
+    uint8_t reserved;
+};
+static_assert(sizeof(SubmitBody) == 40, "SubmitBody layout must stay fixed");
+
+// One keystroke of a submitted test, so the daemon can check its timing too.
+struct SubmitKey {
+    int64_t nanos;
+    uint32_t codepoint;
+    uint8_t kind;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(SubmitKey) == 16, "SubmitKey layout must stay fixed");
+
+struct SubmitReplyBody {
+    uint32_t difficultyRank; // 1-based; 0 if the result did not place
+    uint32_t userRank;
+};
+
+constexpr uint32_t maxFrameLength = 1 << 24;
+
+void appendFrame(string& out, MessageType type, uint32_t requestId, string_view payload) {
+    FrameHeader h = {};
+    h.length = payload.size();
+    h.requestId = requestId;
+    h.type = (uint8_t)type;
+    out.append(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.append(payload.data(), payload.size());
+}
+
+string encodeSubmit(const TypingStats& stats, const KeystrokeRing& keys) {
+    SubmitBody body = {};
+    body.wpm = stats.wpm;
+    body.accuracy = stats.accuracy;
+    body.time = stats.time;
+    body.correctChars = stats.correctChars;
+    body.totalChars = stats.totalChars;
+    body.errors = stats.errors;
+    body.nameLength = min<size_t>(stats.name.size(), 255);
+    body.difficultyLength = min<size_t>(stats.difficulty.size(), 255);
+    body.dateLength = min<size_t>(stats.date.size(), 255);
+
+    string payload(reinterpret_cast<const char*>(&body), sizeof(body));
+    payload.append(stats.name, 0, body.nameLength);
+    payload.append(stats.difficulty, 0, body.difficultyLength);
+    payload.append(stats.date, 0, body.dateLength);
+    for (size_t i = 0; i < keys.size(); i++) {
+        SubmitKey key = {keys[i].nanos, keys[i].codepoint, (uint8_t)keys[i].kind, {}};
+        payload.append(reinterpret_cast<const char*>(&key), sizeof(key));
+    }
+    return payload;
+}
+
+bool decodeSubmit(string_view payload, TypingStats& stats, vector<Keystroke>& keys) {
+    SubmitBody body;
+    if (payload.size() < sizeof(body)) return false;
+    memcpy(&body, payload.data(), sizeof(body));
+    size_t strings = sizeof(body) + body.nameLength + body.difficultyLength + body.dateLength;
+    if (payload.size() < strings || (payload.size() - strings) % sizeof(SubmitKey) != 0) return false;
+
+    keys.clear();
+    for (size_t at = strings; at < payload.size(); at += sizeof(SubmitKey)) {
+        SubmitKey key;
+        memcpy(&key, payload.data() + at, sizeof(key));
+        if (key.kind > (uint8_t)KeyKind::Enter) return false;
+        keys.push_back({key.nanos, key.codepoint, (KeyKind)key.kind});
+    }
+
+    payload = payload.substr(sizeof(body), strings - sizeof(body));
+    stats.name = string(payload.substr(0, body.nameLength));
+    stats.difficulty = string(payload.substr(body.nameLength, body.difficultyLength));
+    stats.date = string(payload.substr(body.nameLength + body.difficultyLength));
+    stats.wpm = body.wpm;
+    stats.accuracy = body.accuracy;
+    stats.time = body.time;
+    stats.correctChars = body.correctChars;
+    stats.totalChars = body.totalChars;
+    stats.errors = body.errors;
+    return !stats.name.empty() && !stats.difficulty.empty();
+}
+
+// Binds a non-blocking listening Unix domain socket, replacing a stale socket
+// file left by a daemon that died. Returns -1 if another daemon answers there.
+int listenUnix(const string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) return -1;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0) {
+        bool live = connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        close(probe);
+        if (live) return -1;
+    }
+    unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int connectUnix(const string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) return -1;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    while (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        if (errno == EINTR) continue;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Thousands of clients need as many descriptors; raise the soft limit.
+void raiseDescriptorLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Daemon that owns the shared leaderboard and appends submitted results to
+// the history log. A single thread serves every client from one event loop;
+// replies are buffered per connection and written as the socket allows.
+// Accepted results are merged into leaderboard.dat every few seconds and on
+// shutdown, the same way an interactive session saves on exit. A submit
+// carries its keystrokes, and the daemon runs the timing checks itself, so a
+// client that skips them still can't rank a result.
+class LeaderboardServer {
+private:
+    struct Connection {
+        string in;
+        string out;
+        size_t sent = 0;
+        bool wantWrite = false;
+        bool replyQueued = false;
+    };
+
+    static constexpr int flushMillis = 2000;
+
+    string socketPath;
+    string boardPath;
+    int listenFd = -1;
+    EventPoller poller;
+    unordered_map<int, Connection> connections;
+    Leaderboard board;
+    vector<HistoryRecord> unsaved;
+    SessionLog log{"typing_history.log"};
+    vector<TypingStats> uncommitted;
+    vector<int> replying;
+    vector<Keystroke> keys;
+    TimingValidator validator;
+    uint64_t submits = 0, flagged = 0, queries = 0;
+
+    void acceptClients() {
+        while (true) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) return;
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            if (!poller.watch(fd, false)) {
+                close(fd);
+                continue;
+            }
+            connections[fd];
+        }
+    }
+
+    void dropClient(int fd) {
+        poller.remove(fd);
+        close(fd);
+        connections.erase(fd);
+    }
+
+    // The checks a session runs before ranking, plus a check that the
+    // keystrokes could have produced the result: a key for every correct
+    // character, and no more time between the first and last than claimed.
+    bool keysSupport(const TypingStats& stats) {
+        if (validator.check(keys).suspicious()) return false;
+        int64_t characters = 0;
+        for (const Keystroke& key : keys) characters += key.kind == KeyKind::Character;
+        if (characters < stats.correctChars) return false;
+        return keys.empty() || (keys.back().nanos - keys.front().nanos) / 1e9 <= stats.time + 0.001;
+    }
+
+    void handleSubmit(const FrameHeader& h, string_view payload, string& out) {
+        TypingStats stats;
+        if (!decodeSubmit(payload, stats, keys)) {
+            appendFrame(out, MessageType::Error, h.requestId, {});
+            return;
+        }
+
+        stats.flagged = !keysSupport(stats);
+        flagged += stats.flagged;
+        uncommitted.push_back(stats);
+        SubmitReplyBody reply = {0, 0};
+        if (stats.wpm > 0 && !stats.flagged) {
+            uint32_t name = board.nameId(stats.name);
+            uint16_t difficulty = board.difficultyId(stats.difficulty);
+            LeaderEntry entry = {stats.wpm, stats.accuracy, parseDate(stats.date), name, difficulty, 0};
+            if (board.add(name, difficulty, entry.wpm, entry.accuracy, entry.date)) {
+                reply.difficultyRank = board.difficultyBoard(difficulty)->rankOf(entry);
+                entry.board = 1;
+                reply.userRank = board.userBoard(stats.name)->rankOf(entry);
+            }
+            unsaved.push_back(SessionLog::pack(stats));
+        }
+        submits++;
+        appendFrame(out, MessageType::SubmitReply, h.requestId,
+                    string_view(reinterpret_cast<const char*>(&reply), sizeof(reply)));
+    }
+
+    void handleQuery(const FrameHeader& h, string_view payload, string& out) {
+        string image;
+        board.viewFor(payload).serialize(image);
+        queries++;
+        appendFrame(out, MessageType::QueryReply, h.requestId, image);
+    }
+
+    // Reads what the socket holds and answers every complete frame. Replies
+    // wait for commit(). A client that hung up after its last request still
+    // gets the replies we can send.
+    bool readClient(int fd, Connection& c) {
+        char buffer[16384];
+        bool hungUp = false;
+        while (true) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                c.in.append(buffer, n);
+                // Level-triggered: a short read drained the socket, and
+                // anything arriving later wakes the loop again.
+                if (n < (ssize_t)sizeof(buffer)) break;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            hungUp = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            break;
+        }
+
+        size_t position = 0;
+        while (c.in.size() - position >= sizeof(FrameHeader)) {
+            FrameHeader h;
+            memcpy(&h, c.in.data() + position, sizeof(h));
+            if (h.length > maxFrameLength) return false;
+            if (c.in.size() - position - sizeof(h) < h.length) break;
+
+            string_view payload(c.in.data() + position + sizeof(h), h.length);
+            if (h.type == (uint8_t)MessageType::Submit) handleSubmit(h, payload, c.out);
+            else if (h.type == (uint8_t)MessageType::Query) handleQuery(h, payload, c.out);
+            else appendFrame(c.out, MessageType::Error, h.requestId, {});
+            position += sizeof(h) + h.length;
+        }
+        c.in.erase(0, position);
+        if (c.out.size() > c.sent && !c.replyQueued) {
+            c.replyQueued = true;
+            replying.push_back(fd);
+        }
+        return !hungUp;
+    }
+
+    // Group commit: everything submitted during one pass of the event loop is
+    // appended with a single write, and only then are the replies sent, so an
+    // acknowledged result is always in the log.
+    void commit() {
+        log.append(uncommitted.data(), uncommitted.size());
+        uncommitted.clear();
+        for (int fd : replying) {
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            it->second.replyQueued = false;
+            if (!writeClient(fd, it->second)) dropClient(fd);
+        }
+        replying.clear();
+    }
+
+    bool writeClient(int fd, Connection& c) {
+        while (c.sent < c.out.size()) {
+            ssize_t n = write(fd, c.out.data() + c.sent, c.out.size() - c.sent);
+            if (n > 0) {
+                c.sent += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            return false;
+        }
+
+        bool pending = c.sent < c.out.size();
+        if (!pending) {
+            c.out.clear();
+            c.sent = 0;
+        }
+        if (pending != c.wantWrite) {
+            c.wantWrite = pending;
+            poller.modify(fd, pending);
+        }
+        return true;
+    }
+
+public:
+    LeaderboardServer(const string& socketPath, size_t capacity)
+        : socketPath(socketPath), boardPath("leaderboard.dat"), board(capacity) {}
+
+    ~LeaderboardServer() {
+        for (auto& connection : connections) close(connection.first);
+        if (listenFd >= 0) {
+            close(listenFd);
+            unlink(socketPath.c_str());
+        }
+    }
+
+    void setFsyncEvery(int n) {
+        log.setFsyncEvery(n);
+    }
+
+    bool start() {
+        board.load(boardPath);
+        startLogGeneration(log, "typing_history.col");
+        listenFd = listenUnix(socketPath);
+        return listenFd >= 0 && poller.watch(listenFd, false);
+    }
+
+    // Merges accepted results into leaderboard.dat and picks up entries other
+    // writers saved in the meantime.
+    bool flush() {
+        log.sync();
+        if (unsaved.empty()) return true;
+        Leaderboard merged(board.getCapacity());
+        if (!mergeLeaderboard(boardPath, board.getCapacity(), unsaved, &merged)) return false;
+        board = move(merged);
+        unsaved.clear();
+        return true;
+    }
+
+    // Serves until stop is set (by a signal handler).
+    void run(const volatile sig_atomic_t& stop) {
+        auto lastFlush = chrono::steady_clock::now();
+        while (!stop) {
+            int n = poller.wait(flushMillis / 4, [&](int fd, bool readable, bool writable) {
+                if (fd == listenFd) {
+                    acceptClients();
+                    return;
+                }
+                auto it = connections.find(fd);
+                if (it == connections.end()) return;
+                bool open = (!writable || writeClient(fd, it->second)) &&
+                            (!readable || readClient(fd, it->second));
+                if (!open) dropClient(fd);
+            });
+            if (n < 0) break;
+            commit();
+
+            auto now = chrono::steady_clock::now();
+            if (now - lastFlush >= chrono::milliseconds(flushMillis)) {
+                flush();
+                lastFlush = now;
+            }
+        }
+        flush();
+    }
+
+    size_t clientCount() const { return connections.size(); }
+    uint64_t submitCount() const { return submits; }
+    uint64_t flaggedCount() const { return flagged; }
+    uint64_t queryCount() const { return queries; }
+};
+
+// Blocking client for the leaderboard daemon, one request at a time.
+class LeaderboardClient {
+private:
+    static constexpr int replyTimeoutSeconds = 5;
+
+    int fd = -1;
+    uint32_t nextRequest = 1;
+
+    bool request(MessageType type, string_view payload, MessageType expected, string& reply) {
+        if (fd < 0) return false;
+        string frame;
+        uint32_t id = nextRequest++;
+        appendFrame(frame, type, id, payload);
+        for (size_t sent = 0; sent < frame.size();) {
+            ssize_t n = write(fd, frame.data() + sent, frame.size() - sent);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return fail();
+            sent += n;
+        }
+
+        FrameHeader h;
+        if (!readExact(&h, sizeof(h)) || h.length > maxFrameLength) return fail();
+        reply.resize(h.length);
+        if (!readExact(&reply[0], h.length)) return fail();
+        return h.requestId == id && h.type == (uint8_t)expected;
+    }
+
+    bool readExact(void* data, size_t size) {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0) {
+            ssize_t n = read(fd, bytes, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool fail() {
+        disconnect();
+        return false;
+    }
+
+public:
+    ~LeaderboardClient() {
+        disconnect();
+    }
+
+    // A daemon that stops answering is dropped after replyTimeoutSeconds, and
+    // the caller falls back to local storage.
+    bool connectTo(const string& socketPath) {
+        disconnect();
+        fd = connectUnix(socketPath);
+        if (fd < 0) return false;
+        struct timeval timeout = {replyTimeoutSeconds, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        return true;
+    }
+
+    void disconnect() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+
+    bool isConnected() const { return fd >= 0; }
+
+    bool submit(const TypingStats& stats, const KeystrokeRing& keys, SubmitReplyBody& reply) {
+        string payload;
+        if (!request(MessageType::Submit, encodeSubmit(stats, keys), MessageType::SubmitReply, payload) ||
+            payload.size() != sizeof(reply)) {
+            return false;
+        }
+        memcpy(&reply, payload.data(), sizeof(reply));
+        return true;
+    }
+
+    bool query(const string& user, Leaderboard& boards) {
+        string payload;
+        return request(MessageType::Query, user, MessageType::QueryReply, payload) &&
+               boards.deserialize(payload);
+    }
+};
+
+// Race frames share FrameHeader with the leaderboard protocol.
+struct RaceStartHeader {
+    uint32_t countdownMillis;
+    uint16_t racerCount;
+    uint16_t racerId; // the receiving racer
+    uint32_t passageLength;
+}; // followed by racerCount names (uint8 length + bytes), then the passage
+
+struct RaceProgress {
+    uint32_t typedChars;
+    uint32_t correctChars;
+    float wpm;
+    uint32_t seq;
+};
+
+struct RaceFinish {
+    uint32_t typedChars;
+    uint32_t correctChars;
+    float wpm;
+    float accuracy;
+};
+
+// Runs races for whoever connects: once racersWanted racers have joined,
+// everyone gets the same passage and a countdown. Progress messages only
+// overwrite the sender's entry; the hub sends one coalesced RaceUpdate with
+// the changed entries per tick, as a single buffer written to every racer.
+// The first change after a quiet tick goes out at once, so an update waits at
+// most one tick (1/120 s), half a 60 Hz frame.
+class RaceHub {
+private:
+    struct Racer {
+        int fd = -1;
+        string name;
+        string in;
+        string out;
+        size_t sent = 0;
+        bool wantWrite = false;
+        bool joined = false;
+        bool changed = false;
+        RaceEntry state = {};
+    };
+
+    static constexpr int64_t tickNanos = 1000000000 / 120;
+    static constexpr uint32_t countdownMillis = 3000;
+
+    string socketPath;
+    int listenFd = -1;
+    EventPoller poller;
+    unordered_map<int, Racer> racers;
+    size_t racersWanted;
+    int difficulty;
+    TextCorpus corpus;
+    bool racing = false;
+    int16_t finishers = 0;
+    vector<int> order; // racer ids in join order; id = index
+    chrono::steady_clock::time_point lastBroadcast;
+    string broadcastFrame;
+    uint64_t races = 0, broadcasts = 0, progressMessages = 0;
+
+    bool flushRacer(int fd, Racer& r) {
+        while (r.sent < r.out.size()) {
+            ssize_t n = write(fd, r.out.data() + r.sent, r.out.size() - r.sent);
+            if (n > 0) {
+                r.sent += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            return false;
+        }
+        bool pending = r.sent < r.out.size();
+        if (!pending) {
+            r.out.clear();
+            r.sent = 0;
+        }
+        if (pending != r.wantWrite) {
+            r.wantWrite = pending;
+            poller.modify(fd, pending);
+        }
+        return true;
+    }
+
+    void dropRacer(int fd) {
+        auto it = racers.find(fd);
+        if (it == racers.end()) return;
+        if (racing && it->second.joined && it->second.state.place == 0) {
+            // The entry stays so the others see the racer leave.
+            it->second.state.place = -1;
+            it->second.changed = true;
+        }
+        poller.remove(fd);
+        close(fd);
+        it->second.fd = -1;
+        if (!racing || !it->second.joined) racers.erase(it);
+    }
+
+    size_t joinedCount() const {
+        size_t count = 0;
+        for (const auto& r : racers) count += r.second.joined;
+        return count;
+    }
+
+    void startRace() {
+        string normalized;
+        string passage(corpus.select(difficulty, normalized));
+        order.clear();
+        for (auto& r : racers) {
+            if (!r.second.joined) continue;
+            r.second.state = {};
+            r.second.state.racerId = order.size();
+            order.push_back(r.first);
+        }
+
+        string names;
+        for (int fd : order) {
+            const string& name = racers[fd].name;
+            names += (char)min<size_t>(name.size(), 255);
+            names.append(name, 0, min<size_t>(name.size(), 255));
+        }
+        for (int fd : order) {
+            Racer& r = racers[fd];
+            RaceStartHeader h = {countdownMillis, (uint16_t)order.size(), r.state.racerId, (uint32_t)passage.size()};
+            string payload(reinterpret_cast<const char*>(&h), sizeof(h));
+            payload += names;
+            payload += passage;
+            appendFrame(r.out, MessageType::RaceStart, 0, payload);
+            flushRacer(fd, r);
+        }
+        racing = true;
+        finishers = 0;
+        races++;
+        cout << "🏁 Race " << races << ": " << order.size() << " racers, " << passage.size() << " characters\n";
+    }
+
+    void endRace() {
+        broadcast();
+        for (int fd : order) {
+            auto it = racers.find(fd);
+            if (it == racers.end() || it->second.fd < 0) continue;
+            appendFrame(it->second.out, MessageType::RaceOver, 0, {});
+            flushRacer(fd, it->second);
+        }
+        // Finished racers' sockets are closed once their last frames drain;
+        // a fresh lobby starts right away.
+        for (int fd : order) {
+            auto it = racers.find(fd);
+            if (it == racers.end()) continue;
+            if (it->second.fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+                if (it->second.sent < it->second.out.size()) {
+                    ssize_t ignored = write(fd, it->second.out.data() + it->second.sent,
+                                            it->second.out.size() - it->second.sent);
+                    (void)ignored;
+                }
+                poller.remove(fd);
+                close(fd);
+            }
+            racers.erase(it);
+        }
+        order.clear();
+        racing = false;
+    }
+
+    bool raceDone() const {
+        for (int fd : order) {
+            auto it = racers.find(fd);
+            if (it != racers.end() && it->second.state.place == 0) return false;
+        }
+        return true;
+    }
+
+    void handleFrame(int fd, Racer& r, const FrameHeader& h, string_view payload) {
+        MessageType type = (MessageType)h.type;
+        if (type == MessageType::Join && !racing && !r.joined) {
+            r.name = string(payload.substr(0, 32));
+            r.joined = true;
+        } else if (type == MessageType::Progress && racing && payload.size() == sizeof(RaceProgress)) {
+            RaceProgress p;
+            memcpy(&p, payload.data(), sizeof(p));
+            if (r.state.place == 0) {
+                r.state.typedChars = p.typedChars;
+                r.state.correctChars = p.correctChars;
+                r.state.wpm = p.wpm;
+            }
+            r.state.seq = p.seq;
+            r.changed = true;
+            progressMessages++;
+        } else if (type == MessageType::Finish && racing && payload.size() == sizeof(RaceFinish)) {
+            RaceFinish f;
+            memcpy(&f, payload.data(), sizeof(f));
+            if (r.state.place == 0) {
+                r.state.place = ++finishers;
+                r.state.typedChars = f.typedChars;
+                r.state.correctChars = f.correctChars;
+                r.state.wpm = f.wpm;
+                r.state.accuracy = f.accuracy;
+                r.changed = true;
+            }
+        } else {
+            appendFrame(r.out, MessageType::Error, h.requestId, {});
+        }
+        (void)fd;
+    }
+
+    bool readRacer(int fd, Racer& r) {
+        char buffer[4096];
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return false;
+        if (n > 0) r.in.append(buffer, n);
+
+        size_t position = 0;
+        while (r.in.size() - position >= sizeof(FrameHeader)) {
+            FrameHeader h;
+            memcpy(&h, r.in.data() + position, sizeof(h));
+            if (h.length > 65536) return false;
+            if (r.in.size() - position - sizeof(h) < h.length) break;
+            handleFrame(fd, r, h, string_view(r.in.data() + position + sizeof(h), h.length));
+            position += sizeof(h) + h.length;
+        }
+        r.in.erase(0, position);
+        return r.out.empty() || flushRacer(fd, r);
+    }
+
+    // One frame holding every entry that changed since the last tick, written
+    // to all racers.
+    void broadcast() {
+        string entries;
+        for (int fd : order) {
+            Racer& r = racers[fd];
+            if (!r.changed) continue;
+            entries.append(reinterpret_cast<const char*>(&r.state), sizeof(r.state));
+            r.changed = false;
+        }
+        lastBroadcast = chrono::steady_clock::now();
+        if (entries.empty()) return;
+
+        broadcastFrame.clear();
+        appendFrame(broadcastFrame, MessageType::RaceUpdate, 0, entries);
+        vector<int> failed;
+        for (int fd : order) {
+            Racer& r = racers[fd];
+            if (r.fd < 0) continue;
+            r.out += broadcastFrame;
+            if (!flushRacer(fd, r)) failed.push_back(fd);
+        }
+        for (int fd : failed) dropRacer(fd);
+        broadcasts++;
+    }
+
+    bool anyChanged() const {
+        for (int fd : order) {
+            auto it = racers.find(fd);
+            if (it != racers.end() && it->second.changed) return true;
+        }
+        return false;
+    }
+
+public:
+    RaceHub(const string& socketPath, size_t racersWanted, int difficulty, const string& corpusPath)
+        : socketPath(socketPath), racersWanted(max<size_t>(1, racersWanted)), difficulty(difficulty) {
+        if (!corpus.openCorpus(corpusPath)) corpus.openBuiltin();
+    }
+
+    ~RaceHub() {
+        for (auto& r : racers) {
+            if (r.second.fd >= 0) close(r.second.fd);
+        }
+        if (listenFd >= 0) {
+            close(listenFd);
+            unlink(socketPath.c_str());
+        }
+    }
+
+    bool start() {
+        listenFd = listenUnix(socketPath);
+        return listenFd >= 0 && poller.watch(listenFd, false);
+    }
+
+    void run(const volatile sig_atomic_t& stop) {
+        lastBroadcast = chrono::steady_clock::now();
+        while (!stop) {
+            int timeoutMs = -1;
+            if (racing && anyChanged()) {
+                auto due = lastBroadcast + chrono::nanoseconds(tickNanos);
+                auto wait = chrono::duration_cast<chrono::milliseconds>(due - chrono::steady_clock::now()).count();
+                timeoutMs = max<int>(0, wait + 1);
+            }
+            int n = poller.wait(timeoutMs, [&](int fd, bool readable, bool writable) {
+                if (fd == listenFd) {
+                    while (true) {
+                        int client = accept(listenFd, nullptr, nullptr);
+                        if (client < 0) break;
+                        if (racing) {
+                            close(client); // mid-race joiners wait for the next lobby
+                            continue;
+                        }
+                        fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                        if (!poller.watch(client, false)) {
+                            close(client);
+                            continue;
+                        }
+                        racers[client].fd = client;
+                    }
+                    return;
+                }
+                auto it = racers.find(fd);
+                if (it == racers.end() || it->second.fd < 0) return;
+                bool open = (!writable || flushRacer(fd, it->second)) && (!readable || readRacer(fd, it->second));
+                if (!open) dropRacer(fd);
+            });
+            if (n < 0) break;
+
+            if (!racing) {
+                if (joinedCount() >= racersWanted) startRace();
+                continue;
+            }
+            if (chrono::steady_clock::now() - lastBroadcast >= chrono::nanoseconds(tickNanos) && anyChanged()) {
+                broadcast();
+            }
+            if (raceDone()) endRace();
+        }
+    }
+
+    uint64_t raceCount() const { return races; }
+    uint64_t broadcastCount() const { return broadcasts; }
+    uint64_t progressCount() const { return progressMessages; }
+};
+
+// A racer's side of the hub connection. During the capture it reports every
+// keystroke as progress and folds the hub's updates into the lane table the
+// renderer draws.
+class RaceClient : public CaptureListener {
+private:
+    int fd = -1;
+    string in;
+    string passage;
+    GraphemeIndex passageText, typedText;
+    vector<RaceLane> lanes;
+    uint16_t self = 0;
+    uint32_t seq = 0;
+    uint32_t countdown = 0;
+    int64_t firstKeyNanos = -1;
+    LiveRenderer* renderer = nullptr;
+    bool over = false;
+
+    bool sendFrame(MessageType type, string_view payload) {
+        string frame;
+        appendFrame(frame, type, 0, payload);
+        for (size_t sent = 0; sent < frame.size();) {
+            ssize_t n = write(fd, frame.data() + sent, frame.size() - sent);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    // Handles every complete frame in the buffer; false on a protocol error.
+    bool handleFrames() {
+        size_t position = 0;
+        while (in.size() - position >= sizeof(FrameHeader)) {
+            FrameHeader h;
+            memcpy(&h, in.data() + position, sizeof(h));
+            if (h.length > maxFrameLength) return false;
+            if (in.size() - position - sizeof(h) < h.length) break;
+            string_view payload(in.data() + position + sizeof(h), h.length);
+            position += sizeof(h) + h.length;
+
+            if (h.type == (uint8_t)MessageType::RaceStart && payload.size() >= sizeof(RaceStartHeader)) {
+                RaceStartHeader start;
+                memcpy(&start, payload.data(), sizeof(start));
+                payload.remove_prefix(sizeof(start));
+                lanes.assign(start.racerCount, RaceLane{});
+                for (uint16_t i = 0; i < start.racerCount && !payload.empty(); i++) {
+                    size_t length = (unsigned char)payload[0];
+                    lanes[i].name = string(payload.substr(1, length));
+                    lanes[i].state.racerId = i;
+                    payload.remove_prefix(min(payload.size(), length + 1));
+                }
+                passage = string(payload.substr(0, start.passageLength));
+                passageText.assign(passage);
+                self = start.racerId;
+                countdown = start.countdownMillis;
+            } else if (h.type == (uint8_t)MessageType::RaceUpdate) {
+                for (size_t i = 0; i + sizeof(RaceEntry) <= payload.size(); i += sizeof(RaceEntry)) {
+                    RaceEntry e;
+                    memcpy(&e, payload.data() + i, sizeof(e));
+                    if (e.racerId < lanes.size()) lanes[e.racerId].state = e;
+                }
+                if (renderer) renderer->markDirty();
+            } else if (h.type == (uint8_t)MessageType::RaceOver) {
+                over = true;
+            }
+        }
+        in.erase(0, position);
+        return true;
+    }
+
+    // Blocks until pred holds or the hub goes away.
+    template <typename Pred>
+    bool readUntil(Pred pred) {
+        char buffer[4096];
+        while (!pred()) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            in.append(buffer, n);
+            if (!handleFrames()) return false;
+        }
+        return true;
+    }
+
+public:
+    ~RaceClient() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool join(const string& socketPath, const string& name) {
+        fd = connectUnix(socketPath);
+        return fd >= 0 && sendFrame(MessageType::Join, name);
+    }
+
+    // Waits in the lobby until the hub starts the race.
+    bool waitForStart() {
+        return readUntil([this] { return !passage.empty(); });
+    }
+
+    bool waitForResults() {
+        return readUntil([this] { return over; });
+    }
+
+    const string& getPassage() const { return passage; }
+    uint32_t countdownMillis() const { return countdown; }
+    uint16_t racerId() const { return self; }
+    const vector<RaceLane>& getLanes() const { return lanes; }
+
+    void attach(LiveRenderer* live) {
+        renderer = live;
+        if (live) live->setLanes(&lanes, self);
+    }
+
+    bool finish(const TypingStats& stats) {
+        RaceFinish f = {(uint32_t)stats.totalChars, (uint32_t)stats.correctChars, (float)stats.wpm,
+                        (float)stats.accuracy};
+        renderer = nullptr;
+        return sendFrame(MessageType::Finish, string_view(reinterpret_cast<const char*>(&f), sizeof(f)));
+    }
+
+    int descriptor() const override { return fd; }
+
+    void onKeystroke(const string& typed, int64_t nanos) override {
+        if (firstKeyNanos < 0) firstKeyNanos = nanos;
+        typedText.sync(typed);
+        uint32_t correct = countEqualClusters(passageText, typedText);
+        double minutes = (nanos - firstKeyNanos) / 6e10;
+        RaceProgress p = {(uint32_t)typedText.size(), correct, minutes > 0 ? float(correct / 5.0 / minutes) : 0.0f, ++seq};
+        sendFrame(MessageType::Progress, string_view(reinterpret_cast<const char*>(&p), sizeof(p)));
+    }
+
+    // A closed or broken hub connection is dropped, so the capture stops
+    // polling it and the typist can finish the test on their own.
+    void onReadable(int64_t) override {
+        char buffer[16384];
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+        if (n > 0) {
+            in.append(buffer, n);
+            if (handleFrames()) return;
+        }
+        close(fd);
+        fd = -1;
+        if (renderer) renderer->markHubLost();
+    }
+};
+
+// Bounded lock-free ring for one producer thread and one consumer thread.
+// Only the producer advances tail and only the consumer advances head; each
+// index sits on its own cache line so the two sides don't share one.
+template <typename T, size_t Capacity>
+class SpscQueue {
+private:
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    T slots[Capacity];
+    alignas(64) atomic<size_t> head{0};
+    alignas(64) atomic<size_t> tail{0};
+
+public:
+    // False if the ring is full.
+    bool push(const T& value) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == Capacity) return false;
+        slots[t & (Capacity - 1)] = value;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    // Moves up to limit values into out and returns how many.
+    size_t popBatch(T* out, size_t limit) {
+        size_t h = head.load(memory_order_relaxed);
+        size_t n = min(tail.load(memory_order_acquire) - h, limit);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = slots[(h + i) & (Capacity - 1)];
+        }
+        head.store(h + n, memory_order_release);
+        return n;
+    }
+
+    bool empty() const {
+        return head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+    }
+};
+
+// A finished test on its way to disk. Ranked results are also merged into
+// leaderboard.dat.
+struct PendingResult {
+    HistoryRecord record;
+    bool ranked;
+};
+
+// Takes persistence off the test loop. Finished results go through an SPSC
+// ring to this thread, which appends them to the history log, merges the
+// ranked ones into leaderboard.dat and then refreshes the saved statistics.
+// It starts on first use, so a session that never finishes a test or opens
+// its history never touches those files. The checker waits for it to go
+// idle before loading anything it writes.
+class HistoryWriter {
+private:
+    static constexpr size_t batchLimit = 64;
+
+    SessionLog log{"typing_history.log"};
+    SpscQueue<PendingResult, 256> queue;
+    thread worker;
+    mutex stateLock;
+    condition_variable wake;     // results arrived, or stop() was called
+    condition_variable drained;  // the writer went idle
+    bool busy = false;
+    atomic<bool> stopping{false};
+    atomic<bool> sleeping{false};  // the writer is in, or about to enter, wake.wait
+    size_t leaderboardSize = 10;
+    long imported = 0;
+    long migrated = 0;
+
+    // One-time migrations from the legacy text files, before anything is
+    // appended or merged, and a check that appends land in a generation
+    // newer than the snapshot.
+    void prepare() {
+        if (log.lock(true)) {
+            HistorySnapshot snapshot;
+            snapshot.openSnapshot("typing_history.col");
+            if (log.wasCreated() && snapshot.size() == 0) {
+                ifstream legacy("typing_history.txt");
+                if (legacy.is_open()) {
+                    legacy.close();
+                    imported = log.importText("typing_history.txt");
+                }
+            }
+            startLogGeneration(log, "typing_history.col");
+            log.unlock();
+        }
+
+        // The lock makes sure only one of several starting sessions converts
+        // the legacy top-10 file.
+        FileLock lock("leaderboard.dat.lock");
+        Leaderboard board(leaderboardSize);
+        if (!board.load("leaderboard.dat")) {
+            long entries = board.loadLegacy("leaderboard.txt");
+            if (entries > 0 && board.save("leaderboard.dat")) migrated = entries;
+        }
+    }
+
+    // Other sessions save the same stats file, so rather than writing a copy
+    // of the checker's statistics, the saved file is reloaded and caught up
+    // from the shared history under the file's lock.
+    void saveStats() {
+        PROBE_SCOPE(Probe::StatsSave);
+        FileLock lock("typing_history.stats.lock");
+        if (!log.lock(false)) return;
+        HistorySnapshot current;
+        current.openSnapshot("typing_history.col");
+        HistoryStats merged("typing_history.stats");
+        catchUpStats(merged, current, log);
+        log.unlock();
+        merged.save();
+    }
+
+    void run() {
+        prepare();
+        PendingResult batch[batchLimit];
+        HistoryRecord records[batchLimit];
+        vector<HistoryRecord> ranked;
+        unique_lock<mutex> guard(stateLock);
+        while (true) {
+            busy = false;
+            drained.notify_all();
+            sleeping = true;
+            atomic_thread_fence(memory_order_seq_cst);
+            wake.wait(guard, [this] { return stopping || !queue.empty(); });
+            sleeping = false;
+            if (queue.empty()) break;
+            busy = true;
+            guard.unlock();
+
+            size_t n;
+            while ((n = queue.popBatch(batch, batchLimit)) > 0) {
+                ranked.clear();
+                for (size_t i = 0; i < n; i++) {
+                    records[i] = batch[i].record;
+                    if (batch[i].ranked) ranked.push_back(batch[i].record);
+                }
+                log.appendRecords(records, n);
+                if (!ranked.empty()) {
+                    PROBE_SCOPE(Probe::LeaderboardSave);
+                    mergeLeaderboard("leaderboard.dat", leaderboardSize, ranked);
+                }
+            }
+            // The statistics file only saves a later load some replaying,
+            // so it is skipped on the way out.
+            if (!stopping) saveStats();
+            guard.lock();
+        }
+        guard.unlock();
+        log.closeLog();
+    }
+
+public:
+    HistoryWriter() = default;
+    HistoryWriter(const HistoryWriter&) = delete;
+    HistoryWriter& operator=(const HistoryWriter&) = delete;
+
+    ~HistoryWriter() {
+        stop();
+    }
+
+    // Both take effect only before the writer starts.
+    void setFsyncEvery(int n) { log.setFsyncEvery(n); }
+    void setLeaderboardSize(size_t k) { leaderboardSize = k; }
+
+    // Tests imported from typing_history.txt and entries from leaderboard.txt
+    // when the writer started.
+    long importedTests() const { return imported; }
+    long migratedEntries() const { return migrated; }
+
+    void start() {
+        if (worker.joinable()) return;
+        busy = true;
+        worker = thread(&HistoryWriter::run, this);
+    }
+
+    // Never blocks on disk: waits only if 256 results are already queued.
+    void submit(const TypingStats& stats, bool ranked) {
+        start();
+        PendingResult pending{SessionLog::pack(stats), ranked};
+        while (!queue.push(pending)) {
+            this_thread::yield();
+        }
+        // A busy writer drains the ring again before it sleeps, so only a
+        // sleeping one needs waking. The fence pairs with the writer's, so
+        // either it sees the push or this sees the flag. Taking the lock then
+        // keeps the notification from slipping in between its check and its
+        // wait.
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!sleeping.load(memory_order_relaxed)) return;
+        { lock_guard<mutex> guard(stateLock); }
+        wake.notify_one();
+    }
+
+    // Returns once everything submitted so far is on disk.
+    void waitIdle() {
+        start();
+        unique_lock<mutex> guard(stateLock);
+        drained.wait(guard, [this] { return !busy && queue.empty(); });
+    }
+
+    // Writes whatever is still queued, then joins. The writer is normally
+    // idle by the time a session exits, so this returns at once.
+    void stop() {
+        if (!worker.joinable()) return;
+        {
+            lock_guard<mutex> guard(stateLock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+};
+
+// Scratch memory for one test. The texts and display buffers a test builds
+// are carved from one block and dropped together when the next test starts.
+// Anything that spilled past the block is added to its size at that point,
+// so once the block fits the largest test, tests stop allocating.
+class TestArena {
+private:
+    // Passes spilled allocations on to the heap and counts their bytes.
+    class Spill : public pmr::memory_resource {
+    public:
+        size_t bytes = 0;
+
+    private:
+        void* do_allocate(size_t size, size_t alignment) override {
+            bytes += size;
+            return pmr::new_delete_resource()->allocate(size, alignment);
+        }
+
+        void do_deallocate(void* p, size_t size, size_t alignment) override {
+            pmr::new_delete_resource()->deallocate(p, size, alignment);
+        }
+
+        bool do_is_equal(const pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    size_t blockSize;
+    unique_ptr<char[]> block;
+    Spill spill;
+    optional<pmr::monotonic_buffer_resource> pool;
+
+public:
+    explicit TestArena(size_t initialSize = 64 * 1024) : blockSize(initialSize), block(new char[initialSize]) {
+        pool.emplace(block.get(), blockSize, &spill);
+    }
+
+    // Frees everything handed out since the last reset.
+    void reset() {
+        if (spill.bytes == 0) {
+            pool->release();
+            return;
+        }
+        pool.reset();
+        blockSize += spill.bytes;
+        spill.bytes = 0;
+        block.reset(new char[blockSize]);
+        pool.emplace(block.get(), blockSize, &spill);
+    }
+
+    pmr::memory_resource* resource() { return &*pool; }
+    size_t capacity() const { return blockSize; }
+};
+
+class TypingSpeedChecker {
+private:
+    HistoryStore history;           // log rows not yet in the snapshot
+    Leaderboard leaderboard;
+    LeaderboardClient server;       // with --connect, results go to the daemon
+    string currentUser;
+    SessionLog historyLog{"typing_history.log"};
+    HistorySnapshot snapshot;
+    HistoryStats historyStats{"typing_history.stats"};
+    HistoryWriter writer;           // appends results and saves in the background
+    bool historyLoaded = false;     // history and leaderboard load on first use
+    bool leaderboardLoaded = false;
+    KeyStatsTable keyStats;
+    RecordingLog recordings{"typing_sessions.rec"};
+    TimingValidator validator;
+    TimingVerdict lastVerdict;      // of the test being recorded
+    KeystrokeCapture capture;
+    LiveRenderer renderer;
+    AlignmentScorer scorer;
+    
+    // Reused by every test, so a warmed-up test allocates nothing: the
+    // result and recording keep their strings' capacity, and everything
+    // else a test builds comes from the arena.
+    TypingStats result;
+    AlignmentResult aligned;
+    SessionRecording recording;
+    TestArena arena;
+    string passageBuffer;
+    string drillText;
+    string highlight;
+    GraphemeIndex highlightOriginal, highlightTyped;
+    
+    TextCorpus corpus;
+    string corpusPath = "texts.txt";
+    DrillGenerator drills;
+    string wordListPath = "words.txt";
+    static constexpr size_t drillWordCount = 30;
+
+    void currentDate(string& date) {
+        time_t now = time(0);
+        char buffer[80];
+        struct tm timeinfo;
+        localtime_r(&now, &timeinfo);
+        date.assign(buffer, strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeinfo));
+    }
+
+    // Nothing is read up front, so the first prompt appears at once however
+    // long the history is. Each store is loaded the first time it is shown.
+    void ensureHistory() {
+        if (historyLoaded) return;
+        writer.waitIdle();
+        loadHistory();
+        historyLoaded = true;
+    }
+    
+    void ensureLeaderboard() {
+        if (leaderboardLoaded) return;
+        writer.waitIdle();
+        loadLeaderboard();
+        leaderboardLoaded = true;
+    }
+
+public:
+    ~TypingSpeedChecker() {
+        writer.stop();
+        PROBE_SCOPE(Probe::KeyStatsSave);
+        keyStats.save("typing_keys.dat");
+    }
+    
+    void setUser(const string& name) {
+        currentUser = name;
+        PROBE_SCOPE(Probe::KeyStatsLoad);
+        keyStats.load("typing_keys.dat", name);
+    }
+    
+    void setFsyncEvery(int n) {
+        writer.setFsyncEvery(n);
+    }
+    
+    bool connectServer(const string& socketPath) {
+        return server.connectTo(socketPath);
+    }
+    
+    // Takes effect on the next test; the corpus is opened lazily.
+    void setCorpus(const string& path) {
+        corpusPath = path;
+        drills.closeWords();
+        corpus.closeCorpus();
+    }
+    
+    // Drill words come from this list, or from the corpus if it is missing.
+    void setWordList(const string& path) {
+        wordListPath = path;
+        drills.closeWords();
+    }
+    
+    // Folds the test's keystrokes into the user's key and bigram table and
+    // appends a recording of them for replay and auditing.
+    void recordKeystrokes(const TypingStats& stats, string_view original, const string& typed, bool prefixOnly) {
+        scorer.alignInto(aligned, original, typed, prefixOnly, true);
+        const KeystrokeRing& keys = capture.keystrokes();
+        keyStats.addSession(scorer.originalClusters(), aligned.ops, keys);
+        
+        // A full ring may have dropped the first keys, which a replay needs.
+        if (keys.size() == 0 || keys.size() == keys.capacity()) return;
+        SessionRecording& rec = recording;
+        rec.name = stats.name;
+        rec.difficulty = stats.difficulty;
+        rec.date = parseDate(stats.date);
+        rec.wpm = stats.wpm;
+        rec.accuracy = stats.accuracy;
+        rec.time = stats.time;
+        rec.correctChars = stats.correctChars;
+        rec.totalChars = stats.totalChars;
+        rec.errors = stats.errors;
+        rec.prefixOnly = prefixOnly;
+        rec.flagged = lastVerdict.suspicious();
+        rec.passage.assign(original);
+        encodeKeystrokes(original, keys, rec);
+        recordings.append(rec);
+    }
+    
+    // Stores a finished test: handed to the writer thread, which appends it
+    // to the log straight away rather than on exit. A test whose keystroke
+    // timing fails validation stays in the user's history, flagged so its
+    // WPM stays out of the averages and a leaderboard rebuild leaves it off.
+    // Stores that are not loaded yet pick the result up from disk when they
+    // are.
+    void recordResult(TypingStats& stats) {
+        lastVerdict = validator.check(capture.keystrokes());
+        stats.flagged = lastVerdict.suspicious();
+        if (historyLoaded) {
+            history.append(stats);
+            historyStats.add(stats);
+        }
+        if (stats.flagged) {
+            cout << "🚩 Not ranked: " << lastVerdict.describe() << "\n";
+            writer.submit(stats, false);
+            return;
+        }
+        if (!submitToServer(stats)) {
+            writer.submit(stats, stats.wpm > 0);
+            updateLeaderboard(stats);
+        }
+    }
+    
+    // The daemon appends to the history log and owns the leaderboard, so a
+    // submitted result is not stored locally. Falls back to local storage if
+    // the daemon has gone away.
+    bool submitToServer(const TypingStats& stats) {
+        if (!server.isConnected()) return false;
+        SubmitReplyBody reply;
+        if (!server.submit(stats, capture.keystrokes(), reply)) {
+            cout << "⚠️ Leaderboard server unavailable, saving locally\n";
+            return false;
+        }
+        if (reply.difficultyRank > 0) {
+            cout << "🌐 #" << reply.difficultyRank << " on the " << stats.difficulty << " leaderboard\n";
+        }
+        return true;
+    }
+    
+    // Scores a finished attempt into the reused result and stores it.
+    const TypingStats& scoreTest(string_view original, const string& typed, double timeTaken,
+                                 string_view difficulty, bool prefixOnly) {
+        AlignmentResult score = scorer.score(original, typed, prefixOnly);
+        result.name = currentUser;
+        result.wpm = calculateWPM(score.matches, timeTaken);
+        result.accuracy = score.accuracy();
+        result.time = timeTaken;
+        result.correctChars = score.matches;
+        result.totalChars = score.typedLength();
+        result.errors = score.distance();
+        result.difficulty = difficulty;
+        currentDate(result.date);
+        
+        recordResult(result);
+        recordKeystrokes(result, original, typed, prefixOnly);
+        return result;
+    }
+    
+    double calculateWPM(int correctChars, double timeInSeconds) {
+        TimingCheck check;
+        double wpm = wpmFor(correctChars, timeInSeconds, check);
+        
+        if (check == TimingCheck::TooShort) {
+            cout << "⚠️ Warning: Timing error detected (" << timeInSeconds << "s)\n";
+        } else if (check == TimingCheck::Unrealistic) {
+            cout << "⚠️ Warning: Unrealistic WPM detected, timing may be incorrect\n";
+        }
+        
+        return wpm;
+    }
+    
+    double calculateAccuracy(const string& original, const string& typed) {
+        return scorer.score(original, typed).accuracy();
+    }
+    
+    int countErrors(const string& original, const string& typed) {
+        return scorer.score(original, typed).distance();
+    }
+    
+    void displayDetailedComparison(string_view original, const string& typed) {
+        AlignmentResult& score = aligned;
+        scorer.alignInto(score, original, typed, false, true);
+        
+        cout << "\n--- Character-by-Character Analysis ---\n";
+        cout << "Legend: ✓ match  ✗ wrong  + extra  - missed\n";
+        
+        // One column per character: ops count clusters, not bytes.
+        const GraphemeIndex& source = scorer.originalClusters();
+        const GraphemeIndex& attempt = scorer.typedClusters();
+        pmr::string originalRow(arena.resource()), typedRow(arena.resource()), matchRow(arena.resource());
+        size_t i = 0, j = 0;
+        for (char op : score.ops) {
+            switch (op) {
+                case '=': originalRow += source.at(i++); typedRow += attempt.at(j++); matchRow += "✓"; break;
+                case 'S': originalRow += source.at(i++); typedRow += attempt.at(j++); matchRow += "✗"; break;
+                case 'I': originalRow += '-'; typedRow += attempt.at(j++); matchRow += "+"; break;
+                case 'D': originalRow += source.at(i++); typedRow += '-'; matchRow += "-"; break;
+            }
+        }
+        
+        cout << "Original: " << originalRow << "\n";
+        cout << "Typed:    " << typedRow << "\n";
+        cout << "Match:    " << matchRow << "\n";
+        cout << "Wrong: " << score.substitutions << " | Extra: " << score.insertions
+             << " | Missed: " << score.deletions << "\n";
+    }
+    
+    void displayRealTimeHighlight(string_view original, const string& typed) {
+        PROBE_SCOPE(Probe::Highlight);
+        cout << "\n--- Real-Time Character Highlighting ---\n";
+        cout << "Legend: [Correct] (Wrong) _Missing_\n\n";
+        
+        // Built in one buffer so the whole passage goes out in a single write.
+        string& out = highlight;
+        out.clear();
+        out.reserve(max<size_t>(4096, original.length() * 12 + typed.length() * 2 + 16));
+        
+        // Compared character by character; plain ASCII keeps the byte loop.
+        highlightOriginal.assign(original);
+        highlightTyped.assign(typed);
+        if (highlightOriginal.isAscii() && highlightTyped.isAscii()) {
+            appendHighlight(out, original.length(), typed.length(), [&](size_t i) { return original[i]; },
+                            [&](size_t i) { return typed[i]; });
+        } else {
+            appendHighlight(out, highlightOriginal.size(), highlightTyped.size(),
+                            [this](size_t i) { return highlightOriginal.at(i); },
+                            [this](size_t i) { return highlightTyped.at(i); });
+        }
+        out += '\n';
+        cout.write(out.data(), out.size());
+    }
+    
+    template <typename OriginalAt, typename TypedAt>
+    static void appendHighlight(string& out, size_t originalLength, size_t typedLength, OriginalAt originalAt,
+                                TypedAt typedAt) {
+        for (size_t i = 0; i < originalLength; i++) {
+            if (i < typedLength) {
+                if (originalAt(i) == typedAt(i)) {
+                    out += "\033[32m[";
+                    out += originalAt(i);
+                    out += "]\033[0m";
+                } else {
+                    out += "\033[31m(";
+                    out += typedAt(i);
+                    out += ")\033[0m";
+                }
+            } else {
+                out += "\033[33m_";
+                out += originalAt(i);
+                out += "_\033[0m";
+            }
+        }
+        
+        if (typedLength > originalLength) {
+            out += "\033[31m";
+            for (size_t i = originalLength; i < typedLength; i++) {
+                out += '+';
+                out += typedAt(i);
+            }
+            out += "\033[0m";
+        }
+    }
+    
+    // Recordings are numbered from 1 in file order; name filters the list
+    // but keeps the numbers.
+    void listRecordings(const string& name) {
+        size_t number = 0, shown = 0;
+        uint64_t keys = 0, bytes = 0;
+        cout << "\n  #     Date                 Typist          Difficulty      WPM   Acc%   Keys  B/key\n";
+        bool readable = recordings.scan([&](const SessionRecording& rec) {
+            number++;
+            if (!name.empty() && rec.name != name) return;
+            shown++;
+            keys += rec.keyCount;
+            bytes += rec.events.size();
+            cout << "  " << left << setw(6) << number << setw(21) << formatDate(rec.date) << setw(16)
+                 << rec.name.substr(0, 15) << setw(12) << rec.difficulty.substr(0, 11) << right << fixed
+                 << setprecision(1) << setw(7) << rec.wpm << setw(7) << rec.accuracy << setw(7) << rec.keyCount
+                 << setprecision(2) << setw(7) << (rec.keyCount ? double(rec.events.size()) / rec.keyCount : 0)
+                 << left << (rec.flagged ? "  🚩" : "") << "\n";
+        });
+        if (!readable) {
+            cout << "❌ Could not read " << recordings.getPath() << "\n";
+            return;
+        }
+        cout << "\n" << shown << " recordings, " << keys << " keystrokes in " << bytes << " bytes ("
+             << fixed << setprecision(2) << (keys ? double(bytes) / keys : 0) << " bytes per keystroke)\n";
+    }
+    
+    // Types recording #number back through the live renderer at speed times
+    // its real pace (0 = at once), starting from keystroke seekTo, then
+    // re-scores it with the current rules.
+    bool replayRecording(size_t number, double speed, size_t seekTo) {
+        SessionRecording found;
+        size_t seen = 0;
+        recordings.scan([&](const SessionRecording& rec) {
+            if (++seen == number) found = rec;
+        });
+        if (number == 0 || number > seen) {
+            cout << "❌ No recording #" << number << " in " << recordings.getPath() << " (" << seen << " recorded)\n";
+            return false;
+        }
+        
+        cout << "\n===========================================\n";
+        cout << "  ▶️  Replay #" << number << ": " << found.name << ", " << found.difficulty << ", "
+             << formatDate(found.date) << "\n";
+        cout << "===========================================\n\n";
+        
+        ReplayCursor cursor(found);
+        if (!cursor.seek(min<size_t>(seekTo, found.keyCount))) {
+            cout << "❌ Recording #" << number << " is damaged at keystroke " << cursor.keyIndex() << "\n";
+            return false;
+        }
+        if (speed > 0 && isatty(STDOUT_FILENO)) {
+            cout.flush();
+            renderer.begin(found.passage);
+            renderer.start();
+            renderer.update(string(), 0);
+            renderer.update(cursor.text(), cursor.nanos());
+            
+            // Recording time maps to wall time through origin.
+            auto origin = chrono::steady_clock::now() - chrono::nanoseconds((int64_t)(cursor.nanos() / speed));
+            auto recordingNanos = [&] {
+                return (int64_t)((chrono::steady_clock::now() - origin).count() * speed);
+            };
+            while (!cursor.atEnd()) {
+                if (!cursor.next()) break;
+                auto due = origin + chrono::nanoseconds((int64_t)(cursor.nanos() / speed));
+                while (chrono::steady_clock::now() < due) {
+                    if (renderer.pending() && recordingNanos() >= renderer.nextFrameNanos()) {
+                        renderer.renderFrame(recordingNanos());
+                    }
+                    auto frame = origin + chrono::nanoseconds((int64_t)(renderer.nextFrameNanos() / speed));
+                    this_thread::sleep_until(renderer.pending() ? min(due, frame) : due);
+                }
+                renderer.update(cursor.text(), cursor.nanos());
+            }
+            renderer.finish(cursor.nanos());
+        } else {
+            cursor.seek(found.keyCount);
+        }
+        
+        TypingStats rescored;
+        string typed;
+        bool complete = rescoreRecording(found, scorer, typed, rescored);
+        displayRealTimeHighlight(found.passage, cursor.text());
+        cout << "\nKeystrokes: " << found.keyCount << " in " << found.events.size() << " bytes | recorded: "
+             << fixed << setprecision(2) << found.wpm << " WPM, " << found.accuracy << "%\n";
+        if (!complete) {
+            cout << "❌ The keystroke stream is damaged; it could not be re-scored\n";
+        } else if (matchesRecording(found, rescored)) {
+            cout << "✅ Current scoring agrees: " << rescored.wpm << " WPM, " << rescored.accuracy << "%\n";
+        } else {
+            cout << "⚠️ Current scoring differs: " << rescored.wpm << " WPM, " << rescored.accuracy << "%, "
+                 << rescored.errors << " errors (recorded " << found.errors << ")\n";
+        }
+        return complete;
+    }
+    
+    void ensureCorpus() {
+        if (!corpus.isOpen() && !corpus.openCorpus(corpusPath)) {
+            corpus.openBuiltin();
+        }
+    }
+    
+    // Valid until the next test or until the corpus is changed.
+    string_view selectText(int difficulty) {
+        ensureCorpus();
+        return corpus.select(difficulty, passageBuffer);
+    }
+    
+    int selectDuration() {
+        cout << "\nChoose a duration: 1) 15s  2) 30s  3) 60s  4) 120s\n";
+        cout << "Enter your choice: ";
+        
+        int option = 0;
+        if (!(cin >> option)) {
+            cin.clear();
+        }
+        
+        switch (option) {
+            case 1: return 15;
+            case 2: return 30;
+            case 4: return 120;
+            default: return 60;
+        }
+    }
+    
+    void timedMode(int durationSeconds) {
+        cout << "\n===========================================\n";
+        cout << "      ⏱️  " << durationSeconds << "-SECOND TIMED MODE ⏱️\n";
+        cout << "===========================================\n";
+        cout << "Type as much as you can in " << durationSeconds << " seconds!\n";
+        cout << "The text will repeat if you finish early.\n\n";
+        
+        static constexpr string_view practiceText =
+            "The quick brown fox jumps over the lazy dog. Practice makes perfect. "
+            "Keep typing to improve your speed. Focus on accuracy and speed together. ";
+        
+        // The repeating text is only generated as far as anyone could type
+        // in the time: 300 WPM, where results are flagged as unrealistic.
+        arena.reset();
+        size_t reachable = (size_t)durationSeconds * 300 * 5 / 60 + practiceText.length();
+        pmr::string fullText(arena.resource());
+        fullText.reserve(reachable);
+        while (fullText.length() < reachable) {
+            fullText.append(practiceText, 0, min(practiceText.length(), reachable - fullText.length()));
+        }
+        
+        cout << "Text to type (repeating):\n";
+        cout << "\"" << practiceText << "\"\n\n";
+        cout << "Press ENTER to start the " << durationSeconds << "-second timer...\n";
+        cin.ignore();
+        
+        cout << "\n⏱️  START TYPING NOW! The clock starts at your first key! ⏱️\n\n";
+        
+        cout << "Type here: ";
+        renderer.begin(fullText);
+        const string& typedText = capture.captureLine(durationSeconds, &renderer);
+        if (capture.wasCancelled()) {
+            cout << "\n🚫 Test cancelled, nothing was saved\n";
+            return;
+        }
+        double timeTaken = min(capture.elapsedSeconds(), (double)durationSeconds);
+        
+        if (capture.timedOut()) {
+            cout << "\n⏰ Time's up!\n";
+        }
+        
+        // The typed text is aligned against whatever prefix of the repeating
+        // text it covers; half as much again allows for skipped characters,
+        // and is what the recording keeps.
+        string_view covered = string_view(fullText).substr(0, typedText.length() * 3 / 2 + 64);
+        char difficulty[24];
+        snprintf(difficulty, sizeof(difficulty), "Timed-%ds", durationSeconds);
+        const TypingStats& stats = scoreTest(covered, typedText, timeTaken, difficulty, true);
+        
+        displayResults(stats);
+        displayKeystrokeAnalysis();
+        displayPerformanceAnalysis(stats);
+    }
+    
+    void customTextMode() {
+        cout << "\n===========================================\n";
+        cout << "      📝 CUSTOM TEXT MODE 📝\n";
+        cout << "===========================================\n";
+        cout << "Enter your custom text to practice:\n";
+        cout << "(Press ENTER twice when done)\n\n";
+        
+        cin.ignore();
+        arena.reset();
+        pmr::string customText(arena.resource());
+        pmr::string line(arena.resource());
+        
+        while (getline(cin, line) && !line.empty()) {
+            customText += line;
+            customText += ' ';
+        }
+        
+        if (customText.empty()) {
+            cout << "❌ No text entered. Returning to menu.\n";
+            return;
+        }
+        
+        cout << "\nYour custom text:\n\"" << customText << "\"\n\n";
+        cout << "Press ENTER when ready to start...\n";
+        cin.get();
+        
+        cout << "\n⏱️  START TYPING NOW! ⏱️\n\n";
+        
+        // Timing runs from the first keystroke to Enter, not from the prompt.
+        renderer.begin(customText);
+        const string& typedText = capture.captureLine(0, &renderer);
+        if (capture.wasCancelled()) {
+            cout << "\n🚫 Test cancelled, nothing was saved\n";
+            return;
+        }
+        const TypingStats& stats = scoreTest(customText, typedText, capture.elapsedSeconds(), "Custom", false);
+        
+        displayResults(stats);
+        displayKeystrokeAnalysis();
+        displayRealTimeHighlight(customText, typedText);
+        displayPerformanceAnalysis(stats);
+    }
+    
+    // A passage of dictionary words weighted toward the user's slowest and
+    // most error-prone bigrams and letters.
+    void drillMode() {
+        arena.reset();
+        if (drills.size() == 0 && !drills.loadWordList(wordListPath)) {
+            ensureCorpus();
+            drills.loadFromCorpus(corpus);
+        }
+        vector<pair<uint32_t, double>> targets = keyStats.weakestFeatures(48);
+        drills.setTargets(targets);
+        drills.generate(drillWordCount, drillText);
+        if (drillText.empty()) {
+            cout << "\n❌ No words available for a drill.\n";
+            return;
+        }
+        
+        cout << "\n===========================================\n";
+        cout << "  🎯 Adaptive Drill\n";
+        cout << "===========================================\n\n";
+        if (targets.empty()) {
+            cout << "No weak spots recorded yet - this drill is random practice.\n\n";
+        } else {
+            cout << "Targeting:";
+            for (size_t i = 0; i < min<size_t>(8, targets.size()); i++) {
+                uint32_t f = targets[i].first;
+                cout << " " << (f >= 65536 ? string(1, (char)(f - 65536)) : string{(char)(f / 256), (char)(f % 256)});
+            }
+            cout << "\n\n";
+        }
+        cout << "Type the following text:\n\n";
+        cout << "\"" << drillText << "\"\n\n";
+        cout << "\nPress ENTER when ready to start...\n";
+        cin.ignore();
+        
+        cout << "\n⏱️  START TYPING NOW! ⏱️\n\n";
+        
+        renderer.begin(drillText);
+        const string& typedText = capture.captureLine(0, &renderer);
+        if (capture.wasCancelled()) {
+            cout << "\n🚫 Test cancelled, nothing was saved\n";
+            return;
+        }
+        const TypingStats& stats = scoreTest(drillText, typedText, capture.elapsedSeconds(), "Drill", false);
+        
+        displayResults(stats);
+        displayKeystrokeAnalysis();
+        displayRealTimeHighlight(drillText, typedText);
+        displayPerformanceAnalysis(stats);
+    }
+    
+    void startTest(int difficulty, string& difficultyLevel) {
+        arena.reset();
+        string_view originalText = selectText(difficulty);
+        
+        switch(difficulty) {
+            case 1: difficultyLevel = "Easy"; break;
+            case 2: difficultyLevel = "Medium"; break;
+            case 3: difficultyLevel = "Hard"; break;
+            case 4: difficultyLevel = "Expert"; break;
+        }
+        
+        cout << "\n===========================================\n";
+        cout << "  Difficulty: " << difficultyLevel << "\n";
+        cout << "===========================================\n\n";
+        cout << "Type the following text:\n\n";
+        cout << "\"" << originalText << "\"\n\n";
+        cout << "Character count: " << graphemeCount(originalText) << "\n";
+        cout << "\nPress ENTER when ready to start...\n";
+        cin.ignore();
+        
+        cout << "\n⏱️  START TYPING NOW! ⏱️\n\n";
+        
+        // Timing runs from the first keystroke to Enter, not from the prompt.
+        renderer.begin(originalText);
+        const string& typedText = capture.captureLine(0, &renderer);
+        if (capture.wasCancelled()) {
+            cout << "\n🚫 Test cancelled, nothing was saved\n";
+            return;
+        }
+        double timeTaken = capture.elapsedSeconds();
+        
+        cout << "\n⏱️ Time measured: " << fixed << setprecision(2) << timeTaken << " seconds\n";
+        
+        const TypingStats& stats = scoreTest(originalText, typedText, timeTaken, difficultyLevel, false);
+        
+        displayResults(stats);
+        displayKeystrokeAnalysis();
+        displayRealTimeHighlight(originalText, typedText);
+        displayDetailedComparison(originalText, typedText);
+        displayPerformanceAnalysis(stats);
+    }
+    
+    // Joins a race on the hub, waits in the lobby for the other racers and
+    // types the hub's passage while everyone's progress is drawn live.
+    void raceMode(const string& socketPath) {
+        arena.reset();
+        RaceClient race;
+        if (!race.join(socketPath, currentUser)) {
+            cout << "❌ No race hub on " << socketPath << "\n";
+            return;
+        }
+        cout << "\n🏁 Joined the race on " << socketPath << ", waiting for the other racers...\n";
+        if (!race.waitForStart()) {
+            cout << "❌ The race hub went away\n";
+            return;
+        }
+        string originalText = race.getPassage();
+        
+        cout << "\n===========================================\n";
+        cout << "  🏁 Race: " << race.getLanes().size() << " racers\n";
+        cout << "===========================================\n\n";
+        cout << "Type the following text:\n\n";
+        cout << "\"" << originalText << "\"\n\n";
+        cout << "Character count: " << graphemeCount(originalText) << "\n\n";
+        for (uint32_t left = race.countdownMillis(); left > 0; left -= min(left, 1000u)) {
+            cout << "  " << (left + 999) / 1000 << "...\n" << flush;
+            this_thread::sleep_for(chrono::milliseconds(min(left, 1000u)));
+        }
+        cout << "\n⏱️  GO! ⏱️\n\n";
+        
+        renderer.begin(originalText);
+        race.attach(&renderer);
+        const string& typedText = capture.captureLine(0, &renderer, &race);
+        if (capture.wasCancelled()) {
+            cout << "\n🚫 Left the race, nothing was saved\n";
+            return;
+        }
+        const TypingStats& stats = scoreTest(originalText, typedText, capture.elapsedSeconds(), "Race", false);
+        
+        race.finish(stats);
+        cout << "\n⏳ Waiting for the other racers to finish...\n";
+        bool complete = race.waitForResults();
+        displayRaceStandings(race.getLanes(), race.racerId(), complete);
+        displayResults(stats);
+        displayRealTimeHighlight(originalText, typedText);
+    }
+    
+    void displayRaceStandings(const vector<RaceLane>& lanes, uint16_t self, bool complete) {
+        vector<const RaceLane*> standings;
+        for (const auto& lane : lanes) standings.push_back(&lane);
+        sort(standings.begin(), standings.end(), [](const RaceLane* a, const RaceLane* b) {
+            int16_t pa = a->state.place, pb = b->state.place;
+            if ((pa > 0) != (pb > 0)) return pa > 0;
+            return pa > 0 ? pa < pb : a->state.correctChars > b->state.correctChars;
+        });
+        
+        cout << "\n===========================================\n";
+        cout << "            🏆 RACE STANDINGS 🏆\n";
+        cout << "===========================================\n";
+        if (!complete) cout << "⚠️ Lost the race hub; standings may be incomplete\n";
+        cout << fixed << setprecision(2);
+        for (const RaceLane* lane : standings) {
+            const RaceEntry& e = lane->state;
+            cout << (e.racerId == self ? "▶ " : "  ");
+            if (e.place > 0) cout << "#" << left << setw(3) << e.place;
+            else cout << left << setw(4) << "--";
+            cout << setw(20) << lane->name.substr(0, 19) << right << setw(8) << e.wpm << " WPM";
+            if (e.place > 0) cout << setw(8) << e.accuracy << "%";
+            else if (e.place < 0) cout << "  (left)";
+            cout << left << "\n";
+        }
+        cout << "===========================================\n";
+    }
+    
+    void displayResults(const TypingStats& stats) {
+        cout << "\n===========================================\n";
+        cout << "              📊 RESULTS 📊\n";
+        cout << "===========================================\n";
+        cout << fixed << setprecision(2);
+        cout << "👤 Typist:            " << stats.name << "\n";
+        cout << "⏱️  Time Taken:        " << stats.time << " seconds\n";
+        cout << "🎯 Accuracy:          " << stats.accuracy << "%\n";
+        cout << "⚡ Typing Speed:      " << stats.wpm << " WPM\n";
+        cout << "✅ Correct Characters: " << stats.correctChars << "\n";
+        cout << "📝 Total Typed:       " << stats.totalChars << "\n";
+        cout << "❌ Errors:            " << stats.errors << "\n";
+        cout << "📊 Difficulty:        " << stats.difficulty << "\n";
+        cout << "📅 Date:              " << stats.date << "\n";
+        cout << "===========================================\n";
+    }
+    
+    void displayKeystrokeAnalysis() {
+        LatencyHistogram histogram = capture.latencies();
+        if (histogram.samples == 0) return;
+        
+        cout << "\n--- Keystroke Analysis ---\n";
+        cout << "Keystrokes: " << capture.keystrokes().size() << " | ";
+        cout << "Backspaces: " << capture.backspaces() << " | ";
+        cout << "Mean latency: " << fixed << setprecision(0) << histogram.mean() << "ms\n";
+        
+        for (int b = 0; b < LatencyHistogram::bucketCount; b++) {
+            int width = histogram.buckets[b] * 40 / histogram.samples;
+            cout << "  " << left << setw(11) << histogram.label(b) << right << setw(5) << histogram.buckets[b] << " ";
+            for (int i = 0; i < width; i++) cout << "█";
+            cout << "\n";
+        }
+        cout << setprecision(2);
+        displaySlowestTransitions(5);
+    }
+    
+    // Mean latency over every timed key, the reference for heat colours.
+    double averageTransitionMillis() const {
+        return keyStats.averageKeyMillis();
+    }
+    
+    static const char* heatColor(double ratio) {
+        if (ratio < 0.85) return "\033[32m";
+        if (ratio < 1.15) return "\033[33m";
+        if (ratio < 1.6) return "\033[31m";
+        return "\033[35m";
+    }
+    
+    static string keyLabel(int c) {
+        return c == ' ' ? "␣" : string(1, (char)c);
+    }
+    
+    // The user's slowest printable transitions across all sessions.
+    void displaySlowestTransitions(size_t limit) {
+        const uint32_t minSamples = 3;
+        pmr::vector<pair<double, int>> slowest(arena.resource());
+        for (int a = 32; a < 127; a++) {
+            for (int b = 32; b < 127; b++) {
+                const TransitionCell& cell = keyStats.bigram(a, b);
+                if (cell.samples >= minSamples) slowest.push_back({cell.meanMillis(), a * 256 + b});
+            }
+        }
+        if (slowest.empty()) return;
+        
+        size_t shown = min(limit, slowest.size());
+        partial_sort(slowest.begin(), slowest.begin() + shown, slowest.end(), greater<pair<double, int>>());
+        double average = averageTransitionMillis();
+        
+        cout << "\n--- Slowest Transitions (all sessions) ---\n";
+        for (size_t i = 0; i < shown; i++) {
+            int a = slowest[i].second / 256, b = slowest[i].second % 256;
+            const TransitionCell& cell = keyStats.bigram(a, b);
+            int width = (int)(20 * cell.meanMillis() / slowest[0].first);
+            
+            cout << "  " << keyLabel(a) << " → " << keyLabel(b) << right << fixed << setprecision(0)
+                 << setw(7) << cell.meanMillis() << "ms avg" << setw(7) << cell.percentile(0.95) << "ms p95"
+                 << setw(7) << setprecision(1) << cell.errorRate() << "% err  " << heatColor(cell.meanMillis() / average);
+            for (int w = 0; w < width; w++) cout << "█";
+            cout << "\033[0m\n";
+        }
+        cout << left << setprecision(2);
+    }
+    
+    // Letter-to-letter grid (case folded), coloured by mean latency relative
+    // to the user's average.
+    void displayTransitionHeatmap() {
+        double average = averageTransitionMillis();
+        if (average == 0) return;
+        
+        string out = "--- Key Transition Heatmap (row: previous key, column: next key) ---\n   ";
+        for (char c = 'a'; c <= 'z'; c++) {
+            out += c;
+            out += ' ';
+        }
+        out += '\n';
+        for (char r = 'a'; r <= 'z'; r++) {
+            out += ' ';
+            out += r;
+            out += ' ';
+            for (char c = 'a'; c <= 'z'; c++) {
+                double sum = 0;
+                uint32_t samples = 0;
+                for (char first : {r, (char)toupper(r)}) {
+                    for (char second : {c, (char)toupper(c)}) {
+                        sum += keyStats.bigram(first, second).sumMillis;
+                        samples += keyStats.bigram(first, second).samples;
+                    }
+                }
+                if (samples == 0) {
+                    out += "· ";
+                } else {
+                    out += heatColor(sum / samples / average);
+                    out += "██\033[0m";
+                }
+            }
+            out += '\n';
+        }
+        out += "   \033[32m██\033[0m fast  \033[33m██\033[0m average  \033[31m██\033[0m slow  "
+               "\033[35m██\033[0m very slow  · no data\n";
+        cout << out;
+        displaySlowestTransitions(10);
+        cout << "\n";
+    }
+    
+    void displayPerformanceAnalysis(const TypingStats& stats) {
+        cout << "\n--- Performance Analysis ---\n";
+        
+        cout << "Speed Rating: ";
+        if (stats.wpm >= 80) cout << "⭐⭐⭐⭐⭐ Elite\n";
+        else if (stats.wpm >= 60) cout << "⭐⭐⭐⭐ Excellent\n";
+        else if (stats.wpm >= 40) cout << "⭐⭐⭐ Good\n";
+        else if (stats.wpm >= 25) cout << "⭐⭐ Average\n";
+        else if (stats.wpm > 0) cout << "⭐ Beginner\n";
+        else cout << "❌ Invalid timing\n";
+        
+        cout << "Accuracy Rating: ";
+        if (stats.accuracy >= 98) cout << "⭐⭐⭐⭐⭐ Perfect\n";
+        else if (stats.accuracy >= 95) cout << "⭐⭐⭐⭐ Excellent\n";
+        else if (stats.accuracy >= 90) cout << "⭐⭐⭐ Good\n";
+        else if (stats.accuracy >= 80) cout << "⭐⭐ Fair\n";
+        else cout << "⭐ Needs Practice\n";
+        
+        if (stats.wpm > 0) {
+            cout << "\n💡 Feedback:\n";
+            if (stats.wpm >= 60 && stats.accuracy >= 95) {
+                cout << "   Outstanding! You're in the top tier of typists.\n";
+            } else if (stats.wpm >= 40 && stats.accuracy >= 85) {
+                cout << "   Great work! Keep practicing to reach expert level.\n";
+            } else if (stats.accuracy < 80) {
+                cout << "   Focus on accuracy before speed. Slow down and reduce errors.\n";
+            } else if (stats.wpm < 40) {
+                cout << "   Practice regularly to build muscle memory and speed.\n";
+            }
+        }
+    }
+    
+    void printHistoryEntry(size_t number, string_view name, string_view difficulty,
+                           double wpm, double accuracy, double time, string_view date, bool flagged) {
+        cout << "Test #" << number << " - " << name << " [" << difficulty << "]"
+             << (flagged ? " 🚩 not ranked" : "") << "\n";
+        cout << "  Speed: " << fixed << setprecision(2) << wpm << " WPM | ";
+        cout << "Accuracy: " << accuracy << "% | ";
+        cout << "Time: " << time << "s\n";
+        cout << "  Date: " << date << "\n\n";
+    }
+    
+    static void printStatsRow(const string& label, const RunningStats& running, const TDigest& digest) {
+        cout << left << setw(14) << label << setw(7) << running.valid
+             << fixed << setprecision(2)
+             << setw(9) << running.averageWpm() << setw(9) << running.stddevWpm()
+             << setw(9) << running.bestWpm << setw(9) << digest.quantile(0.5)
+             << setw(9) << digest.quantile(0.9) << running.averageAccuracy() << "%\n";
+    }
+    
+    static void printBuckets(const char* title, const map<int32_t, StatsBucket>& buckets, bool weeks) {
+        if (buckets.empty()) return;
+        cout << "\n" << title << "\n";
+        for (const auto& entry : buckets) {
+            const StatsBucket& bucket = entry.second;
+            string label = weeks ? "Week of " + formatDay(bucket.key * 7 - 3) : formatDay(bucket.key);
+            cout << "  " << left << setw(20) << label << bucket.count << " tests, "
+                 << fixed << setprecision(2) << bucket.sumWpm / bucket.count << " WPM avg, "
+                 << bucket.bestWpm << " best, " << bucket.sumAccuracy / bucket.count << "% accuracy\n";
+        }
+    }
+    
+    // The most recent `limit` buckets across the given groups, merged by key.
+    static map<int32_t, StatsBucket> recentBuckets(const vector<const HistoryStats::Group*>& groups,
+                                                   bool weeks, size_t limit) {
+        map<int32_t, StatsBucket> merged;
+        for (const auto* group : groups) {
+            const vector<StatsBucket>& buckets = weeks ? group->weeks : group->days;
+            for (size_t i = buckets.size() > limit ? buckets.size() - limit : 0; i < buckets.size(); i++) {
+                auto inserted = merged.emplace(buckets[i].key, buckets[i]);
+                if (!inserted.second) {
+                    StatsBucket& bucket = inserted.first->second;
+                    bucket.count += buckets[i].count;
+                    bucket.sumWpm += buckets[i].sumWpm;
+                    bucket.sumAccuracy += buckets[i].sumAccuracy;
+                    bucket.bestWpm = max(bucket.bestWpm, buckets[i].bestWpm);
+                }
+            }
+        }
+        while (merged.size() > limit) merged.erase(merged.begin());
+        return merged;
+    }
+    
+    void displayUserStatistics() {
+        vector<const HistoryStats::Group*> groups;
+        for (const auto& group : historyStats.getGroups()) {
+            if (group.name == currentUser && group.running.valid > 0) groups.push_back(&group);
+        }
+        if (groups.empty()) return;
+        sort(groups.begin(), groups.end(), [](const HistoryStats::Group* a, const HistoryStats::Group* b) {
+            return a->difficulty < b->difficulty;
+        });
+        
+        cout << "--- Your Statistics (" << currentUser << ") ---\n";
+        cout << left << setw(14) << "Difficulty" << setw(7) << "Tests" << setw(9) << "Avg WPM"
+             << setw(9) << "Std Dev" << setw(9) << "Best" << setw(9) << "Median"
+             << setw(9) << "p90" << "Accuracy\n";
+        
+        RunningStats allRunning;
+        TDigest allDigest;
+        for (const auto* group : groups) {
+            printStatsRow(group->difficulty, group->running, group->wpmDigest);
+            allRunning.merge(group->running);
+            allDigest.merge(group->wpmDigest);
+        }
+        if (groups.size() > 1) {
+            printStatsRow("All", allRunning, allDigest);
+        }
+        
+        printBuckets("Recent days:", recentBuckets(groups, false, 7), false);
+        printBuckets("Recent weeks:", recentBuckets(groups, true, 4), true);
+        cout << "\n";
+    }
+    
+    void printHistoryRow(size_t index) {
+        size_t archived = snapshot.size();
+        if (index < archived) {
+            printHistoryEntry(index + 1, snapshot.name(snapshot.nameIds()[index]),
+                              snapshot.difficulty(snapshot.difficultyIds()[index]),
+                              snapshot.wpm()[index], snapshot.accuracy()[index], snapshot.time()[index],
+                              formatDate(snapshot.dates()[index]), snapshot.flags() && snapshot.flags()[index]);
+        } else {
+            PackedStats row = history.row(index - archived);
+            printHistoryEntry(index + 1, history.name(row.nameId), history.difficulty(row.difficultyId),
+                              row.wpm, row.accuracy, row.time, formatDate(row.date),
+                              history.flags()[index - archived]);
+        }
+    }
+    
+    // Summaries come from the incremental statistics; the raw list is shown a
+    // page at a time, newest page first.
+    void viewHistory() {
+        arena.reset();
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        ensureHistory();
+        size_t totalTests = snapshot.size() + history.size();
+        
+        if (totalTests == 0) {
+            cout << "\n❌ No typing history available yet!\n";
+            return;
+        }
+        
+        cout << "\n===========================================\n";
+        cout << "         📈 TYPING HISTORY 📈\n";
+        cout << "===========================================\n\n";
+        
+        displayUserStatistics();
+        displayTransitionHeatmap();
+        
+        RunningStats overall;
+        for (const auto& group : historyStats.getGroups()) {
+            overall.merge(group.running);
+        }
+        if (overall.valid > 0) {
+            cout << "--- Overall Statistics ---\n";
+            cout << "Total Tests: " << totalTests << " (Valid: " << overall.valid << ")\n";
+            cout << "Average Speed: " << overall.averageWpm() << " WPM\n";
+            cout << "Average Accuracy: " << overall.averageAccuracy() << "%\n";
+        }
+        cout << "===========================================\n";
+        
+        const size_t pageSize = 10;
+        size_t pages = (totalTests + pageSize - 1) / pageSize;
+        size_t page = pages - 1;
+        while (true) {
+            cout << "\n";
+            for (size_t i = page * pageSize; i < min(totalTests, (page + 1) * pageSize); i++) {
+                printHistoryRow(i);
+            }
+            if (pages == 1) break;
+            
+            cout << "Page " << page + 1 << "/" << pages
+                 << " - [p] older, [n] newer, page number, [Enter] done: ";
+            string input;
+            if (!getline(cin, input) || input.empty() || input == "q") break;
+            if (input == "p") {
+                if (page > 0) page--;
+            } else if (input == "n") {
+                if (page + 1 < pages) page++;
+            } else {
+                try {
+                    page = min(pages, max<size_t>(1, stoul(input))) - 1;
+                } catch (const exception&) {
+                    cout << "❌ Invalid page\n";
+                }
+            }
+        }
+    }
+    
+    
+    // The writer merges the result into leaderboard.dat; a board that is not
+    // loaded yet reads it from there.
+    void updateLeaderboard(const TypingStats& stats) {
+        if (stats.wpm <= 0) return; // Don't add invalid entries
+        if (!leaderboardLoaded) return;
+        
+        leaderboard.add(stats.name, stats.difficulty, stats.wpm, stats.accuracy, parseDate(stats.date));
     }
     
-    ~TypingSpeedChecker() {
-        saveHistory();
-        saveLeaderboard();
+    void setLeaderboardSize(size_t k) {
+        leaderboard.setCapacity(k);
+        writer.setLeaderboardSize(k);
     }
     
-    void setUser(const string& name) {
-        currentUser = name;
+    // Rank order for board display: the four levels first, then timed and
+    // custom boards alphabetically.
+    static int difficultyRank(string_view difficulty) {
+        const char* levels[] = {"Easy", "Medium", "Hard", "Expert"};
+        for (int i = 0; i < 4; i++) {
+            if (difficulty == levels[i]) return i;
+        }
+        return 4;
     }
     
-    double calculateWPM(int correctChars, double timeInSeconds) {
-        // Strict validation for macOS
-        if (timeInSeconds < 0.5) {
-            cout << "⚠️ Warning: Timing error detected (" << timeInSeconds << "s)\n";
-            return 0;
-        }
-        
-        double minutes = timeInSeconds / 60.0;
-        double words = correctChars / 5.0;
-        double wpm = words / minutes;
+    void printBoard(const vector<LeaderEntry>& entries, bool byUser) {
+        cout << left << setw(5) << "Rank" << setw(15) << (byUser ? "Difficulty" : "Name")
+             << setw(10) << "WPM" << setw(12) << "Accuracy"
+             << "Date" << "\n";
+        cout << string(54, '-') << "\n";
         
-        // Cap at 300 WPM (world record territory)
-        if (wpm > 300) {
-            cout << "⚠️ Warning: Unrealistic WPM detected, timing may be incorrect\n";
-            return 0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            string medal = "";
+            if (i == 0) medal = "🥇 ";
+            else if (i == 1) medal = "🥈 ";
+            else if (i == 2) medal = "🥉 ";
+            else medal = to_string(i + 1) + ".  ";
+            
+            string_view label = byUser ? leaderboard.difficulty(entries[i].difficultyId)
+                                       : leaderboard.name(entries[i].nameId);
+            ostringstream accuracy;
+            accuracy << fixed << setprecision(2) << entries[i].accuracy << "%";
+            cout << left << setw(5) << medal
+                 << setw(15) << string(label)
+                 << setw(10) << fixed << setprecision(2) << entries[i].wpm
+                 << setw(12) << accuracy.str()
+                 << formatDate(entries[i].date).substr(0, 10) << "\n";
         }
-        
-        return wpm;
     }
     
-    double calculateAccuracy(const string& original, const string& typed) {
-        int correct = 0;
-        int total = max(original.length(), typed.length());
+    void displayLeaderboard() {
+        ensureLeaderboard();
+        if (server.isConnected()) {
+            Leaderboard remote(leaderboard.getCapacity());
+            if (server.query(currentUser, remote)) leaderboard = move(remote);
+        }
         
-        for (size_t i = 0; i < min(original.length(), typed.length()); i++) {
-            if (original[i] == typed[i]) {
-                correct++;
-            }
+        vector<uint16_t> boards;
+        for (size_t id = 0; id < leaderboard.difficultyCount(); id++) {
+            if (!leaderboard.difficultyBoard(id)->empty()) boards.push_back(id);
+        }
+        if (boards.empty()) {
+            cout << "\n❌ Leaderboard is empty!\n";
+            return;
+        }
+        sort(boards.begin(), boards.end(), [this](uint16_t a, uint16_t b) {
+            int rankA = difficultyRank(leaderboard.difficulty(a));
+            int rankB = difficultyRank(leaderboard.difficulty(b));
+            if (rankA != rankB) return rankA < rankB;
+            return leaderboard.difficulty(a) < leaderboard.difficulty(b);
+        });
+        
+        cout << "\n===========================================\n";
+        cout << "         🏆 LEADERBOARD 🏆\n";
+        cout << "===========================================\n";
+        
+        for (uint16_t id : boards) {
+            cout << "\n📋 " << leaderboard.difficulty(id) << "\n";
+            printBoard(leaderboard.difficultyBoard(id)->ranked(), false);
+        }
+        
+        const TopK* personal = leaderboard.userBoard(currentUser);
+        if (personal && !personal->empty()) {
+            cout << "\n🏅 Your best results, " << currentUser << "\n";
+            printBoard(personal->ranked(), true);
         }
         
-        return total > 0 ? (double)correct / total * 100.0 : 0;
+        cout << "===========================================\n";
     }
     
-    int countErrors(const string& original, const string& typed) {
-        int errors = 0;
-        size_t maxLen = max(original.length(), typed.length());
+    // The writer has already run the one-time import and the generation
+    // check under the exclusive lock. Reading holds the lock shared, which
+    // still keeps a compaction from moving rows between the snapshot and
+    // the log.
+    void loadHistory() {
+        PROBE_SCOPE(Probe::HistoryLoad);
+        if (writer.importedTests() > 0) {
+            cout << "📦 Imported " << writer.importedTests() << " tests from typing_history.txt\n";
+        }
+        
+        historyLog.lock(false);
+        snapshot.openSnapshot("typing_history.col");
         
-        for (size_t i = 0; i < maxLen; i++) {
-            if (i >= original.length() || i >= typed.length() || original[i] != typed[i]) {
-                errors++;
+        // Only records not yet folded into the snapshot are read from the log.
+        if (historyLog.readGeneration() > snapshot.logGeneration()) {
+            size_t skipped = history.load(historyLog);
+            if (skipped > 0) {
+                cout << "⚠️ Warning: Skipped " << skipped << " corrupted history records\n";
             }
         }
         
-        return errors;
+        catchUpStats(historyStats, snapshot, historyLog);
+        historyLog.unlock();
+        history.reserve(history.size() + 256);
     }
     
-    void displayDetailedComparison(const string& original, const string& typed) {
-        cout << "\n--- Character-by-Character Analysis ---\n";
-        cout << "Original: " << original << "\n";
-        cout << "Typed:    " << typed << "\n";
-        cout << "Match:    ";
-        
-        for (size_t i = 0; i < max(original.length(), typed.length()); i++) {
-            if (i < original.length() && i < typed.length() && original[i] == typed[i]) {
-                cout << "✓";
-            } else {
-                cout << "✗";
-            }
+    // The writer has already converted a legacy leaderboard.txt.
+    void loadLeaderboard() {
+        PROBE_SCOPE(Probe::LeaderboardLoad);
+        if (writer.migratedEntries() > 0) {
+            cout << "📦 Imported " << writer.migratedEntries() << " leaderboard entries from leaderboard.txt\n";
         }
-        cout << "\n";
+        leaderboard.load("leaderboard.dat");
     }
     
-    void displayRealTimeHighlight(const string& original, const string& typed) {
-        cout << "\n--- Real-Time Character Highlighting ---\n";
-        cout << "Legend: [Correct] (Wrong) _Missing_\n\n";
-        
-        for (size_t i = 0; i < original.length(); i++) {
-            if (i < typed.length()) {
-                if (original[i] == typed[i]) {
-                    cout << "\033[32m[" << original[i] << "]\033[0m";
-                } else {
-                    cout << "\033[31m(" << typed[i] << ")\033[0m";
-                }
-            } else {
-                cout << "\033[33m_" << original[i] << "_\033[0m";
-            }
+    void displayMenu() {
+        cout << "\n===========================================\n";
+        cout << "    ⌨️  TYPING SPEED CHECKER PRO ⌨️\n";
+        cout << "===========================================\n";
+        cout << "1. 🟢 Easy Mode\n";
+        cout << "2. 🟡 Medium Mode\n";
+        cout << "3. 🟠 Hard Mode\n";
+        cout << "4. 🔴 Expert Mode\n";
+        cout << "5. ⏱️  Timed Mode (15/30/60/120s)\n";
+        cout << "6. 📝 Custom Text Mode\n";
+        cout << "7. 📈 View History\n";
+        cout << "8. 🏆 View Leaderboard\n";
+        cout << "9. 🎯 Adaptive Drill\n";
+        cout << "0. 🚪 Exit\n";
+        cout << "===========================================\n";
+        cout << "Enter your choice: ";
+    }
+};
+
+// Position-by-position scoring used before alignment; kept as the baseline
+// for --bench-scoring.
+double positionalAccuracy(const string& original, const string& typed) {
+    int correct = 0;
+    int total = max(original.length(), typed.length());
+    
+    for (size_t i = 0; i < min(original.length(), typed.length()); i++) {
+        if (original[i] == typed[i]) {
+            correct++;
         }
-        
-        if (typed.length() > original.length()) {
-            cout << "\033[31m";
-            for (size_t i = original.length(); i < typed.length(); i++) {
-                cout << "+" << typed[i];
-            }
-            cout << "\033[0m";
+    }
+    
+    return total > 0 ? (double)correct / total * 100.0 : 0;
+}
+
+int positionalErrors(const string& original, const string& typed) {
+    int errors = 0;
+    size_t maxLen = max(original.length(), typed.length());
+    
+    for (size_t i = 0; i < maxLen; i++) {
+        if (i >= original.length() || i >= typed.length() || original[i] != typed[i]) {
+            errors++;
         }
-        cout << "\n";
     }
     
-    string selectText(int difficulty) {
-        srand(time(0));
-        vector<string>* texts;
-        
-        switch(difficulty) {
-            case 1: texts = &easyTexts; break;
-            case 2: texts = &mediumTexts; break;
-            case 3: texts = &hardTexts; break;
-            case 4: texts = &expertTexts; break;
-            default: texts = &mediumTexts;
+    return errors;
+}
+
+// Edit distance by the full quadratic DP, or in prefix mode the distance to
+// the closest prefix of the original; the reference for the banded scorer.
+int naiveDistance(const string& original, const string& typed, bool prefixOnly) {
+    vector<int> column(original.length() + 1), next(original.length() + 1);
+    for (size_t i = 0; i <= original.length(); i++) column[i] = (int)i;
+    for (size_t j = 1; j <= typed.length(); j++) {
+        next[0] = (int)j;
+        for (size_t i = 1; i <= original.length(); i++) {
+            next[i] = min({column[i] + 1, next[i - 1] + 1,
+                           column[i - 1] + (original[i - 1] == typed[j - 1] ? 0 : 1)});
         }
-        
-        return (*texts)[rand() % texts->size()];
+        swap(column, next);
     }
+    return prefixOnly ? *min_element(column.begin(), column.end()) : column.back();
+}
+
+// Times the positional scorer, the SIMD comparison kernel and the alignment
+// scorer on generated attempts with a skipped character near the start and
+// ~2% random typos, then checks attempts far from the original's length
+// against the full DP.
+int runScoringBenchmark() {
+    const char* words[] = {"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+                           "typing", "practice", "makes", "perfect", "speed", "accuracy"};
+    mt19937 rng(12345);
+    AlignmentScorer scorer;
     
-    void timedMode() {
-        cout << "\n===========================================\n";
-        cout << "      ⏱️  60-SECOND TIMED MODE ⏱️\n";
-        cout << "===========================================\n";
-        cout << "Type as much as you can in 60 seconds!\n";
-        cout << "The text will repeat if you finish early.\n\n";
-        
-        string practiceText = "The quick brown fox jumps over the lazy dog. ";
-        practiceText += "Practice makes perfect. ";
-        practiceText += "Keep typing to improve your speed. ";
-        practiceText += "Focus on accuracy and speed together. ";
-        
-        string fullText = "";
-        for (int i = 0; i < 20; i++) {
-            fullText += practiceText;
+    cout << "Compare kernel: " << compareKernel().name << "\n\n";
+    cout << left << setw(10) << "Bytes" << setw(18) << "Positional (us)" << setw(14) << "Kernel (us)"
+         << setw(18) << "Alignment (us)" << setw(16) << "Positional acc" << "Alignment acc\n";
+    cout << string(90, '-') << "\n";
+    
+    for (size_t length : {64, 256, 1024, 4096, 16384, 65536}) {
+        string original;
+        while (original.length() < length) {
+            original += words[rng() % 14];
+            original += ' ';
         }
+        original.resize(length);
         
-        cout << "Text to type (repeating):\n";
-        cout << "\"" << practiceText << "\"\n\n";
-        cout << "Press ENTER to start the 60-second timer...\n";
-        cin.ignore();
-        
-        cout << "\n⏱️  START TYPING NOW! You have 60 seconds! ⏱️\n\n";
+        string typed = original;
+        typed.erase(min<size_t>(5, typed.length() - 1), 1);
+        for (size_t i = 0; i < typed.length(); i++) {
+            if (rng() % 50 == 0) typed[i] = 'a' + rng() % 26;
+        }
         
-        auto startTime = chrono::high_resolution_clock::now();
-        auto endTime = startTime + chrono::seconds(60);
+        auto timeIt = [](auto&& fn) {
+            int iterations = 0;
+            auto start = chrono::steady_clock::now();
+            chrono::duration<double> elapsed{0};
+            do {
+                fn();
+                iterations++;
+                elapsed = chrono::steady_clock::now() - start;
+            } while (elapsed.count() < 0.2);
+            return elapsed.count() * 1e6 / iterations;
+        };
         
-        string typedText = "";
-        cout << "Type here: ";
+        volatile double sink = 0;
+        double positionalUs = timeIt([&] {
+            sink = positionalAccuracy(original, typed) + positionalErrors(original, typed);
+        });
+        double kernelUs = timeIt([&] {
+            sink = compareText(original, typed).errors();
+        });
+        double alignmentUs = timeIt([&] {
+            sink = scorer.align(original, typed).accuracy();
+        });
         
-        while (chrono::high_resolution_clock::now() < endTime) {
-            if (cin.peek() != EOF) {
-                getline(cin, typedText);
-                break;
+        cout << left << setw(10) << length << fixed << setprecision(2)
+             << setw(18) << positionalUs << setw(14) << kernelUs << setw(18) << alignmentUs
+             << setw(16) << positionalAccuracy(original, typed)
+             << scorer.align(original, typed).accuracy() << "\n";
+    }
+    
+    string original;
+    while (original.length() < 3000) {
+        original += words[rng() % 14];
+        original += ' ';
+    }
+    original.resize(3000);
+    string typoed = original;
+    typoed[100] = '#';
+    typoed[200] = '#';
+    string extra;
+    for (int i = 0; i < 1500; i++) extra += 'a' + rng() % 26;
+    
+    cout << "\nUnequal lengths against the full DP (3000-byte original, 2 typos):\n";
+    int mismatches = 0;
+    for (const string& typed : {typoed.substr(0, 1500), typoed.substr(0, 2500), typoed + extra}) {
+        for (bool prefixOnly : {false, true}) {
+            AlignmentResult result = scorer.align(original, typed, prefixOnly);
+            int distance = result.substitutions + result.insertions + result.deletions;
+            int exact = naiveDistance(original, typed, prefixOnly);
+            if (distance != exact) mismatches++;
+            cout << "  " << setw(6) << typed.length() << (prefixOnly ? " prefix " : " full   ")
+                 << "distance " << setw(6) << distance << " exact " << setw(6) << exact
+                 << (distance == exact ? " ✅\n" : " ❌\n");
+        }
+    }
+    
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Fixed set of worker threads, each owning a deque of index ranges. Workers
+// take from the back of their own deque and steal from the front of others'
+// once it runs dry, so uneven record costs still balance across cores.
+class WorkStealingPool {
+private:
+    struct WorkQueue {
+        mutex lock;
+        deque<pair<size_t, size_t>> ranges;
+    };
+
+    size_t threadCount;
+    vector<unique_ptr<WorkQueue>> queues;
+    atomic<size_t> steals{0};
+
+    bool takeOwn(size_t worker, pair<size_t, size_t>& range) {
+        WorkQueue& queue = *queues[worker];
+        lock_guard<mutex> guard(queue.lock);
+        if (queue.ranges.empty()) return false;
+        range = queue.ranges.back();
+        queue.ranges.pop_back();
+        return true;
+    }
+
+    bool steal(size_t worker, pair<size_t, size_t>& range) {
+        for (size_t k = 1; k < threadCount; k++) {
+            WorkQueue& victim = *queues[(worker + k) % threadCount];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.ranges.empty()) {
+                range = victim.ranges.front();
+                victim.ranges.pop_front();
+                steals++;
+                return true;
             }
         }
-        
-        auto actualEndTime = chrono::high_resolution_clock::now();
-        chrono::duration<double> elapsed = actualEndTime - startTime;
-        double timeTaken = min(elapsed.count(), 60.0);
-        
-        string textToCompare = fullText.substr(0, typedText.length());
-        double accuracy = calculateAccuracy(textToCompare, typedText);
-        int correctChars = 0;
-        
-        for (size_t i = 0; i < min(textToCompare.length(), typedText.length()); i++) {
-            if (textToCompare[i] == typedText[i]) {
-                correctChars++;
+        return false;
+    }
+
+public:
+    explicit WorkStealingPool(size_t threads) : threadCount(max<size_t>(1, threads)) {
+        for (size_t i = 0; i < threadCount; i++) {
+            queues.push_back(make_unique<WorkQueue>());
+        }
+    }
+
+    size_t size() const { return threadCount; }
+    size_t stealCount() const { return steals; }
+
+    // Calls fn(worker, begin, end) over [0, count) in chunks of chunkSize.
+    // Each worker starts with a contiguous share; no work is added while
+    // running, so a worker that finds every deque empty is done.
+    template <typename Fn>
+    void run(size_t count, size_t chunkSize, Fn fn) {
+        size_t share = (count + threadCount - 1) / threadCount;
+        for (size_t w = 0; w < threadCount; w++) {
+            size_t end = min(count, (w + 1) * share);
+            for (size_t begin = w * share; begin < end; begin += chunkSize) {
+                queues[w]->ranges.emplace_back(begin, min(end, begin + chunkSize));
             }
+            // Own work is taken from the back; start with the lowest indices.
+            reverse(queues[w]->ranges.begin(), queues[w]->ranges.end());
+        }
+
+        auto work = [&](size_t worker) {
+            pair<size_t, size_t> range;
+            while (takeOwn(worker, range) || steal(worker, range)) {
+                fn(worker, range.first, range.second);
+            }
+        };
+
+        vector<thread> workers;
+        for (size_t w = 1; w < threadCount; w++) {
+            workers.emplace_back(work, w);
+        }
+        work(0);
+        for (auto& t : workers) {
+            t.join();
         }
-        
-        double wpm = calculateWPM(correctChars, timeTaken);
-        int errors = countErrors(textToCompare, typedText);
-        
-        TypingStats stats;
-        stats.name = currentUser;
-        stats.wpm = wpm;
-        stats.accuracy = accuracy;
-        stats.time = timeTaken;
-        stats.correctChars = correctChars;
-        stats.totalChars = typedText.length();
-        stats.errors = errors;
-        stats.difficulty = "Timed-60s";
-        stats.date = getCurrentDate();
-        
-        history.push_back(stats);
-        updateLeaderboard(stats);
-        
-        displayResults(stats);
-        displayPerformanceAnalysis(stats);
     }
-    
-    void customTextMode() {
-        cout << "\n===========================================\n";
-        cout << "      📝 CUSTOM TEXT MODE 📝\n";
-        cout << "===========================================\n";
-        cout << "Enter your custom text to practice:\n";
-        cout << "(Press ENTER twice when done)\n\n";
-        
-        cin.ignore();
-        string customText;
-        string line;
-        
-        while (getline(cin, line) && !line.empty()) {
-            customText += line + " ";
+};
+
+// Totals of rows [begin, end). Each sum is its own reduction over one or two
+// columns; std::reduce may regroup the additions, which the library uses to
+// break the dependency chain. A chunk fits in cache, so only the first pass
+// over it reads memory.
+template <typename Real>
+HistoryTotals sumHistoryColumns(const Real* wpm, const Real* accuracy, const Real* time, size_t begin, size_t end) {
+    auto ifValid = [](Real w, Real value) { return w > 0 ? double(value) : 0.0; };
+    HistoryTotals totals;
+    totals.tests = end - begin;
+    totals.valid = transform_reduce(wpm + begin, wpm + end, uint64_t(0), plus<>(),
+                                    [](Real w) { return uint64_t(w > 0); });
+    totals.sumWpm = transform_reduce(wpm + begin, wpm + end, 0.0, plus<>(),
+                                     [](Real w) { return w > 0 ? double(w) : 0.0; });
+    totals.sumAccuracy = transform_reduce(wpm + begin, wpm + end, accuracy + begin, 0.0, plus<>(), ifValid);
+    totals.sumTime = transform_reduce(wpm + begin, wpm + end, time + begin, 0.0, plus<>(), ifValid);
+    totals.bestWpm = reduce(wpm + begin, wpm + end, Real(0), [](Real a, Real b) { return max(a, b); });
+    return totals;
+}
+
+// Totals of the first `rows` rows, in 64K-row chunks spread over `threads`
+// workers. Each worker folds its chunks into its own partial; the partials
+// are combined at the end.
+template <typename Real>
+HistoryTotals scanHistoryTotals(const Real* wpm, const Real* accuracy, const Real* time, size_t rows, size_t threads) {
+    WorkStealingPool pool(threads);
+    vector<HistoryTotals> partial(pool.size());
+    pool.run(rows, 1 << 16, [&](size_t worker, size_t begin, size_t end) {
+        partial[worker].merge(sumHistoryColumns(wpm, accuracy, time, begin, end));
+    });
+    return reduce(partial.begin(), partial.end(), HistoryTotals(), [](HistoryTotals a, const HistoryTotals& b) {
+        a.merge(b);
+        return a;
+    });
+}
+
+// One attempt to re-score: views into the mapped input file.
+struct BatchRecord {
+    string_view original;
+    string_view typed;
+    double seconds;
+    string_view name;
+    string_view difficulty;
+    string_view date;
+};
+
+// Splits the batch input into records. Each line is tab-separated:
+// original, typed, seconds[, name, difficulty, date]. Malformed lines are
+// counted and skipped.
+vector<BatchRecord> parseBatchInput(string_view input, size_t& skipped) {
+    vector<BatchRecord> records;
+    records.reserve(input.length() / 64);
+    skipped = 0;
+
+    while (!input.empty()) {
+        size_t eol = input.find('\n');
+        string_view line = input.substr(0, eol);
+        input.remove_prefix(eol == string_view::npos ? input.length() : eol + 1);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) continue;
+
+        string_view fields[6];
+        int count = 0;
+        while (count < 6) {
+            size_t tab = line.find('\t');
+            fields[count++] = line.substr(0, tab);
+            if (tab == string_view::npos) break;
+            line.remove_prefix(tab + 1);
         }
-        
-        if (customText.empty()) {
-            cout << "❌ No text entered. Returning to menu.\n";
+        if (count < 3) {
+            skipped++;
+            continue;
+        }
+
+        char number[32];
+        size_t len = min(fields[2].length(), sizeof(number) - 1);
+        memcpy(number, fields[2].data(), len);
+        number[len] = '\0';
+        char* end = nullptr;
+        double seconds = strtod(number, &end);
+        if (end == number) {
+            skipped++;
+            continue;
+        }
+
+        records.push_back({fields[0], fields[1], seconds, fields[3], fields[4], fields[5]});
+    }
+
+    return records;
+}
+
+// Re-scores recorded attempts with the current rules across all cores and
+// writes the results as history lines (importable with --import-history).
+int runBatchScoring(const string& inputPath, const string& outputPath, size_t threads) {
+    int fd = open(inputPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cout << "❌ Could not read " << inputPath << "\n";
+        return 1;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t inputSize = st.st_size;
+    void* mapped = inputSize > 0 ? mmap(nullptr, inputSize, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        cout << "❌ Could not map " << inputPath << "\n";
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    size_t skipped = 0;
+    vector<BatchRecord> records = parseBatchInput(
+        string_view(static_cast<const char*>(mapped), inputSize), skipped);
+    vector<TypingStats> results(records.size());
+    string defaultDate = formatDate(time(0));
+
+    WorkStealingPool pool(threads);
+    vector<AlignmentScorer> scorers(pool.size());
+    pool.run(records.size(), 256, [&](size_t worker, size_t begin, size_t end) {
+        AlignmentScorer& scorer = scorers[worker];
+        for (size_t i = begin; i < end; i++) {
+            const BatchRecord& record = records[i];
+            AlignmentResult score = scorer.score(record.original, record.typed);
+            TimingCheck check;
+
+            TypingStats& stats = results[i];
+            stats.name = record.name.empty() ? "batch" : string(record.name);
+            stats.wpm = wpmFor(score.matches, record.seconds, check);
+            stats.accuracy = score.accuracy();
+            stats.time = record.seconds;
+            stats.correctChars = score.matches;
+            stats.totalChars = score.typedLength();
+            stats.errors = score.distance();
+            stats.difficulty = record.difficulty.empty() ? "Batch" : string(record.difficulty);
+            stats.date = record.date.empty() ? defaultDate : string(record.date);
+        }
+    });
+
+    auto scored = chrono::steady_clock::now();
+
+    // Results go out in one buffer, in input order.
+    string out;
+    out.reserve(results.size() * 80);
+    char line[128];
+    for (const auto& stats : results) {
+        out += stats.name;
+        snprintf(line, sizeof(line), "|%g|%g|%g|%d|%d|%d|", stats.wpm, stats.accuracy, stats.time,
+                 stats.correctChars, stats.totalChars, stats.errors);
+        out += line;
+        out += stats.difficulty;
+        out += '|';
+        out += stats.date;
+        out += '\n';
+    }
+
+    bool written = false;
+    int outFd = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outFd >= 0) {
+        written = write(outFd, out.data(), out.size()) == (ssize_t)out.size();
+        close(outFd);
+    }
+    if (mapped) munmap(mapped, inputSize);
+
+    chrono::duration<double> scoreTime = scored - start;
+    chrono::duration<double> totalTime = chrono::steady_clock::now() - start;
+    double rate = scoreTime.count() > 0 ? results.size() / scoreTime.count() : 0;
+
+    cout << "✅ Scored " << results.size() << " records (" << skipped << " malformed skipped) on "
+         << pool.size() << " threads, " << pool.stealCount() << " steals\n";
+    cout << fixed << setprecision(0) << "⚡ " << rate << " records/sec scoring, "
+         << setprecision(3) << totalTime.count() << "s total\n";
+    if (!written) {
+        cout << "❌ Could not write " << outputPath << "\n";
+        return 1;
+    }
+    cout << "📝 Results written to " << outputPath << "\n";
+    return 0;
+}
+
+// Turns the probes on for its lifetime. With --stats it prints each probe's
+// latency distribution on the way out. With --trace it also writes every
+// timed span as Chrome trace JSON, for chrome://tracing or ui.perfetto.dev.
+// main creates it before the checker, so the checker's saves on exit are
+// measured too.
+class ProbeReport {
+private:
+    bool printStats;
+    string tracePath;
+    uint64_t startTicks = 0;
+    chrono::steady_clock::time_point startTime;
+
+    static string formatNanos(double nanos) {
+        char text[32];
+        if (nanos < 1e3) snprintf(text, sizeof(text), "%.0f ns", nanos);
+        else if (nanos < 1e6) snprintf(text, sizeof(text), "%.1f us", nanos / 1e3);
+        else if (nanos < 1e9) snprintf(text, sizeof(text), "%.1f ms", nanos / 1e6);
+        else snprintf(text, sizeof(text), "%.2f s", nanos / 1e9);
+        return text;
+    }
+
+    // Upper end of the bucket holding the q-th quantile, capped at the maximum.
+    static uint64_t quantileTicks(const vector<uint64_t>& buckets, uint64_t samples, uint64_t maxTicks, double q) {
+        uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(q * samples));
+        uint64_t seen = 0;
+        for (int b = 0; b + 1 < ProbeHistogram::bucketCount; b++) {
+            seen += buckets[b];
+            if (seen >= rank) return min(ProbeHistogram::lowerBound(b + 1) - 1, maxTicks);
+        }
+        return maxTicks;
+    }
+
+    void printProbes(double ticksPerNano, double seconds) const {
+        size_t threads = 0;
+        for (ThreadProbes* t = probeThreads.load(memory_order_acquire); t; t = t->next) threads++;
+
+        cout << "\n📊 Probe statistics (" << threads << " thread" << (threads == 1 ? "" : "s") << ", "
+             << fixed << setprecision(1) << seconds << "s)\n";
+        cout << left << setw(18) << "Probe" << right << setw(10) << "Count" << setw(11) << "Mean"
+             << setw(11) << "p50" << setw(11) << "p99" << setw(11) << "Max" << setw(11) << "Total" << "\n";
+
+        for (size_t p = 0; p < (size_t)Probe::Count; p++) {
+            vector<uint64_t> buckets(ProbeHistogram::bucketCount);
+            uint64_t samples = 0, total = 0, maxTicks = 0;
+            for (ThreadProbes* t = probeThreads.load(memory_order_acquire); t; t = t->next) {
+                const ProbeHistogram& h = t->histograms[p];
+                for (int b = 0; b < ProbeHistogram::bucketCount; b++) {
+                    buckets[b] += h.buckets[b].load(memory_order_relaxed);
+                }
+                samples += h.samples.load(memory_order_relaxed);
+                total += h.totalTicks.load(memory_order_relaxed);
+                maxTicks = max(maxTicks, h.maxTicks.load(memory_order_relaxed));
+            }
+            if (samples == 0) continue;
+
+            cout << left << setw(18) << probeNames[p] << right << setw(10) << samples
+                 << setw(11) << formatNanos(total / ticksPerNano / samples)
+                 << setw(11) << formatNanos(quantileTicks(buckets, samples, maxTicks, 0.50) / ticksPerNano)
+                 << setw(11) << formatNanos(quantileTicks(buckets, samples, maxTicks, 0.99) / ticksPerNano)
+                 << setw(11) << formatNanos(maxTicks / ticksPerNano)
+                 << setw(11) << formatNanos(total / ticksPerNano) << "\n";
+        }
+
+        for (size_t c = 0; c < (size_t)Counter::Count; c++) {
+            uint64_t total = 0;
+            for (ThreadProbes* t = probeThreads.load(memory_order_acquire); t; t = t->next) {
+                total += t->counters[c].load(memory_order_relaxed);
+            }
+            if (total > 0) cout << left << setw(28) << counterNames[c] << right << setw(10) << total << "\n";
+        }
+        cout << left;
+    }
+
+    void writeTrace(double ticksPerNano) const {
+        ofstream out(tracePath);
+        if (!out.is_open()) {
+            cout << "❌ Error: Cannot write " << tracePath << "\n";
             return;
         }
-        
-        cout << "\nYour custom text:\n\"" << customText << "\"\n\n";
-        cout << "Press ENTER when ready to start...\n";
-        cin.get();
-        
-        cout << "\n⏱️  START TYPING NOW! ⏱️\n\n";
-        
-        auto startTime = chrono::high_resolution_clock::now();
-        string typedText;
-        getline(cin, typedText);
-        auto endTime = chrono::high_resolution_clock::now();
-        
-        chrono::duration<double> elapsed = endTime - startTime;
-        double timeTaken = elapsed.count();
-        
-        double accuracy = calculateAccuracy(customText, typedText);
-        int correctChars = 0;
-        
-        for (size_t i = 0; i < min(customText.length(), typedText.length()); i++) {
-            if (customText[i] == typedText[i]) {
-                correctChars++;
+
+        long pid = (long)getpid();
+        size_t spans = 0;
+        uint64_t dropped = 0;
+        char line[256];
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        const char* separator = "\n";
+        for (ThreadProbes* t = probeThreads.load(memory_order_acquire); t; t = t->next) {
+            snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,"
+                     "\"args\":{\"name\":\"thread %u\"}}", separator, pid, t->threadId, t->threadId);
+            out << line;
+            separator = ",\n";
+
+            size_t length = t->traceLength.load(memory_order_acquire);
+            for (size_t i = 0; i < length; i++) {
+                const TraceEvent& e = t->trace[i];
+                double start = e.start > startTicks ? (e.start - startTicks) / ticksPerNano / 1e3 : 0;
+                snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%ld,"
+                         "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", probeNames[(size_t)e.probe],
+                         probeCategories[(size_t)e.probe], pid, t->threadId, start, e.ticks / ticksPerNano / 1e3);
+                out << line;
+            }
+            spans += length;
+            dropped += t->traceDropped.load(memory_order_relaxed);
+        }
+        out << "\n]}\n";
+
+        cout << "🧭 Wrote " << spans << " spans to " << tracePath;
+        if (dropped > 0) cout << " (" << dropped << " dropped after the per-thread limit)";
+        cout << "\n";
+    }
+
+public:
+    ProbeReport(bool stats, const string& trace) : printStats(stats), tracePath(trace) {
+        if (!printStats && tracePath.empty()) return;
+#ifdef TYPING_SPEED_NO_PROBES
+        cout << "⚠️ Built with TYPING_SPEED_NO_PROBES, nothing will be measured\n";
+#endif
+        startTime = chrono::steady_clock::now();
+        startTicks = probeTicks();
+        probesTracing.store(!tracePath.empty());
+        probesEnabled.store(true);
+    }
+
+    ~ProbeReport() {
+        if (!probesEnabled.load()) return;
+        probesEnabled.store(false);
+
+        uint64_t ticks = probeTicks() - startTicks;
+        double nanos = chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count();
+        double ticksPerNano = nanos > 0 && ticks > 0 ? ticks / nanos : 1;
+
+        if (printStats) printProbes(ticksPerNano, nanos / 1e9);
+        if (!tracePath.empty()) writeTrace(ticksPerNano);
+    }
+
+    ProbeReport(const ProbeReport&) = delete;
+    ProbeReport& operator=(const ProbeReport&) = delete;
+};
+
+void printUsage(const char* program) {
+    cout << "Usage: " << program << " [options]\n";
+    cout << "  --corpus FILE          practice texts to draw passages from (default texts.txt)\n";
+    cout << "  --fsync-every N        fsync the history log after every N tests\n";
+    cout << "  --words FILE           word list for adaptive drills (default words.txt)\n";
+    cout << "  --bench-drill          time drill generation over the word list\n";
+    cout << "  --top N                entries kept per leaderboard board (default 10)\n";
+    cout << "  --rebuild-leaderboard  refill the leaderboard from the full history\n";
+    cout << "  --compact              fold the history log into the columnar snapshot\n";
+    cout << "  --import-history FILE  append a pipe-delimited history file to the log\n";
+    cout << "  --bench-scoring        compare positional and alignment scoring speed\n";
+    cout << "  --batch-score FILE     re-score tab-separated (original, typed, seconds) records\n";
+    cout << "    --out FILE           where to write the scored history (default batch_results.txt)\n";
+    cout << "    --threads N          worker threads (default: all cores)\n";
+    cout << "  --scan-history         total the full history with the parallel column scan\n";
+    cout << "  --query                filter the full history through its date and user indexes\n";
+    cout << "    --user NAME          only NAME's tests\n";
+    cout << "    --difficulty NAME    only tests at this difficulty (e.g. Expert, Timed-60s)\n";
+    cout << "    --from / --to DATE   first and last day, YYYY-MM-DD\n";
+    cout << "    --days N             only the last N days\n";
+    cout << "    --group day|week     break the totals down per day or week\n";
+    cout << "  --serve                run the leaderboard daemon on the socket\n";
+    cout << "  --connect              submit results to the daemon instead of local files\n";
+    cout << "  --socket PATH          daemon socket (default leaderboard.sock)\n";
+    cout << "  --load-test CLIENTS    time submits from many concurrent daemon clients\n";
+    cout << "    --requests N         submits per client (default 100)\n";
+    cout << "  --race-hub             run a race hub on the socket (default race.sock)\n";
+    cout << "    --racers N           racers per race (default 2)\n";
+    cout << "    --level N            passage difficulty, 1-4 (default 2)\n";
+    cout << "  --race                 join a race on the hub before the menu\n";
+    cout << "  --race-bench SECONDS   time update delivery with --racers simulated racers\n";
+    cout << "  --recordings           list recorded tests (typing_sessions.rec)\n";
+    cout << "    --user NAME          only NAME's recordings\n";
+    cout << "  --replay N             replay recording N through the live view\n";
+    cout << "    --speed X            playback speed, 0 = instant (default 1)\n";
+    cout << "    --seek K             start after keystroke K\n";
+    cout << "  --rescore-recordings   re-score every recording with the current rules\n";
+    cout << "  --audit-recordings     re-run the keystroke timing checks over every recording\n";
+    cout << "  --stats                print hot-path latency statistics on exit\n";
+    cout << "  --trace FILE           write hot-path timings as Chrome trace JSON on exit\n";
+    cout << "  --help                 show this message\n";
+}
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+    stopRequested = 1;
+}
+
+int runServer(const string& socketPath, size_t topK, int fsyncEvery) {
+    raiseDescriptorLimit();
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction action = {};
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    LeaderboardServer server(socketPath, topK);
+    server.setFsyncEvery(fsyncEvery);
+    if (!server.start()) {
+        cout << "❌ Could not listen on " << socketPath << " (is a daemon already running?)\n";
+        return 1;
+    }
+    cout << "🌐 Serving the leaderboard on " << socketPath << " (Ctrl+C to stop)\n";
+    server.run(stopRequested);
+    cout << "\n✅ Served " << server.submitCount() << " submits (" << server.flaggedCount() << " not ranked) and "
+         << server.queryCount() << " queries; leaderboard saved\n";
+    return 0;
+}
+
+// Opens clients connections to the daemon at once; each submits requests
+// results back to back, and every round trip is timed. Results land in the
+// daemon's history and leaderboard, so point it at a scratch directory.
+int runLoadTest(const string& socketPath, size_t clients, size_t requests) {
+    raiseDescriptorLimit();
+    signal(SIGPIPE, SIG_IGN);
+
+    struct Client {
+        int fd = -1;
+        string in;
+        string out;
+        size_t sent = 0;
+        size_t done = 0;
+        chrono::steady_clock::time_point started;
+    };
+
+    const char* levels[] = {"Easy", "Medium", "Hard", "Expert"};
+    mt19937 rng(11);
+    vector<string> payloads;
+    KeystrokeRing keys(200);
+    for (int i = 0; i < 256; i++) {
+        TypingStats stats = {"load-" + to_string(i % 64), 20 + (rng() % 10000) / 100.0, 90.0 + rng() % 10,
+                             30, 150, 160, 10, levels[i % 4], "2026-10-17 12:00:00"};
+        // Unevenly spaced keys, 80-180 ms apart, so the daemon's timing checks pass.
+        keys.clear();
+        int64_t nanos = 0;
+        for (int k = 0; k < 160; k++) {
+            nanos += (80 + rng() % 100) * 1000000LL;
+            keys.push({nanos, (uint32_t)('a' + rng() % 26), KeyKind::Character});
+        }
+        keys.push({nanos, 0, KeyKind::Enter});
+        payloads.push_back(encodeSubmit(stats, keys));
+    }
+
+    EventPoller poller;
+    vector<Client> pool;
+    unordered_map<int, size_t> byFd;
+    for (size_t i = 0; i < clients; i++) {
+        int fd = connectUnix(socketPath);
+        if (fd < 0) {
+            cout << "❌ Could not open client " << i + 1 << " to " << socketPath << "\n";
+            for (auto& c : pool) close(c.fd);
+            return 1;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        poller.watch(fd, false);
+        byFd[fd] = pool.size();
+        pool.emplace_back();
+        pool.back().fd = fd;
+    }
+
+    auto send = [&](Client& c) {
+        if (c.sent == c.out.size()) {
+            c.out.clear();
+            c.sent = 0;
+        }
+        appendFrame(c.out, MessageType::Submit, c.done + 1, payloads[rng() % payloads.size()]);
+        c.started = chrono::steady_clock::now();
+        ssize_t n = write(c.fd, c.out.data() + c.sent, c.out.size() - c.sent);
+        if (n > 0) c.sent += n;
+        if (c.sent < c.out.size()) poller.modify(c.fd, true);
+    };
+
+    vector<double> micros;
+    micros.reserve(clients * requests);
+    size_t active = clients, failed = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto& c : pool) send(c);
+
+    while (active > 0) {
+        int n = poller.wait(5000, [&](int fd, bool readable, bool writable) {
+            Client& c = pool[byFd[fd]];
+            if (c.fd < 0) return;
+            if (writable && c.sent < c.out.size()) {
+                ssize_t written = write(fd, c.out.data() + c.sent, c.out.size() - c.sent);
+                if (written > 0) c.sent += written;
+                if (c.sent == c.out.size()) poller.modify(fd, false);
+            }
+            if (!readable) return;
+
+            char buffer[4096];
+            ssize_t got = read(fd, buffer, sizeof(buffer));
+            if (got > 0) c.in.append(buffer, got);
+            bool closed = got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+
+            const size_t replySize = sizeof(FrameHeader) + sizeof(SubmitReplyBody);
+            while (c.in.size() >= replySize) {
+                FrameHeader h;
+                memcpy(&h, c.in.data(), sizeof(h));
+                c.in.erase(0, sizeof(h) + h.length);
+                if (h.type != (uint8_t)MessageType::SubmitReply) failed++;
+                micros.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - c.started).count());
+                if (++c.done < requests) send(c);
+            }
+            if (closed || c.done >= requests) {
+                failed += requests - c.done;
+                poller.remove(fd);
+                close(fd);
+                c.fd = -1;
+                active--;
+            }
+        });
+        if (n <= 0) break;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (auto& c : pool) {
+        if (c.fd >= 0) close(c.fd);
+    }
+
+    if (micros.empty()) {
+        cout << "❌ No replies from " << socketPath << "\n";
+        return 1;
+    }
+    sort(micros.begin(), micros.end());
+    auto at = [&](double q) { return micros[min(micros.size() - 1, size_t(q * micros.size()))]; };
+    cout << "Clients: " << clients << " | submits: " << micros.size() << " (" << failed << " failed) in "
+         << fixed << setprecision(2) << seconds << " s = " << setprecision(0) << micros.size() / seconds
+         << " submits/s\n";
+    cout << "Submit latency: p50 " << setprecision(1) << at(0.5) << " µs, p99 " << at(0.99)
+         << " µs, p99.9 " << at(0.999) << " µs, max " << micros.back() << " µs\n";
+    return failed > 0 ? 1 : 0;
+}
+
+int runRaceHub(const string& socketPath, size_t racers, int difficulty, const string& corpusPath) {
+    raiseDescriptorLimit();
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction action = {};
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    RaceHub hub(socketPath, racers, difficulty, corpusPath.empty() ? "texts.txt" : corpusPath);
+    if (!hub.start()) {
+        cout << "❌ Could not listen on " << socketPath << " (is a hub already running?)\n";
+        return 1;
+    }
+    cout << "🏁 Race hub on " << socketPath << ": races start with " << racers << " racers (Ctrl+C to stop)\n";
+    hub.run(stopRequested);
+    cout << "\n✅ Ran " << hub.raceCount() << " races: " << hub.progressCount() << " progress updates in "
+         << hub.broadcastCount() << " broadcasts\n";
+    return 0;
+}
+
+// Joins racers simulated racers to the hub (started with the same --racers),
+// each reporting progress every 100-200 ms like a fast typist. Every racer
+// times how long each other racer's update took to reach it.
+int runRaceBenchmark(const string& socketPath, size_t racers, double seconds) {
+    raiseDescriptorLimit();
+    signal(SIGPIPE, SIG_IGN);
+
+    struct Racer {
+        int fd = -1;
+        string in;
+        uint16_t id = 0;
+        uint32_t seq = 0;
+        uint32_t typed = 0;
+        chrono::steady_clock::time_point nextSend;
+        bool over = false;
+    };
+
+    vector<Racer> pool(racers);
+    for (size_t i = 0; i < racers; i++) {
+        pool[i].fd = connectUnix(socketPath);
+        string frame;
+        appendFrame(frame, MessageType::Join, 0, "bench-" + to_string(i));
+        if (pool[i].fd < 0 || write(pool[i].fd, frame.data(), frame.size()) != (ssize_t)frame.size()) {
+            cout << "❌ Could not join racer " << i + 1 << " to " << socketPath << "\n";
+            for (auto& r : pool) {
+                if (r.fd >= 0) close(r.fd);
+            }
+            return 1;
+        }
+    }
+
+    // Blocking reads until each racer has its RaceStart.
+    size_t passageLength = 0, racerCount = 0;
+    for (auto& r : pool) {
+        while (true) {
+            char buffer[16384];
+            ssize_t n = read(r.fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                cout << "❌ The hub closed the lobby (is it running with --racers " << racers << "?)\n";
+                return 1;
             }
+            r.in.append(buffer, n);
+            FrameHeader h;
+            if (r.in.size() < sizeof(h)) continue;
+            memcpy(&h, r.in.data(), sizeof(h));
+            if (r.in.size() < sizeof(h) + h.length) continue;
+            RaceStartHeader start;
+            memcpy(&start, r.in.data() + sizeof(h), sizeof(start));
+            r.id = start.racerId;
+            passageLength = start.passageLength;
+            racerCount = start.racerCount;
+            r.in.erase(0, sizeof(h) + h.length);
+            break;
         }
-        
-        double wpm = calculateWPM(correctChars, timeTaken);
-        int errors = countErrors(customText, typedText);
-        
-        TypingStats stats;
-        stats.name = currentUser;
-        stats.wpm = wpm;
-        stats.accuracy = accuracy;
-        stats.time = timeTaken;
-        stats.correctChars = correctChars;
-        stats.totalChars = typedText.length();
-        stats.errors = errors;
-        stats.difficulty = "Custom";
-        stats.date = getCurrentDate();
-        
-        history.push_back(stats);
-        updateLeaderboard(stats);
-        
-        displayResults(stats);
-        displayRealTimeHighlight(customText, typedText);
-        displayPerformanceAnalysis(stats);
     }
-    
-    void startTest(int difficulty, string& difficultyLevel) {
-        string originalText = selectText(difficulty);
-        
-        switch(difficulty) {
-            case 1: difficultyLevel = "Easy"; break;
-            case 2: difficultyLevel = "Medium"; break;
-            case 3: difficultyLevel = "Hard"; break;
-            case 4: difficultyLevel = "Expert"; break;
+
+    // sentAt[racer id][seq] for every progress message sent; other clients in
+    // the race are in the table but never send.
+    vector<vector<chrono::steady_clock::time_point>> sentAt(racerCount);
+    mt19937 rng(5);
+    auto start = chrono::steady_clock::now();
+    EventPoller poller;
+    for (auto& r : pool) {
+        fcntl(r.fd, F_SETFL, fcntl(r.fd, F_GETFL) | O_NONBLOCK);
+        poller.watch(r.fd, false);
+        r.nextSend = start + chrono::milliseconds(rng() % 200);
+    }
+    unordered_map<int, size_t> byFd;
+    for (size_t i = 0; i < racers; i++) byFd[pool[i].fd] = i;
+
+    vector<double> micros;
+    size_t broadcastsSeen = 0, active = racers;
+    bool finishing = false;
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    while (active > 0) {
+        auto now = chrono::steady_clock::now();
+        if (!finishing && now >= deadline) {
+            finishing = true;
+            for (auto& r : pool) {
+                RaceFinish f = {r.typed, r.typed, 90.0f, 100.0f};
+                string frame;
+                appendFrame(frame, MessageType::Finish, 0, string_view(reinterpret_cast<const char*>(&f), sizeof(f)));
+                ssize_t ignored = write(r.fd, frame.data(), frame.size());
+                (void)ignored;
+            }
         }
-        
-        cout << "\n===========================================\n";
-        cout << "  Difficulty: " << difficultyLevel << "\n";
-        cout << "===========================================\n\n";
-        cout << "Type the following text:\n\n";
-        cout << "\"" << originalText << "\"\n\n";
-        cout << "Character count: " << originalText.length() << "\n";
-        cout << "\nPress ENTER when ready to start...\n";
-        cin.ignore();
-        
-        cout << "\n⏱️  START TYPING NOW! ⏱️\n\n";
-        
-        auto startTime = chrono::high_resolution_clock::now();
-        string typedText;
-        getline(cin, typedText);
-        auto endTime = chrono::high_resolution_clock::now();
-        
-        chrono::duration<double> elapsed = endTime - startTime;
-        double timeTaken = elapsed.count();
-        
-        cout << "\n⏱️ Time measured: " << fixed << setprecision(2) << timeTaken << " seconds\n";
-        
-        double accuracy = calculateAccuracy(originalText, typedText);
-        int correctChars = 0;
-        
-        for (size_t i = 0; i < min(originalText.length(), typedText.length()); i++) {
-            if (originalText[i] == typedText[i]) {
-                correctChars++;
+        auto nextSend = deadline;
+        if (!finishing) {
+            for (auto& r : pool) {
+                if (r.nextSend <= now) {
+                    r.typed = min<uint32_t>(r.typed + 1 + rng() % 3, passageLength);
+                    RaceProgress p = {r.typed, r.typed, 90.0f, ++r.seq};
+                    string frame;
+                    appendFrame(frame, MessageType::Progress, 0, string_view(reinterpret_cast<const char*>(&p), sizeof(p)));
+                    sentAt[r.id].push_back(chrono::steady_clock::now());
+                    ssize_t ignored = write(r.fd, frame.data(), frame.size());
+                    (void)ignored;
+                    r.nextSend = now + chrono::milliseconds(100 + rng() % 100);
+                }
+                nextSend = min(nextSend, r.nextSend);
             }
         }
-        
-        double wpm = calculateWPM(correctChars, timeTaken);
-        int errors = countErrors(originalText, typedText);
-        
-        TypingStats stats;
-        stats.name = currentUser;
-        stats.wpm = wpm;
-        stats.accuracy = accuracy;
-        stats.time = timeTaken;
-        stats.correctChars = correctChars;
-        stats.totalChars = typedText.length();
-        stats.errors = errors;
-        stats.difficulty = difficultyLevel;
-        stats.date = getCurrentDate();
-        
-        history.push_back(stats);
-        updateLeaderboard(stats);
-        
-        displayResults(stats);
-        displayRealTimeHighlight(originalText, typedText);
-        displayDetailedComparison(originalText, typedText);
-        displayPerformanceAnalysis(stats);
+        int timeoutMs = finishing ? 5000 : max<int>(0, chrono::duration_cast<chrono::milliseconds>(nextSend - now).count());
+        int n = poller.wait(timeoutMs, [&](int fd, bool readable, bool) {
+            Racer& r = pool[byFd[fd]];
+            if (!readable || r.over) return;
+            char buffer[65536];
+            ssize_t got = read(fd, buffer, sizeof(buffer));
+            auto received = chrono::steady_clock::now();
+            if (got > 0) r.in.append(buffer, got);
+            size_t position = 0;
+            while (r.in.size() - position >= sizeof(FrameHeader)) {
+                FrameHeader h;
+                memcpy(&h, r.in.data() + position, sizeof(h));
+                if (r.in.size() - position - sizeof(h) < h.length) break;
+                const char* payload = r.in.data() + position + sizeof(h);
+                if (h.type == (uint8_t)MessageType::RaceUpdate) {
+                    broadcastsSeen++;
+                    for (size_t i = 0; i + sizeof(RaceEntry) <= h.length; i += sizeof(RaceEntry)) {
+                        RaceEntry e;
+                        memcpy(&e, payload + i, sizeof(e));
+                        if (e.place != 0 || e.racerId >= racerCount || e.seq == 0 || e.seq > sentAt[e.racerId].size()) continue;
+                        micros.push_back(chrono::duration<double, micro>(received - sentAt[e.racerId][e.seq - 1]).count());
+                    }
+                } else if (h.type == (uint8_t)MessageType::RaceOver) {
+                    r.over = true;
+                }
+                position += sizeof(h) + h.length;
+            }
+            r.in.erase(0, position);
+            if (r.over || got == 0) {
+                poller.remove(fd);
+                r.over = true;
+                active--;
+            }
+        });
+        if (n < 0 || (finishing && n == 0)) break;
     }
-    
-    void displayResults(const TypingStats& stats) {
-        cout << "\n===========================================\n";
-        cout << "              📊 RESULTS 📊\n";
-        cout << "===========================================\n";
-        cout << fixed << setprecision(2);
-        cout << "👤 Typist:            " << stats.name << "\n";
-        cout << "⏱️  Time Taken:        " << stats.time << " seconds\n";
-        cout << "🎯 Accuracy:          " << stats.accuracy << "%\n";
-        cout << "⚡ Typing Speed:      " << stats.wpm << " WPM\n";
-        cout << "✅ Correct Characters: " << stats.correctChars << "\n";
-        cout << "📝 Total Typed:       " << stats.totalChars << "\n";
-        cout << "❌ Errors:            " << stats.errors << "\n";
-        cout << "📊 Difficulty:        " << stats.difficulty << "\n";
-        cout << "📅 Date:              " << stats.date << "\n";
-        cout << "===========================================\n";
+    for (auto& r : pool) close(r.fd);
+
+    if (micros.empty()) {
+        cout << "❌ No race updates from " << socketPath << "\n";
+        return 1;
     }
-    
-    void displayPerformanceAnalysis(const TypingStats& stats) {
-        cout << "\n--- Performance Analysis ---\n";
-        
-        cout << "Speed Rating: ";
-        if (stats.wpm >= 80) cout << "⭐⭐⭐⭐⭐ Elite\n";
-        else if (stats.wpm >= 60) cout << "⭐⭐⭐⭐ Excellent\n";
-        else if (stats.wpm >= 40) cout << "⭐⭐⭐ Good\n";
-        else if (stats.wpm >= 25) cout << "⭐⭐ Average\n";
-        else if (stats.wpm > 0) cout << "⭐ Beginner\n";
-        else cout << "❌ Invalid timing\n";
-        
-        cout << "Accuracy Rating: ";
-        if (stats.accuracy >= 98) cout << "⭐⭐⭐⭐⭐ Perfect\n";
-        else if (stats.accuracy >= 95) cout << "⭐⭐⭐⭐ Excellent\n";
-        else if (stats.accuracy >= 90) cout << "⭐⭐⭐ Good\n";
-        else if (stats.accuracy >= 80) cout << "⭐⭐ Fair\n";
-        else cout << "⭐ Needs Practice\n";
-        
-        if (stats.wpm > 0) {
-            cout << "\n💡 Feedback:\n";
-            if (stats.wpm >= 60 && stats.accuracy >= 95) {
-                cout << "   Outstanding! You're in the top tier of typists.\n";
-            } else if (stats.wpm >= 40 && stats.accuracy >= 85) {
-                cout << "   Great work! Keep practicing to reach expert level.\n";
-            } else if (stats.accuracy < 80) {
-                cout << "   Focus on accuracy before speed. Slow down and reduce errors.\n";
-            } else if (stats.wpm < 40) {
-                cout << "   Practice regularly to build muscle memory and speed.\n";
+    size_t sent = 0;
+    for (const auto& s : sentAt) sent += s.size();
+    sort(micros.begin(), micros.end());
+    auto at = [&](double q) { return micros[min(micros.size() - 1, size_t(q * micros.size()))]; };
+    cout << "Racers: " << racers << " | progress updates: " << sent << " | broadcasts received: " << broadcastsSeen
+         << " | deliveries: " << micros.size() << "\n";
+    cout << fixed << setprecision(2) << "Update latency: p50 " << at(0.5) / 1000 << " ms, p99 " << at(0.99) / 1000
+         << " ms, max " << micros.back() / 1000 << " ms (one 60 Hz frame is 16.67 ms)\n";
+    return active > 0 ? 1 : 0;
+}
+
+// Re-scores every recording with the current rules and reports the ones
+// whose result would change, e.g. after editing the scorer.
+int rescoreRecordings(const string& path) {
+    RecordingLog log(path);
+    AlignmentScorer scorer;
+    string typed;
+    TypingStats stats;
+    size_t total = 0, changed = 0, damaged = 0;
+    uint64_t keys = 0;
+    auto start = chrono::steady_clock::now();
+    bool readable = log.scan([&](const SessionRecording& rec) {
+        total++;
+        keys += rec.keyCount;
+        if (!rescoreRecording(rec, scorer, typed, stats)) {
+            damaged++;
+        } else if (!matchesRecording(rec, stats)) {
+            if (changed++ < 20) {
+                cout << "  #" << total << " " << rec.name << " " << formatDate(rec.date) << ": " << fixed
+                     << setprecision(2) << rec.wpm << " → " << stats.wpm << " WPM, " << rec.accuracy << " → "
+                     << stats.accuracy << "%\n";
             }
         }
+    });
+    double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (!readable) {
+        cout << "❌ Could not read " << path << "\n";
+        return 1;
     }
-    
-    void viewHistory() {
-        if (history.empty()) {
-            cout << "\n❌ No typing history available yet!\n";
+    cout << "Re-scored " << total << " recordings (" << keys << " keystrokes) in " << fixed << setprecision(1)
+         << millis << " ms: " << changed << " changed, " << damaged << " damaged\n";
+    return changed > 0 || damaged > 0 ? 1 : 0;
+}
+
+// Runs the timing checks over every recording, e.g. after tightening them,
+// and lists the tests they reject. Tests flagged when recorded are counted
+// separately so a change in verdicts stands out.
+int auditRecordings(const string& path) {
+    RecordingLog log(path);
+    TimingValidator validator;
+    size_t total = 0, flagged = 0, newlyFlagged = 0, cleared = 0;
+    uint64_t keys = 0;
+    auto start = chrono::steady_clock::now();
+    bool readable = log.scan([&](const SessionRecording& rec) {
+        total++;
+        keys += rec.keyCount;
+        TimingVerdict verdict = validator.check(rec);
+        if (!verdict.suspicious()) {
+            cleared += rec.flagged;
             return;
         }
-        
-        cout << "\n===========================================\n";
-        cout << "         📈 TYPING HISTORY 📈\n";
-        cout << "===========================================\n\n";
-        
-        double avgWPM = 0, avgAccuracy = 0;
-        int validTests = 0;
-        
-        for (size_t i = 0; i < history.size(); i++) {
-            cout << "Test #" << (i + 1) << " - " << history[i].name << " [" << history[i].difficulty << "]\n";
-            cout << "  Speed: " << fixed << setprecision(2) << history[i].wpm << " WPM | ";
-            cout << "Accuracy: " << history[i].accuracy << "% | ";
-            cout << "Time: " << history[i].time << "s\n";
-            cout << "  Date: " << history[i].date << "\n\n";
-            
-            if (history[i].wpm > 0) {
-                avgWPM += history[i].wpm;
-                avgAccuracy += history[i].accuracy;
-                validTests++;
-            }
+        flagged++;
+        newlyFlagged += !rec.flagged;
+        if (flagged <= 50) {
+            cout << "  🚩 #" << total << " " << rec.name << " " << formatDate(rec.date) << " " << rec.difficulty
+                 << " " << fixed << setprecision(1) << rec.wpm << " WPM: " << verdict.describe() << "\n";
         }
-        
-        if (validTests > 0) {
-            avgWPM /= validTests;
-            avgAccuracy /= validTests;
-            
-            cout << "--- Overall Statistics ---\n";
-            cout << "Total Tests: " << history.size() << " (Valid: " << validTests << ")\n";
-            cout << "Average Speed: " << avgWPM << " WPM\n";
-            cout << "Average Accuracy: " << avgAccuracy << "%\n";
+    });
+    double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    if (!readable) {
+        cout << "❌ Could not read " << path << "\n";
+        return 1;
+    }
+    cout << "Checked " << total << " recordings (" << keys << " keystrokes) in " << fixed << setprecision(1)
+         << micros / 1000 << " ms, " << (total ? micros / total : 0) << " µs each: " << flagged << " flagged ("
+         << newlyFlagged << " not flagged when recorded), " << cleared << " cleared\n";
+    return 0;
+}
+
+int compactHistoryLog() {
+    SessionLog log("typing_history.log");
+    size_t skipped = 0;
+    long folded = compactHistory(log, "typing_history.col", &skipped);
+    if (folded < 0) {
+        cout << "❌ Failed to compact " << log.getPath() << "\n";
+        return 1;
+    }
+    cout << "✅ Folded " << folded << " tests into typing_history.col ("
+         << skipped << " corrupted records dropped)\n";
+    return 0;
+}
+
+// Builds the drill index over a word list and times 200-word drills against
+// randomly chosen weak features.
+int runDrillBenchmark(const string& wordListPath) {
+    DrillGenerator drills;
+    auto start = chrono::steady_clock::now();
+    if (!drills.loadWordList(wordListPath)) {
+        cout << "❌ Could not read a word list from " << wordListPath << "\n";
+        return 1;
+    }
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    
+    mt19937 rng(7);
+    vector<pair<uint32_t, double>> targets;
+    for (int i = 0; i < 48; i++) {
+        uint32_t a = 'a' + rng() % 26, b = 'a' + rng() % 26;
+        targets.push_back({i % 6 == 0 ? 65536 + a : a * 256 + b, 0.1 + (rng() % 100) / 25.0});
+    }
+    
+    const int rounds = 1000;
+    size_t checksum = 0;
+    string drill;
+    vector<double> micros;
+    for (int r = 0; r < rounds; r++) {
+        auto drillStart = chrono::steady_clock::now();
+        drills.setTargets(targets);
+        drills.generate(200, drill);
+        checksum += drill.size();
+        micros.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - drillStart).count());
+    }
+    sort(micros.begin(), micros.end());
+    double meanUs = 0;
+    for (double us : micros) meanUs += us / rounds;
+    
+    cout << "Words: " << drills.size() << " | index build: " << fixed << setprecision(1) << buildMs << " ms\n";
+    cout << "200-word drill: " << meanUs << " µs mean, " << micros[rounds * 99 / 100]
+         << " µs p99 over " << rounds << " drills (" << checksum / rounds << " chars each)\n";
+    return 0;
+}
+
+// Refills every board from the full history (snapshot plus unfolded log) and
+// replaces leaderboard.dat. Tests that failed timing validation stay off the
+// boards, as they were when recorded.
+int rebuildLeaderboard(size_t topK) {
+    auto start = chrono::steady_clock::now();
+    Leaderboard board(topK);
+    size_t offered = 0, flagged = 0;
+    
+    // Held shared so a compaction can't move rows between the two reads.
+    SessionLog log("typing_history.log");
+    log.lock(false);
+    HistorySnapshot snapshot;
+    snapshot.openSnapshot("typing_history.col");
+    vector<uint32_t> nameMap;
+    vector<uint16_t> difficultyMap;
+    for (uint32_t id = 0; id < snapshot.nameCount(); id++) {
+        nameMap.push_back(board.nameId(snapshot.name(id)));
+    }
+    for (uint32_t id = 0; id < snapshot.difficultyCount(); id++) {
+        difficultyMap.push_back(board.difficultyId(snapshot.difficulty(id)));
+    }
+    
+    if (snapshot.size() > 0) {
+        const double* wpm = snapshot.wpm();
+        const double* accuracy = snapshot.accuracy();
+        const int64_t* dates = snapshot.dates();
+        const uint32_t* nameIds = snapshot.nameIds();
+        const uint16_t* difficultyIds = snapshot.difficultyIds();
+        const uint8_t* flags = snapshot.flags();
+        for (size_t i = 0; i < snapshot.size(); i++) {
+            if (nameIds[i] >= nameMap.size() || difficultyIds[i] >= difficultyMap.size()) continue;
+            if (flags && flags[i]) {
+                flagged++;
+                continue;
+            }
+            board.add(nameMap[nameIds[i]], difficultyMap[difficultyIds[i]], wpm[i], accuracy[i], dates[i]);
+            offered++;
         }
-        cout << "===========================================\n";
     }
     
-    void updateLeaderboard(const TypingStats& stats) {
-        if (stats.wpm <= 0) return; // Don't add invalid entries
-        
-        leaderboard.push_back(stats);
-        
-        sort(leaderboard.begin(), leaderboard.end(), [](const TypingStats& a, const TypingStats& b) {
-            if (abs(a.wpm - b.wpm) < 0.01) {
-                return a.accuracy > b.accuracy;
+    if (log.readGeneration() > snapshot.logGeneration()) {
+        log.scan([&](const HistoryRecord& rec) {
+            if (SessionLog::isFlagged(rec)) {
+                flagged++;
+                return;
             }
-            return a.wpm > b.wpm;
+            board.add(string_view(rec.name, strnlen(rec.name, sizeof(rec.name))),
+                      string_view(rec.difficulty, strnlen(rec.difficulty, sizeof(rec.difficulty))),
+                      rec.wpm, rec.accuracy,
+                      parseDate(string_view(rec.date, strnlen(rec.date, sizeof(rec.date)))));
+            offered++;
         });
-        
-        if (leaderboard.size() > 10) {
-            leaderboard.resize(10);
-        }
     }
+    log.unlock();
+    double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
     
-    void displayLeaderboard() {
-        if (leaderboard.empty()) {
-            cout << "\n❌ Leaderboard is empty!\n";
-            return;
-        }
-        
-        cout << "\n===========================================\n";
-        cout << "         🏆 LEADERBOARD 🏆\n";
-        cout << "===========================================\n\n";
-        
-        cout << left << setw(5) << "Rank" << setw(15) << "Name" 
-             << setw(10) << "WPM" << setw(12) << "Accuracy" 
-             << setw(12) << "Difficulty" << "\n";
-        cout << string(54, '-') << "\n";
-        
-        for (size_t i = 0; i < leaderboard.size(); i++) {
-            string medal = "";
-            if (i == 0) medal = "🥇 ";
-            else if (i == 1) medal = "🥈 ";
-            else if (i == 2) medal = "🥉 ";
-            else medal = to_string(i + 1) + ".  ";
-            
-            cout << left << setw(5) << medal
-                 << setw(15) << leaderboard[i].name
-                 << setw(10) << fixed << setprecision(2) << leaderboard[i].wpm
-                 << setw(12) << leaderboard[i].accuracy << "%"
-                 << setw(12) << leaderboard[i].difficulty << "\n";
-        }
-        
-        cout << "===========================================\n";
+    FileLock lock("leaderboard.dat.lock");
+    if (!board.save("leaderboard.dat")) {
+        cout << "❌ Could not write leaderboard.dat\n";
+        return 1;
     }
+    cout << "✅ Rebuilt leaderboard (top " << topK << ") from " << offered << " tests in "
+         << fixed << setprecision(1) << millis << " ms";
+    if (flagged > 0) cout << ", leaving out " << flagged << " flagged";
+    cout << "\n";
+    return 0;
+}
+
+// Totals over the full history with the parallel column scan: the snapshot's
+// columns in place, then the unfolded log rows from a HistoryStore.
+int scanHistory(size_t threads) {
+    SessionLog log("typing_history.log");
+    log.lock(false);
+    HistorySnapshot snapshot;
+    snapshot.openSnapshot("typing_history.col");
+    HistoryStore store;
+    if (log.readGeneration() > snapshot.logGeneration()) {
+        store.load(log);
+    }
+    log.unlock();
     
-    void saveHistory() {
-        ofstream file("typing_history.txt");
-        if (!file.is_open()) return;
-        
-        for (const auto& stat : history) {
-            file << stat.name << "|" << stat.wpm << "|" << stat.accuracy << "|"
-                 << stat.time << "|" << stat.correctChars << "|" << stat.totalChars << "|"
-                 << stat.errors << "|" << stat.difficulty << "|" << stat.date << "\n";
-        }
-        
-        file.close();
+    auto start = chrono::steady_clock::now();
+    HistoryTotals totals;
+    if (snapshot.size() > 0) {
+        totals = scanHistoryTotals(snapshot.wpm(), snapshot.accuracy(), snapshot.time(), snapshot.size(), threads);
     }
+    totals.merge(scanHistoryTotals(store.wpm(), store.accuracy(), store.time(), store.size(), threads));
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
     
-    void loadHistory() {
-        ifstream file("typing_history.txt");
-        if (!file.is_open()) return;
-        
-        string line;
-        while (getline(file, line)) {
-            TypingStats stat;
-            stringstream ss(line);
-            string token;
-            
-            getline(ss, stat.name, '|');
-            getline(ss, token, '|'); stat.wpm = stod(token);
-            getline(ss, token, '|'); stat.accuracy = stod(token);
-            getline(ss, token, '|'); stat.time = stod(token);
-            getline(ss, token, '|'); stat.correctChars = stoi(token);
-            getline(ss, token, '|'); stat.totalChars = stoi(token);
-            getline(ss, token, '|'); stat.errors = stoi(token);
-            getline(ss, stat.difficulty, '|');
-            getline(ss, stat.date);
-            
-            history.push_back(stat);
-        }
-        
-        file.close();
+    if (totals.tests == 0) {
+        cout << "❌ No typing history available yet!\n";
+        return 1;
+    }
+    cout << "✅ Scanned " << totals.tests << " tests (" << snapshot.size() << " compacted, " << store.size()
+         << " in the log) on " << threads << " threads in " << fixed << setprecision(3) << seconds * 1000 << " ms\n";
+    cout << setprecision(0) << "⚡ " << (seconds > 0 ? totals.tests / seconds : 0) << " rows/sec\n";
+    cout << setprecision(2) << "📊 Valid: " << totals.valid << ", average " << totals.averageWpm() << " WPM, "
+         << totals.averageAccuracy() << "% accuracy, best " << totals.bestWpm << " WPM\n";
+    return 0;
+}
+
+// Filtered totals over the full history through a HistoryIndex, optionally
+// per local day or week.
+int queryHistory(const HistoryQuery& query) {
+    SessionLog log("typing_history.log");
+    log.lock(false);
+    HistorySnapshot snapshot;
+    snapshot.openSnapshot("typing_history.col");
+    HistoryStore store;
+    if (log.readGeneration() > snapshot.logGeneration()) {
+        store.load(log);
     }
+    log.unlock();
     
-    void saveLeaderboard() {
-        ofstream file("leaderboard.txt");
-        if (!file.is_open()) return;
-        
-        for (const auto& stat : leaderboard) {
-            file << stat.name << "|" << stat.wpm << "|" << stat.accuracy << "|"
-                 << stat.difficulty << "|" << stat.date << "\n";
+    auto start = chrono::steady_clock::now();
+    HistoryIndex index;
+    index.build(snapshot, store);
+    auto built = chrono::steady_clock::now();
+    HistoryQueryResult result = index.query(query);
+    auto done = chrono::steady_clock::now();
+    
+    cout << "🔎 " << (query.user.empty() ? "All users" : query.user) << ", "
+         << (query.difficulty.empty() ? "all difficulties" : query.difficulty);
+    if (query.from != numeric_limits<int64_t>::min()) cout << ", from " << formatDate(query.from).substr(0, 10);
+    if (query.to != numeric_limits<int64_t>::max()) cout << ", to " << formatDate(query.to - 1).substr(0, 10);
+    cout << "\n";
+    
+    const HistoryTotals& totals = result.totals;
+    if (totals.tests == 0) {
+        cout << "❌ No matching tests\n";
+    } else {
+        cout << "Tests: " << totals.tests << " (Valid: " << totals.valid << ")\n";
+        cout << fixed << setprecision(2) << "Average Speed: " << totals.averageWpm() << " WPM, best "
+             << totals.bestWpm << " WPM\n";
+        cout << "Average Accuracy: " << totals.averageAccuracy() << "%\n";
+        bool weeks = query.grouping == QueryGrouping::Week;
+        for (const StatsBucket& bucket : result.buckets) {
+            string label = weeks ? "Week of " + formatDay(bucket.key * 7 - 3) : formatDay(bucket.key);
+            cout << "  " << left << setw(20) << label << bucket.count << " tests, "
+                 << bucket.sumWpm / bucket.count << " WPM avg, " << bucket.bestWpm << " best, "
+                 << bucket.sumAccuracy / bucket.count << "% accuracy\n";
         }
-        
-        file.close();
     }
     
-    void loadLeaderboard() {
-        ifstream file("leaderboard.txt");
-        if (!file.is_open()) return;
-        
-        string line;
-        while (getline(file, line)) {
-            TypingStats stat;
-            stringstream ss(line);
-            string token;
-            
-            getline(ss, stat.name, '|');
-            getline(ss, token, '|'); stat.wpm = stod(token);
-            getline(ss, token, '|'); stat.accuracy = stod(token);
-            getline(ss, stat.difficulty, '|');
-            getline(ss, stat.date);
-            
-            leaderboard.push_back(stat);
+    double buildMillis = chrono::duration<double, milli>(built - start).count();
+    double queryMillis = chrono::duration<double, milli>(done - built).count();
+    cout << fixed << setprecision(3) << "⏱️  Indexed " << index.size() << " tests in " << buildMillis
+         << " ms; query took " << queryMillis << " ms\n";
+    return 0;
+}
+
+int importHistoryFile(const string& textPath) {
+    SessionLog log("typing_history.log");
+    startLogGeneration(log, "typing_history.col");
+    
+    long imported = log.importText(textPath);
+    if (imported < 0) {
+        cout << "❌ Could not read " << textPath << "\n";
+        return 1;
+    }
+    cout << "✅ Imported " << imported << " tests from " << textPath << "\n";
+    return 0;
+}
+
+// The benchmarks include this file and bring their own main.
+#ifndef TYPING_SPEED_NO_MAIN
+int main(int argc, char* argv[]) {
+    int fsyncEvery = 0;
+    string corpusPath;
+    size_t topK = 10;
+    bool rebuildBoards = false;
+    string wordListPath;
+    bool benchDrill = false;
+    string batchInput;
+    string batchOutput = "batch_results.txt";
+    size_t threads = max(1u, thread::hardware_concurrency());
+    bool serve = false;
+    bool connectToServer = false;
+    string socketPath = "leaderboard.sock";
+    size_t loadClients = 0;
+    size_t loadRequests = 100;
+    bool raceHub = false;
+    bool joinRace = false;
+    double raceBenchSeconds = 0;
+    size_t racers = 2;
+    int raceDifficulty = 2;
+    string socketOption;
+    bool listRecordings = false;
+    string recordingUser;
+    size_t replayNumber = 0;
+    double replaySpeed = 1;
+    size_t replaySeek = 0;
+    bool showStats = false;
+    string tracePath;
+    bool historyScan = false;
+    bool historyQuery = false;
+    HistoryQuery query;
+    
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--compact") {
+            return compactHistoryLog();
+        } else if (arg == "--bench-scoring") {
+            return runScoringBenchmark();
+        } else if (arg == "--import-history" && i + 1 < argc) {
+            return importHistoryFile(argv[++i]);
+        } else if (arg == "--batch-score" && i + 1 < argc) {
+            batchInput = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            batchOutput = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = max(1, atoi(argv[++i]));
+        } else if (arg == "--fsync-every" && i + 1 < argc) {
+            fsyncEvery = atoi(argv[++i]);
+        } else if (arg == "--corpus" && i + 1 < argc) {
+            corpusPath = argv[++i];
+        } else if (arg == "--top" && i + 1 < argc) {
+            topK = max(1, atoi(argv[++i]));
+        } else if (arg == "--rebuild-leaderboard") {
+            rebuildBoards = true;
+        } else if (arg == "--words" && i + 1 < argc) {
+            wordListPath = argv[++i];
+        } else if (arg == "--bench-drill") {
+            benchDrill = true;
+        } else if (arg == "--scan-history") {
+            historyScan = true;
+        } else if (arg == "--serve") {
+            serve = true;
+        } else if (arg == "--connect") {
+            connectToServer = true;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            socketOption = argv[++i];
+        } else if (arg == "--load-test" && i + 1 < argc) {
+            loadClients = max(1, atoi(argv[++i]));
+        } else if (arg == "--requests" && i + 1 < argc) {
+            loadRequests = max(1, atoi(argv[++i]));
+        } else if (arg == "--race-hub") {
+            raceHub = true;
+        } else if (arg == "--race") {
+            joinRace = true;
+        } else if (arg == "--race-bench" && i + 1 < argc) {
+            raceBenchSeconds = max(1.0, atof(argv[++i]));
+        } else if (arg == "--racers" && i + 1 < argc) {
+            racers = max(1, atoi(argv[++i]));
+        } else if (arg == "--recordings") {
+            listRecordings = true;
+        } else if (arg == "--user" && i + 1 < argc) {
+            recordingUser = argv[++i];
+            query.user = recordingUser;
+        } else if (arg == "--query") {
+            historyQuery = true;
+        } else if ((arg == "--from" || arg == "--to") && i + 1 < argc) {
+            string day = argv[++i];
+            int64_t date = parseDate(day + (arg == "--from" ? " 00:00:00" : " 23:59:59"));
+            if (date == 0 || formatDate(date).compare(0, 10, day) != 0) {
+                cout << "❌ Invalid date " << day << " (expected YYYY-MM-DD)\n";
+                return 1;
+            }
+            if (arg == "--from") query.from = date;
+            else query.to = date + 1;
+        } else if (arg == "--days" && i + 1 < argc) {
+            query.from = (int64_t)time(0) - int64_t(max(1, atoi(argv[++i]))) * 86400;
+        } else if (arg == "--group" && i + 1 < argc) {
+            string grouping = argv[++i];
+            query.grouping = grouping == "week" ? QueryGrouping::Week
+                           : grouping == "day" ? QueryGrouping::Day : QueryGrouping::None;
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayNumber = max(1, atoi(argv[++i]));
+        } else if (arg == "--speed" && i + 1 < argc) {
+            replaySpeed = max(0.0, atof(argv[++i]));
+        } else if (arg == "--seek" && i + 1 < argc) {
+            replaySeek = max(0, atoi(argv[++i]));
+        } else if (arg == "--rescore-recordings") {
+            return rescoreRecordings("typing_sessions.rec");
+        } else if (arg == "--audit-recordings") {
+            return auditRecordings("typing_sessions.rec");
+        } else if (arg == "--stats") {
+            showStats = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--difficulty" && i + 1 < argc) {
+            query.difficulty = argv[++i];
+        } else if (arg == "--level" && i + 1 < argc) {
+            raceDifficulty = min(4, max(1, atoi(argv[++i])));
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
         }
-        
-        file.close();
     }
     
-    void displayMenu() {
-        cout << "\n===========================================\n";
-        cout << "    ⌨️  TYPING SPEED CHECKER PRO ⌨️\n";
-        cout << "===========================================\n";
-        cout << "1. 🟢 Easy Mode\n";
-        cout << "2. 🟡 Medium Mode\n";
-        cout << "3. 🟠 Hard Mode\n";
-        cout << "4. 🔴 Expert Mode\n";
-        cout << "5. ⏱️  60-Second Timed Mode\n";
-        cout << "6. 📝 Custom Text Mode\n";
-        cout << "7. 📈 View History\n";
-        cout << "8. 🏆 View Leaderboard\n";
-        cout << "9. 🚪 Exit\n";
-        cout << "===========================================\n";
-        cout << "Enter your choice: ";
+    ProbeReport probeReport(showStats, tracePath);
+    
+    if (!batchInput.empty()) {
+        return runBatchScoring(batchInput, batchOutput, threads);
     }
-};
-
-int main() {
+    if (rebuildBoards) {
+        return rebuildLeaderboard(topK);
+    }
+    if (benchDrill) {
+        return runDrillBenchmark(wordListPath.empty() ? "words.txt" : wordListPath);
+    }
+    if (historyScan) {
+        return scanHistory(threads);
+    }
+    if (historyQuery) {
+        return queryHistory(query);
+    }
+    // Races and the leaderboard daemon use separate sockets by default so one
+    // of each can run side by side.
+    string raceSocketPath = socketOption.empty() ? "race.sock" : socketOption;
+    if (!socketOption.empty()) {
+        socketPath = socketOption;
+    }
+    if (raceHub) {
+        return runRaceHub(raceSocketPath, racers, raceDifficulty, corpusPath);
+    }
+    if (raceBenchSeconds > 0) {
+        return runRaceBenchmark(raceSocketPath, racers, raceBenchSeconds);
+    }
+    if (serve) {
+        return runServer(socketPath, topK, fsyncEvery);
+    }
+    if (loadClients > 0) {
+        return runLoadTest(socketPath, loadClients, loadRequests);
+    }
+    
     TypingSpeedChecker checker;
+    checker.setFsyncEvery(fsyncEvery);
+    checker.setLeaderboardSize(topK);
+    if (!wordListPath.empty()) {
+        checker.setWordList(wordListPath);
+    }
+    if (!corpusPath.empty()) {
+        checker.setCorpus(corpusPath);
+    }
+    if (listRecordings) {
+        checker.listRecordings(recordingUser);
+        return 0;
+    }
+    if (replayNumber > 0) {
+        return checker.replayRecording(replayNumber, replaySpeed, replaySeek) ? 0 : 1;
+    }
+    if (connectToServer) {
+        // A daemon that exits between tests must not kill the session on
+        // the next submit; the write fails and the result is kept locally.
+        signal(SIGPIPE, SIG_IGN);
+        if (!checker.connectServer(socketPath)) {
+            cout << "⚠️ No leaderboard server on " << socketPath << ", results stay local\n";
+        }
+    }
     int choice;
     string difficultyLevel;
     string userName;
@@ -625,11 +8813,24 @@ int main() {
     checker.setUser(userName);
     cout << "\nWelcome, " << userName << "! 🎉\n";
     
+    if (joinRace) {
+        signal(SIGPIPE, SIG_IGN);
+        checker.raceMode(raceSocketPath);
+        cout << "\n🔄 Press ENTER to continue...\n";
+        cin.get();
+    }
+    
     while (true) {
         checker.displayMenu();
-        cin >> choice;
+        if (!(cin >> choice)) {
+            if (cin.eof()) break;
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "\n❌ Invalid choice! Please try again.\n";
+            continue;
+        }
         
-        if (choice == 9) {
+        if (choice == 0) {
             cout << "\n👋 Thanks for practicing, " << userName << "! Keep improving!\n";
             cout << "Your progress has been saved. 💾\n";
             break;
@@ -641,7 +8842,7 @@ int main() {
             cin.ignore();
             cin.get();
         } else if (choice == 5) {
-            checker.timedMode();
+            checker.timedMode(checker.selectDuration());
             cout << "\n🔄 Press ENTER to continue...\n";
             cin.ignore();
             cin.get();
@@ -652,13 +8853,17 @@ int main() {
         } else if (choice == 7) {
             checker.viewHistory();
             cout << "\n🔄 Press ENTER to continue...\n";
-            cin.ignore();
             cin.get();
         } else if (choice == 8) {
             checker.displayLeaderboard();
             cout << "\n🔄 Press ENTER to continue...\n";
             cin.ignore();
             cin.get();
+        } else if (choice == 9) {
+            checker.drillMode();
+            cout << "\n🔄 Press ENTER to continue...\n";
+            cin.ignore();
+            cin.get();
         } else {
             cout << "\n❌ Invalid choice! Please try again.\n";
             cin.ignore();
@@ -666,4 +8871,5 @@ int main() {
     }
     
     return 0;
-}
\ No newline at end of file
+}
+#endif